@@ -0,0 +1,48 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include "arena.h"
+
+Arena *createArena(size_t blockSize) {
+    auto arena = new Arena;
+    arena->blockSize = blockSize;
+    arena->block = 0;
+    arena->used = 0;
+    return arena;
+}
+
+void destroyArena(Arena *arena) {
+    for (auto &block : arena->blocks) {
+        delete[] block.data;
+    }
+    delete arena;
+}
+
+void *arenaAllocate(Arena *arena, size_t bytes, size_t align) {
+    for (;;) {
+        if (arena->block < arena->blocks.size()) {
+            const ArenaBlock &block = arena->blocks[arena->block];
+            size_t start = (arena->used + align - 1) / align * align;
+            if (start + bytes <= block.size) {
+                arena->used = start + bytes;
+                return block.data + start;
+            }
+            if (arena->block + 1 < arena->blocks.size()) {
+                // what is left of this block stays unused until the reset
+                arena->block++;
+                arena->used = 0;
+                continue;
+            }
+        }
+        // new blocks go to the end, so a reset arena walks them in the same order
+        size_t size = std::max(arena->blockSize, bytes + align);
+        arena->blocks.push_back({new char[size], size});
+        arena->block = arena->blocks.size() - 1;
+        arena->used = 0;
+    }
+}
+
+void resetArena(Arena *arena) {
+    arena->block = 0;
+    arena->used = 0;
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <type_traits>
+#include <vector>
+
+struct ArenaBlock {
+    char *data;
+    size_t size;
+};
+
+/*
+ * Bump allocator for data that dies together, e.g. everything laid out for a
+ * frame or for a document. Nothing is freed on its own; resetArena() drops it
+ * all at once and keeps the blocks, so an arena that has grown to a frame's
+ * worth never goes to the heap again. Nothing is destructed either, so only
+ * trivially destructible types go in.
+ */
+struct Arena {
+    std::vector<ArenaBlock> blocks;
+    size_t blockSize;
+    size_t block;               // the block being filled
+    size_t used;                // bytes taken from it
+};
+
+Arena *createArena(size_t blockSize = 64 * 1024);
+
+void destroyArena(Arena *arena);
+
+void *arenaAllocate(Arena *arena, size_t bytes, size_t align);
+
+// Everything allocated so far becomes invalid.
+void resetArena(Arena *arena);
+
+// Uninitialized room for count Ts.
+template<typename T>
+T *arenaArray(Arena *arena, size_t count) {
+    static_assert(std::is_trivially_destructible<T>::value, "arena memory is never destructed");
+    return (T *) arenaAllocate(arena, count * sizeof(T), alignof(T));
+}
+
+#endif
@@ -0,0 +1,151 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <cmath>
+#include "atlas.h"
+#include "profiler.h"
+#include "sdf.h"
+
+bool isAtlasStale(const Atlas *atlas, const GlyphCache *glyphCache) {
+    if (atlas->cache != glyphCache) {
+        return true;
+    }
+    if (atlas->pending && atlas->completed != glyphCache->completed) {
+        return true;
+    }
+    for (int i = 0; i < atlas->rc; ++i) {
+        const AtlasRange &range = atlas->ranges[i];
+        if (glyphCache->pages[range.page].generation != range.generation) {
+            return true;
+        }
+    }
+    return false;
+}
+
+Atlas *createAtlas(Arena *arena, const ParagraphLayout *layout, float x, float y, GlyphMode mode, int pageCount) {
+    size_t count = layout->glyphs.size();
+    Atlas *atlas = arenaArray<Atlas>(arena, 1);
+    atlas->size = layout->size;
+    atlas->mode = mode;
+    GlyphRun &run = atlas->run;
+    run.glyphs = arenaArray<unsigned int>(arena, count);
+    run.clusters = arenaArray<unsigned int>(arena, count);
+    run.x = arenaArray<float>(arena, count);
+    run.y = arenaArray<float>(arena, count);
+    run.faces = arenaArray<FaceRun>(arena, layout->faces.size());
+    placeGlyphRun(layout, x, y, &run);
+    atlas->resolved = arenaArray<Glyph>(arena, run.count);
+    atlas->vertices = arenaArray<Point>(arena, run.count * 4);
+    atlas->vc = 0;
+    atlas->ranges = arenaArray<AtlasRange>(arena, pageCount);
+    atlas->rc = 0;
+    atlas->pages = arenaArray<AtlasRange>(arena, pageCount);
+    atlas->pageCount = pageCount;
+    atlas->pending = 0;
+    atlas->completed = 0;
+    atlas->cache = nullptr;
+    return atlas;
+}
+
+/*
+ * Resolves every placed glyph through the shared cache and writes the quads
+ * grouped by atlas page, so each page is one contiguous range of indices.
+ */
+void buildAtlas(Atlas *atlas, GlyphCache *glyphCache) {
+    PROFILE_SCOPE("build");
+    const GlyphRun &run = atlas->run;
+    Glyph *resolved = atlas->resolved;
+    int pageCount = atlas->pageCount;
+    // first counts quads until the ranges are laid out, then is the next free one
+    AtlasRange *pages = atlas->pages;
+    for (int p = 0; p < pageCount; ++p) {
+        pages[p] = {p, 0, 0, 0};
+    }
+    unsigned long evictions = glyphCache->evictions;
+    atlas->cache = glyphCache;
+    atlas->pending = 0;
+    atlas->completed = glyphCache->completed;
+    unsigned int size = atlas->size;
+    float quadScale = 1.0f;
+    if (atlas->mode == GLYPH_SDF) {
+        size = SDF_BASE_SIZE;
+        quadScale = (float) atlas->size / SDF_BASE_SIZE;
+        // one batch per face span, the ids are already contiguous
+        for (int f = 0; f < run.faceCount; ++f) {
+            int first = run.faces[f].first;
+            prefetchGlyphs(glyphCache, run.faces[f].face, run.glyphs + first, faceRunEnd(&run, f) - first, size,
+                           GLYPH_SDF);
+        }
+    }
+    for (int f = 0; f < run.faceCount; ++f) {
+        FT_Face face = run.faces[f].face;
+        for (int i = run.faces[f].first, end = faceRunEnd(&run, f); i < end; ++i) {
+            resolved[i] = *cacheGlyph(glyphCache, face, run.glyphs[i], size, atlas->mode);
+            int page = resolved[i].page;
+            if (page == GLYPH_PENDING) {
+                atlas->pending++;
+            } else if (page >= 0) {
+                pages[page].generation = glyphCache->pages[page].generation;
+                pages[page].first++;
+            }
+        }
+    }
+
+    atlas->rc = 0;
+    int quadCount = 0;
+    for (int p = 0; p < pageCount; ++p) {
+        int quads = pages[p].first;
+        if (!quads) {
+            continue;
+        }
+        atlas->ranges[atlas->rc++] = {p, pages[p].generation, quadCount * 6, quads * 6};
+        pages[p].first = quadCount;
+        quadCount += quads;
+    }
+
+    float scale = 1.0f / glyphCache->pageSize;
+    for (int i = 0; i < run.count; ++i) {
+        const Glyph &g = resolved[i];
+        if (g.page < 0) {
+            continue;
+        }
+        float s0 = g.x * scale;
+        float t0 = g.y * scale;
+        float s1 = s0 + g.w * scale;
+        float t1 = t0 + g.h * scale;
+        float x0, y0, x1, y1;
+        if (atlas->mode == GLYPH_SDF) {
+            // fields filter smoothly at any scale, no pixel snapping
+            x0 = run.x[i] + g.left * quadScale;
+            y0 = run.y[i] + g.top * quadScale;
+            x1 = x0 + g.w * quadScale;
+            y1 = y0 - g.h * quadScale;
+        } else {
+            x0 = run.x[i] + g.left;
+            y0 = floor(run.y[i] + g.top);
+            x1 = x0 + g.w;
+            y1 = floor(y0 - g.h);
+        }
+
+        int vc = pages[g.page].first++ * 4;
+        atlas->vertices[vc++] = {
+                x0, y0, s0, t0
+        };
+        atlas->vertices[vc++] = {
+                x0, y1, s0, t1
+        };
+        atlas->vertices[vc++] = {
+                x1, y1, s1, t1
+        };
+        atlas->vertices[vc++] = {
+                x1, y0, s1, t0
+        };
+    }
+    atlas->vc = quadCount * 4;
+    if (glyphCache->evictions != evictions) {
+        // a page was recycled halfway through, so some quads may point at
+        // wiped texels; leave the ranges stale and try again on the next draw
+        for (int i = 0; i < atlas->rc; ++i) {
+            atlas->ranges[i].generation = 0;
+        }
+    }
+}
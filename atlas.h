@@ -0,0 +1,61 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <glad/glad.h>
+#include "arena.h"
+#include "glyph_cache.h"
+#include "text_layout.h"
+
+struct Point {
+    GLfloat x;
+    GLfloat y;
+    GLfloat s;
+    GLfloat t;
+};
+
+typedef struct {
+    int page;
+    unsigned int generation;
+    int first;
+    int count;
+} AtlasRange;
+
+/*
+ * Placed glyphs and the quads they are drawn with, all from one arena: it is
+ * built once, rebuilt in place when pages move, and freed with everything
+ * else in the arena. Building never allocates.
+ */
+typedef struct {
+    unsigned int size;
+    GlyphMode mode;             // GLYPH_SDF quads are scaled up from SDF_BASE_SIZE
+    GlyphRun run;
+    Glyph *resolved;            // per glyph of run, scratch
+    Point *vertices;            // 4 per drawn glyph, grouped by page
+    int vc;
+    AtlasRange *ranges;
+    int rc;
+    AtlasRange *pages;          // per cache page, scratch
+    int pageCount;
+    int pending;                // glyphs left out because workers are still rasterizing them
+    unsigned long completed;    // GlyphCache::completed when the quads were built
+    const GlyphCache *cache;    // what the quads were built against, null before buildAtlas()
+} Atlas;
+
+/*
+ * Places layout with the first baseline at (x, y) and makes room for its quads
+ * on a cache of pageCount pages. Everything lives in arena; buildAtlas() fills
+ * the quads in.
+ */
+Atlas *createAtlas(Arena *arena, const ParagraphLayout *layout, float x, float y, GlyphMode mode, int pageCount);
+
+// True when a page the quads were built against has been recycled since, or
+// when glyphs that were pending may have arrived. Page generations only mean
+// something within one cache, so an atlas not built against glyphCache is
+// always stale.
+bool isAtlasStale(const Atlas *atlas, const GlyphCache *glyphCache);
+
+void buildAtlas(Atlas *atlas, GlyphCache *glyphCache);
+
+#endif
@@ -0,0 +1,185 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <cstring>
+#include "blend.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLEND_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// GCC and Clang build the AVX2 kernel with a target attribute and pick it at
+// run time; MSVC only when the whole program targets AVX2.
+#if defined(BLEND_HAVE_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define BLEND_HAVE_AVX2 1
+#define BLEND_AVX2_TARGET __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(BLEND_HAVE_SSE2) && defined(__AVX2__)
+#define BLEND_HAVE_AVX2 1
+#define BLEND_AVX2_TARGET
+#include <immintrin.h>
+#endif
+
+// x / 255 rounded to nearest, exact for every x up to 255 * 255
+static inline unsigned int div255(unsigned int x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+static void blendScalar(unsigned char *dst, const unsigned char *coverage, int count,
+                        const unsigned char color[4], unsigned int alpha) {
+    for (int i = 0; i < count; ++i, dst += 4) {
+        unsigned int a = div255(coverage[i] * alpha);
+        if (!a) {
+            continue;
+        }
+        for (int c = 0; c < 4; ++c) {
+            dst[c] = (unsigned char) div255(dst[c] * (255 - a) + color[c] * a);
+        }
+    }
+}
+
+#ifdef BLEND_HAVE_SSE2
+static inline __m128i div255x8(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// Two pixels as 16 bit channels, weights already spread over each channel.
+static inline __m128i blendPair(__m128i dst, __m128i src, __m128i a) {
+    __m128i inverse = _mm_sub_epi16(_mm_set1_epi16(255), a);
+    return div255x8(_mm_add_epi16(_mm_mullo_epi16(dst, inverse), _mm_mullo_epi16(src, a)));
+}
+
+// Four pixels; inlines into the AVX2 kernel as VEX code for its tail.
+static inline void blendFour(unsigned char *dst, int packed, __m128i src, __m128i alpha16) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i a = div255x8(_mm_mullo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero), alpha16));
+    a = _mm_unpacklo_epi16(a, a);
+    __m128i a01 = _mm_unpacklo_epi32(a, a);
+    __m128i a23 = _mm_unpackhi_epi32(a, a);
+    __m128i pixels = _mm_loadu_si128((const __m128i *) dst);
+    __m128i lo = blendPair(_mm_unpacklo_epi8(pixels, zero), src, a01);
+    __m128i hi = blendPair(_mm_unpackhi_epi8(pixels, zero), src, a23);
+    _mm_storeu_si128((__m128i *) dst, _mm_packus_epi16(lo, hi));
+}
+
+// Blends whole groups of four and returns how many pixels it covered.
+static inline int blendFours(unsigned char *dst, const unsigned char *coverage, int count,
+                             const unsigned char color[4], unsigned int alpha) {
+    __m128i alpha16 = _mm_set1_epi16((short) alpha);
+    __m128i src = _mm_set_epi16(color[3], color[2], color[1], color[0], color[3], color[2], color[1], color[0]);
+    int i = 0;
+    for (; i + 4 <= count; i += 4, dst += 16) {
+        int packed;
+        memcpy(&packed, coverage + i, 4);
+        if (packed) {
+            blendFour(dst, packed, src, alpha16);
+        }
+    }
+    return i;
+}
+
+static void blendSSE2(unsigned char *dst, const unsigned char *coverage, int count,
+                      const unsigned char color[4], unsigned int alpha) {
+    int i = blendFours(dst, coverage, count, color, alpha);
+    blendScalar(dst + i * 4, coverage + i, count - i, color, alpha);
+}
+#endif
+
+#ifdef BLEND_HAVE_AVX2
+BLEND_AVX2_TARGET
+static inline __m256i div255x16(__m256i x) {
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+BLEND_AVX2_TARGET
+static inline __m256i blendQuad(__m256i dst, __m256i src, __m256i a) {
+    __m256i inverse = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+    return div255x16(_mm256_add_epi16(_mm256_mullo_epi16(dst, inverse), _mm256_mullo_epi16(src, a)));
+}
+
+BLEND_AVX2_TARGET
+static void blendAVX2(unsigned char *dst, const unsigned char *coverage, int count,
+                      const unsigned char color[4], unsigned int alpha) {
+    __m256i src = _mm256_setr_epi16(color[0], color[1], color[2], color[3], color[0], color[1], color[2], color[3],
+                                    color[0], color[1], color[2], color[3], color[0], color[1], color[2], color[3]);
+    // spreads the weights of pixels 0-3 (and 4-7) of eight 16 bit lanes over
+    // their four channels; pixels 0-1 land in the low 128 bit lane, 2-3 high
+    __m256i spreadLow = _mm256_setr_epi8(0, 1, 0, 1, 0, 1, 0, 1, 2, 3, 2, 3, 2, 3, 2, 3,
+                                         4, 5, 4, 5, 4, 5, 4, 5, 6, 7, 6, 7, 6, 7, 6, 7);
+    __m256i spreadHigh = _mm256_setr_epi8(8, 9, 8, 9, 8, 9, 8, 9, 10, 11, 10, 11, 10, 11, 10, 11,
+                                          12, 13, 12, 13, 12, 13, 12, 13, 14, 15, 14, 15, 14, 15, 14, 15);
+    __m128i alpha16 = _mm_set1_epi16((short) alpha);
+    int i = 0;
+    for (; i + 8 <= count; i += 8, dst += 32) {
+        unsigned long long packed;
+        memcpy(&packed, coverage + i, 8);
+        if (!packed) {
+            continue;
+        }
+        __m128i cover = _mm_loadl_epi64((const __m128i *) (coverage + i));
+        __m128i a = _mm_mullo_epi16(_mm_cvtepu8_epi16(cover), alpha16);
+        a = _mm_add_epi16(a, _mm_set1_epi16(128));
+        a = _mm_srli_epi16(_mm_add_epi16(a, _mm_srli_epi16(a, 8)), 8);
+        __m256i weights = _mm256_broadcastsi128_si256(a);
+        __m128i first = _mm_loadu_si128((const __m128i *) dst);
+        __m128i second = _mm_loadu_si128((const __m128i *) (dst + 16));
+        __m256i p0 = blendQuad(_mm256_cvtepu8_epi16(first), src, _mm256_shuffle_epi8(weights, spreadLow));
+        __m256i p1 = blendQuad(_mm256_cvtepu8_epi16(second), src, _mm256_shuffle_epi8(weights, spreadHigh));
+        // packus works per 128 bit lane, put the pixels back in order after it
+        __m256i result = _mm256_permute4x64_epi64(_mm256_packus_epi16(p0, p1), 0xd8);
+        _mm256_storeu_si256((__m256i *) dst, result);
+    }
+    // clean upper halves, or the legacy SSE code after us stalls
+    _mm256_zeroupper();
+    int j = blendFours(dst, coverage + i, count - i, color, alpha);
+    blendScalar(dst + j * 4, coverage + i + j, count - i - j, color, alpha);
+}
+#endif
+
+BlendKernel bestBlendKernel() {
+#if defined(BLEND_HAVE_AVX2) && defined(__AVX2__)
+    return BLEND_AVX2;
+#elif defined(BLEND_HAVE_AVX2)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return BLEND_AVX2;
+    }
+    return BLEND_SSE2;
+#elif defined(BLEND_HAVE_SSE2)
+    return BLEND_SSE2;
+#else
+    return BLEND_SCALAR;
+#endif
+}
+
+const char *blendKernelName(BlendKernel kernel) {
+    switch (kernel) {
+        case BLEND_SSE2:
+            return "sse2";
+        case BLEND_AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
+
+void blendSpan(BlendKernel kernel, unsigned char *dst, const unsigned char *coverage, int count,
+               const unsigned char color[4], unsigned int alpha) {
+    switch (kernel) {
+#ifdef BLEND_HAVE_AVX2
+        case BLEND_AVX2:
+            blendAVX2(dst, coverage, count, color, alpha);
+            return;
+#endif
+#ifdef BLEND_HAVE_SSE2
+        case BLEND_SSE2:
+            blendSSE2(dst, coverage, count, color, alpha);
+            return;
+#endif
+        default:
+            blendScalar(dst, coverage, count, color, alpha);
+    }
+}
@@ -0,0 +1,26 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef BLEND_H
+#define BLEND_H
+
+enum BlendKernel {
+    BLEND_SCALAR,
+    BLEND_SSE2,
+    BLEND_AVX2
+};
+
+// Fastest kernel the running CPU supports.
+BlendKernel bestBlendKernel();
+
+const char *blendKernelName(BlendKernel kernel);
+
+/*
+ * Blends color over count 4-byte pixels, each weighted by its coverage byte
+ * times alpha / 255. color is in the framebuffer's byte order and its 4th
+ * byte is the alpha written for full coverage. All kernels round the same
+ * way, so their output is bit identical.
+ */
+void blendSpan(BlendKernel kernel, unsigned char *dst, const unsigned char *coverage, int count,
+               const unsigned char color[4], unsigned int alpha);
+
+#endif
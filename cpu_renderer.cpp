@@ -0,0 +1,88 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include <cmath>
+#include "cpu_renderer.h"
+#include "image_write.h"
+#include "profiler.h"
+
+static unsigned char toByte(float v) {
+    return (unsigned char) std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255);
+}
+
+// r, g, b and opaque alpha in the framebuffer's byte order
+static void packColor(PixelFormat format, float r, float g, float b, unsigned char color[4]) {
+    color[0] = toByte(format == PIXEL_BGRA ? b : r);
+    color[1] = toByte(g);
+    color[2] = toByte(format == PIXEL_BGRA ? r : b);
+    color[3] = 255;
+}
+
+CPURenderer *createCPURenderer(GlyphCache *glyphCache, int width, int height, PixelFormat format) {
+    auto renderer = new CPURenderer;
+    renderer->glyphCache = glyphCache;
+    renderer->width = width;
+    renderer->height = height;
+    renderer->format = format;
+    renderer->kernel = bestBlendKernel();
+    renderer->pixels.assign((size_t) width * height * 4, 0);
+    return renderer;
+}
+
+void CPURenderer::clear(float r, float g, float b) {
+    unsigned char color[4];
+    packColor(format, r, g, b, color);
+    // pixels can be longer than the image, when the owner reuses it for smaller ones
+    for (size_t i = 0, end = (size_t) width * height * 4; i < end; i += 4) {
+        std::copy(color, color + 4, &pixels[i]);
+    }
+}
+
+/*
+ * Same placement rules as the GL paths, in their y-up space: the glyph's top
+ * row sits at floor(y + top), which is framebuffer row height - that.
+ */
+void CPURenderer::drawText(Atlas *atlas, float r, float g, float b) {
+    PROFILE_SCOPE("composite");
+    unsigned char color[4];
+    packColor(format, r, g, b, color);
+    int pageSize = glyphCache->pageSize;
+    const GlyphRun &run = atlas->run;
+    // a bitmap atlas current for this cache already holds its glyphs, the cache is only read
+    bool current = atlas->mode == GLYPH_BITMAP && !isAtlasStale(atlas, glyphCache);
+    for (int f = 0; f < run.faceCount; ++f) {
+        FT_Face face = run.faces[f].face;
+        for (int i = run.faces[f].first, end = faceRunEnd(&run, f); i < end; ++i) {
+            const Glyph *glyph = current ? &atlas->resolved[i] : cacheGlyph(glyphCache, face, run.glyphs[i],
+                                                                              atlas->size);
+            if (glyph->page < 0) {
+                continue;
+            }
+            int x0 = (int) std::lround(run.x[i] + glyph->left);
+            int row0 = height - (int) std::floor(run.y[i] + glyph->top);
+            int left = std::max(x0, 0);
+            int right = std::min(x0 + glyph->w, width);
+            if (left >= right) {
+                continue;
+            }
+            const unsigned char *page = glyphCache->pages[glyph->page].pixels.data();
+            for (int row = std::max(row0, 0); row < std::min(row0 + glyph->h, height); ++row) {
+                const unsigned char *coverage = page + (size_t) (glyph->y + row - row0) * pageSize +
+                                                glyph->x + (left - x0);
+                blendSpan(kernel, &pixels[((size_t) row * width + left) * 4], coverage, right - left, color, 255);
+            }
+        }
+    }
+}
+
+bool saveCPURenderer(const CPURenderer *renderer, const char *path) {
+    if (renderer->format == PIXEL_RGBA) {
+        return saveImage(path, renderer->width, renderer->height, 4, renderer->pixels.data(), 0) != 0;
+    }
+    const unsigned char *pixels = renderer->pixels.data();
+    std::vector<unsigned char> rgba(pixels, pixels + (size_t) renderer->width * renderer->height * 4);
+    for (size_t i = 0; i < rgba.size(); i += 4) {
+        std::swap(rgba[i], rgba[i + 2]);
+    }
+    return saveImage(path, renderer->width, renderer->height, 4, rgba.data(), 0) != 0;
+}
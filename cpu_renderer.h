@@ -0,0 +1,45 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef CPU_RENDERER_H
+#define CPU_RENDERER_H
+
+#include <vector>
+#include "blend.h"
+#include "glyph_cache.h"
+#include "text_renderer.h"
+
+enum PixelFormat {
+    PIXEL_RGBA,
+    PIXEL_BGRA
+};
+
+/*
+ * Software compositor over an in-memory framebuffer, for thumbnails and
+ * image generation without a GPU. It reads coverage from the glyph cache's
+ * CPU mirror, so that cache needs GLYPH_STORAGE_CPU. Glyphs are placed on
+ * whole pixels like the instanced path; SDF atlases are drawn from bitmaps.
+ * Bitmap atlases that are not stale are drawn from the glyphs they resolved
+ * without writing to the cache, so renderers on several threads can draw at
+ * once while nothing else uses it.
+ */
+struct CPURenderer : TextRenderer {
+    GlyphCache *glyphCache;
+    int width;
+    int height;
+    PixelFormat format;
+    BlendKernel kernel;
+    std::vector<unsigned char> pixels;  // 4 bytes per pixel, top row first; at least width * height of them
+
+    void clear(float r, float g, float b) override;
+
+    void drawText(Atlas *atlas, float r, float g, float b) override;
+};
+
+// Picks the fastest blend kernel; kernel can be changed afterwards.
+CPURenderer *createCPURenderer(GlyphCache *glyphCache, int width, int height, PixelFormat format);
+
+// Writes the framebuffer through saveImage(), like saveScreenShot() does;
+// false when the file could not be written.
+bool saveCPURenderer(const CPURenderer *renderer, const char *path);
+
+#endif
@@ -0,0 +1,343 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "curve_text.h"
+#include FT_OUTLINE_H
+#include "profiler.h"
+
+static_assert(sizeof(CurveInstance) == 20, "curve instances must stay 20 bytes");
+
+// Band edges are widened by this much, so a curve ending on one is in both bands.
+static const float BAND_EPSILON = 1.0f / 4096;
+
+size_t CurveKeyHash::operator()(const CurveKey &key) const {
+    size_t h = std::hash<void *>()(key.face);
+    h ^= key.glyph + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+}
+
+static GLubyte toByte(float v) {
+    return (GLubyte) std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255.0f);
+}
+
+CurveText *createCurveText(GLuint program, GLsizeiptr streamSize) {
+    auto text = new CurveText;
+    text->program = program;
+    text->stream = createStreamBuffer(GL_ARRAY_BUFFER, streamSize, true);
+    text->capacity = 0;
+    text->uploaded = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &text->maxTexels);
+    // texel numbers are stored as floats, exact up to 2^24
+    text->maxTexels = std::min(text->maxTexels, 1 << 24);
+    setCurveTextTransform(text, 1, 0, 0, 1, 0, 0);
+
+    glGenVertexArrays(1, &text->vao);
+    glBindVertexArray(text->vao);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(0, 1);
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribDivisor(2, 1);
+    glBindVertexArray(0);
+
+    glGenBuffers(1, &text->curveBuffer);
+    glGenTextures(1, &text->curveTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, text->curveBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, text->curveTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, text->curveBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "curves"), 0);
+    glUniform1i(glGetUniformLocation(program, "bands"), CURVE_BANDS);
+    text->transformLocation = glGetUniformLocation(program, "transform");
+    glUseProgram(0);
+    return text;
+}
+
+void destroyCurveText(CurveText *text) {
+    glDeleteTextures(1, &text->curveTexture);
+    glDeleteBuffers(1, &text->curveBuffer);
+    glDeleteVertexArrays(1, &text->vao);
+    destroyStreamBuffer(text->stream);
+    delete text;
+}
+
+// Collects a glyph's outline as quadratics while FreeType walks it.
+struct OutlineSink {
+    std::vector<QuadCurve> *curves;
+    float scale;            // font units to em
+    float x;                // current point
+    float y;
+};
+
+static void addQuad(OutlineSink *sink, float cx, float cy, float x, float y) {
+    sink->curves->push_back({sink->x, sink->y, cx, cy, x, y});
+    sink->x = x;
+    sink->y = y;
+}
+
+static int moveTo(const FT_Vector *to, void *user) {
+    auto sink = (OutlineSink *) user;
+    sink->x = to->x * sink->scale;
+    sink->y = to->y * sink->scale;
+    return 0;
+}
+
+static int lineTo(const FT_Vector *to, void *user) {
+    auto sink = (OutlineSink *) user;
+    float x = to->x * sink->scale;
+    float y = to->y * sink->scale;
+    // a line is a quadratic with its control point halfway
+    addQuad(sink, (sink->x + x) * 0.5f, (sink->y + y) * 0.5f, x, y);
+    return 0;
+}
+
+static int conicTo(const FT_Vector *control, const FT_Vector *to, void *user) {
+    auto sink = (OutlineSink *) user;
+    addQuad(sink, control->x * sink->scale, control->y * sink->scale, to->x * sink->scale, to->y * sink->scale);
+    return 0;
+}
+
+/*
+ * A cubic is split in half and each half replaced by the quadratic through
+ * the same ends whose control point is (3 (c1 + c2) - p0 - p3) / 4; off by
+ * far less than a pixel at text sizes.
+ */
+static int cubicTo(const FT_Vector *control1, const FT_Vector *control2, const FT_Vector *to, void *user) {
+    auto sink = (OutlineSink *) user;
+    float x0 = sink->x, y0 = sink->y;
+    float x1 = control1->x * sink->scale, y1 = control1->y * sink->scale;
+    float x2 = control2->x * sink->scale, y2 = control2->y * sink->scale;
+    float x3 = to->x * sink->scale, y3 = to->y * sink->scale;
+    // de Casteljau at t = 0.5
+    float ax = (x0 + x1) * 0.5f, ay = (y0 + y1) * 0.5f;
+    float bx = (x1 + x2) * 0.5f, by = (y1 + y2) * 0.5f;
+    float cx = (x2 + x3) * 0.5f, cy = (y2 + y3) * 0.5f;
+    float dx = (ax + bx) * 0.5f, dy = (ay + by) * 0.5f;
+    float ex = (bx + cx) * 0.5f, ey = (by + cy) * 0.5f;
+    float mx = (dx + ex) * 0.5f, my = (dy + ey) * 0.5f;
+    addQuad(sink, (3 * (ax + dx) - x0 - mx) * 0.25f, (3 * (ay + dy) - y0 - my) * 0.25f, mx, my);
+    addQuad(sink, (3 * (ex + cx) - mx - x3) * 0.25f, (3 * (ey + cy) - my - y3) * 0.25f, x3, y3);
+    return 0;
+}
+
+static float curveMin(const QuadCurve &c, int axis) {
+    return axis ? std::min(std::min(c.y1, c.y2), c.y3) : std::min(std::min(c.x1, c.x2), c.x3);
+}
+
+static float curveMax(const QuadCurve &c, int axis) {
+    return axis ? std::max(std::max(c.y1, c.y2), c.y3) : std::max(std::max(c.x1, c.x2), c.x3);
+}
+
+static int bandOf(float v, float origin, float size) {
+    return std::min(std::max((int) ((v - origin) / size * CURVE_BANDS), 0), CURVE_BANDS - 1);
+}
+
+/*
+ * Appends the glyph's texels to curveData. Rows are cut along y and hold the
+ * curves a ray along x can cross there, sorted so the shader can stop at the
+ * first one left of the pixel; columns the same with the axes swapped.
+ * Curves flat along the ray never cross it and are left out.
+ */
+static GLint buildCurveGlyph(CurveText *text, FT_Face face, unsigned int glyph) {
+    PROFILE_SCOPE("curve_glyph");
+    // unscaled, so one outline serves every size
+    if (FT_Load_Glyph(face, glyph, FT_LOAD_NO_SCALE) || face->glyph->format != FT_GLYPH_FORMAT_OUTLINE) {
+        return -1;
+    }
+    std::vector<QuadCurve> &curves = text->outline;
+    curves.clear();
+    OutlineSink sink = {&curves, 1.0f / face->units_per_EM, 0, 0};
+    FT_Outline_Funcs funcs = {moveTo, lineTo, conicTo, cubicTo, 0, 0};
+    if (FT_Outline_Decompose(&face->glyph->outline, &funcs, &sink) || curves.empty()) {
+        return -1;
+    }
+    float box[4] = {curveMin(curves[0], 0), curveMin(curves[0], 1), curveMax(curves[0], 0), curveMax(curves[0], 1)};
+    for (auto &c : curves) {
+        box[0] = std::min(box[0], curveMin(c, 0));
+        box[1] = std::min(box[1], curveMin(c, 1));
+        box[2] = std::max(box[2], curveMax(c, 0));
+        box[3] = std::max(box[3], curveMax(c, 1));
+    }
+    if (box[2] <= box[0] || box[3] <= box[1]) {
+        return -1;
+    }
+
+    // bands 0 .. CURVE_BANDS - 1 are rows, the rest columns
+    int counts[2 * CURVE_BANDS] = {};
+    int firsts[2 * CURVE_BANDS];
+    for (auto &c : curves) {
+        for (int axis = 0; axis < 2; ++axis) {
+            // rows split y
+            int across = 1 - axis;
+            float lo = curveMin(c, across), hi = curveMax(c, across);
+            if (lo == hi) {
+                continue;
+            }
+            float origin = box[across], size = box[across + 2] - box[across];
+            int last = bandOf(hi + BAND_EPSILON, origin, size);
+            for (int b = bandOf(lo - BAND_EPSILON, origin, size); b <= last; ++b) {
+                counts[axis * CURVE_BANDS + b]++;
+            }
+        }
+    }
+    size_t base = text->curveData.size() / 4;
+    size_t next = base + 1 + CURVE_BANDS;
+    for (int b = 0; b < 2 * CURVE_BANDS; ++b) {
+        firsts[b] = (int) next;
+        next += (counts[b] + 3) / 4;
+    }
+    size_t curveBase = next;
+    size_t end = curveBase + 2 * curves.size();
+    if (end > (size_t) text->maxTexels) {
+        return -1;
+    }
+
+    std::vector<GLfloat> &data = text->curveData;
+    data.resize(end * 4, 0.0f);
+    GLfloat *texels = data.data() + base * 4;
+    memcpy(texels, box, sizeof(box));
+    for (int b = 0; b < 2 * CURVE_BANDS; ++b) {
+        GLfloat *header = texels + 4 + (b / 2) * 4 + (b & 1) * 2;
+        header[0] = (GLfloat) counts[b];
+        header[1] = (GLfloat) firsts[b];
+    }
+    for (size_t i = 0; i < curves.size(); ++i) {
+        const QuadCurve &c = curves[i];
+        GLfloat *texel = data.data() + (curveBase + 2 * i) * 4;
+        texel[0] = c.x1;
+        texel[1] = c.y1;
+        texel[2] = c.x2;
+        texel[3] = c.y2;
+        texel[4] = c.x3;
+        texel[5] = c.y3;
+    }
+    std::vector<int> &order = text->order;
+    order.resize(curves.size());
+    for (int axis = 0; axis < 2; ++axis) {
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = (int) i;
+        }
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            return curveMax(curves[a], axis) > curveMax(curves[b], axis);
+        });
+        int across = 1 - axis;
+        float origin = box[across], size = box[across + 2] - box[across];
+        int filled[CURVE_BANDS] = {};
+        for (int i : order) {
+            const QuadCurve &c = curves[i];
+            float lo = curveMin(c, across), hi = curveMax(c, across);
+            if (lo == hi) {
+                continue;
+            }
+            int last = bandOf(hi + BAND_EPSILON, origin, size);
+            for (int b = bandOf(lo - BAND_EPSILON, origin, size); b <= last; ++b) {
+                int k = filled[b]++;
+                data[(size_t) firsts[axis * CURVE_BANDS + b] * 4 + k] = (GLfloat) (curveBase + 2 * i);
+            }
+        }
+    }
+    return (GLint) base;
+}
+
+GLint cacheCurveGlyph(CurveText *text, FT_Face face, unsigned int glyph) {
+    CurveKey key = {face, glyph};
+    auto it = text->glyphs.find(key);
+    if (it != text->glyphs.end()) {
+        return it->second;
+    }
+    GLint first = buildCurveGlyph(text, face, glyph);
+    text->glyphs.emplace(key, first);
+    return first;
+}
+
+void appendCurveInstances(CurveText *text, const GlyphRun *run, float size, float r, float g, float b, float a) {
+    CurveInstance instance;
+    instance.size = size;
+    instance.color[0] = toByte(r);
+    instance.color[1] = toByte(g);
+    instance.color[2] = toByte(b);
+    instance.color[3] = toByte(a);
+    for (int f = 0; f < run->faceCount; ++f) {
+        FT_Face face = run->faces[f].face;
+        for (int i = run->faces[f].first, end = faceRunEnd(run, f); i < end; ++i) {
+            instance.glyph = cacheCurveGlyph(text, face, run->glyphs[i]);
+            if (instance.glyph < 0) {
+                continue;
+            }
+            instance.x = run->x[i];
+            instance.y = run->y[i];
+            text->instances.push_back(instance);
+        }
+    }
+}
+
+void setCurveTextTransform(CurveText *text, float a, float b, float c, float d, float tx, float ty) {
+    GLfloat *transform = text->transform;
+    transform[0] = a;
+    transform[1] = b;
+    transform[2] = c;
+    transform[3] = d;
+    transform[4] = tx;
+    transform[5] = ty;
+}
+
+// Glyphs only ever go on the end, so only the new texels are sent.
+static void uploadCurves(CurveText *text) {
+    size_t texels = text->curveData.size() / 4;
+    if (texels == text->uploaded) {
+        return;
+    }
+    PROFILE_SCOPE("curve_upload");
+    glBindBuffer(GL_TEXTURE_BUFFER, text->curveBuffer);
+    if (texels > text->capacity) {
+        text->capacity = std::min(std::max(texels, text->capacity * 2), (size_t) text->maxTexels);
+        glBufferData(GL_TEXTURE_BUFFER, text->capacity * 4 * sizeof(GLfloat), nullptr, GL_STATIC_DRAW);
+        text->uploaded = 0;
+    }
+    glBufferSubData(GL_TEXTURE_BUFFER, text->uploaded * 4 * sizeof(GLfloat),
+                    (texels - text->uploaded) * 4 * sizeof(GLfloat), text->curveData.data() + text->uploaded * 4);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    text->uploaded = texels;
+}
+
+void drawCurveText(CurveText *text) {
+    PROFILE_GPU_SCOPE("draw_curves");
+    std::vector<CurveInstance> &instances = text->instances;
+    if (instances.empty()) {
+        return;
+    }
+    uploadCurves(text);
+    int regionInstances = (int) (text->stream->regionSize / sizeof(CurveInstance));
+    const GLfloat *t = text->transform;
+    GLfloat transform[9] = {t[0], t[1], 0, t[2], t[3], 0, t[4], t[5], 1};
+
+    glUseProgram(text->program);
+    glUniformMatrix3fv(text->transformLocation, 1, GL_FALSE, transform);
+    glBindVertexArray(text->vao);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_BUFFER, text->curveTexture);
+    for (int first = 0; first < (int) instances.size(); first += regionInstances) {
+        int count = std::min((int) instances.size() - first, regionInstances);
+        GLsizeiptr bytes = count * sizeof(CurveInstance);
+        GLintptr offset;
+        void *dst = mapStream(text->stream, bytes, sizeof(CurveInstance), &offset);
+        memcpy(dst, instances.data() + first, bytes);
+        unmapStream(text->stream);
+
+        // GL 3.3 has no base instance, so the attributes move instead
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CurveInstance), (void *) offset);
+        glVertexAttribIPointer(1, 1, GL_INT, sizeof(CurveInstance), (void *) (offset + 12));
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(CurveInstance), (void *) (offset + 16));
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+    }
+    instances.clear();
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,103 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef CURVE_TEXT_H
+#define CURVE_TEXT_H
+
+#include <vector>
+#include <unordered_map>
+#include <glad/glad.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "stream_buffer.h"
+#include "text_layout.h"
+
+// Bands a glyph's box is cut into along each axis; res/fs_curve.glsl gets it as a uniform.
+static const int CURVE_BANDS = 8;
+
+struct CurveKey {
+    FT_Face face;
+    unsigned int glyph;
+
+    bool operator==(const CurveKey &other) const {
+        return face == other.face && glyph == other.glyph;
+    }
+};
+
+struct CurveKeyHash {
+    size_t operator()(const CurveKey &key) const;
+};
+
+// A quadratic Bézier segment in em units, y up.
+struct QuadCurve {
+    float x1, y1;
+    float x2, y2;           // control point
+    float x3, y3;
+};
+
+/*
+ * One glyph in 20 bytes. res/vs_curve.glsl reads the glyph's box from the
+ * curve buffer and covers it with a quad built from gl_VertexID.
+ */
+struct CurveInstance {
+    GLfloat x;              // pen position in pixels, before the transform
+    GLfloat y;
+    GLfloat size;           // pixels per em
+    GLint glyph;            // first texel of the glyph in the curve buffer
+    GLubyte color[4];
+};
+
+/*
+ * Draws glyphs straight from their outlines. Every glyph is loaded unscaled
+ * once, its lines, conics and cubics turned into quadratics, and appended to
+ * one RGBA32F texture buffer:
+ *
+ *   glyph                  box <x0, y0, x1, y1> in em
+ *   glyph + 1 ...          CURVE_BANDS texels of band headers, 2 bands each as
+ *                          <count, first texel>; rows along y, then columns along x
+ *   band lists             4 curve texels per texel, rows sorted by max x and
+ *                          columns by max y, both descending
+ *   curves                 2 texels each: <x1, y1, x2, y2>, <x3, y3, 0, 0>
+ *
+ * res/fs_curve.glsl casts a ray along x through the row its pixel is in and
+ * one along y through the column, and gets the coverage from where they cross
+ * the curves, so nothing is rasterized at any size or transform and a glyph
+ * takes the same memory whatever size it is drawn at.
+ */
+struct CurveText {
+    GLuint program;
+    GLuint vao;
+    GLint transformLocation;
+    GLuint curveBuffer;
+    GLuint curveTexture;
+    GLint maxTexels;                    // GL_MAX_TEXTURE_BUFFER_SIZE, at most 2^24
+    size_t capacity;                    // texels the buffer holds
+    size_t uploaded;                    // texels already in the buffer
+    std::vector<GLfloat> curveData;     // every glyph's texels, the buffer's contents
+    std::unordered_map<CurveKey, GLint, CurveKeyHash> glyphs;
+    std::vector<QuadCurve> outline;
+    std::vector<int> order;
+    StreamBuffer *stream;
+    std::vector<CurveInstance> instances;
+    GLfloat transform[6];
+};
+
+// program is built from res/vs_curve.glsl and res/fs_curve.glsl.
+CurveText *createCurveText(GLuint program, GLsizeiptr streamSize);
+
+void destroyCurveText(CurveText *text);
+
+// First texel of the glyph, loaded the first time it is asked for; -1 when it
+// has no outline or the buffer is full.
+GLint cacheCurveGlyph(CurveText *text, FT_Face face, unsigned int glyph);
+
+// Glyphs of a run laid out at size pixels per em.
+void appendCurveInstances(CurveText *text, const GlyphRun *run, float size,
+                          float r, float g, float b, float a = 1.0f);
+
+// Affine transform applied to the next draw: [a c tx; b d ty].
+void setCurveTextTransform(CurveText *text, float a, float b, float c, float d, float tx, float ty);
+
+// Uploads the glyphs loaded since the last draw, then draws and empties the instances.
+void drawCurveText(CurveText *text);
+
+#endif
@@ -0,0 +1,159 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include <cmath>
+#include "damage.h"
+#include "profiler.h"
+
+// More boxes than this are drawn as one: every box is a pass over the scene.
+static const size_t MAX_DAMAGE_RECTS = 8;
+
+static void allocateFrame(DamageTracker *tracker) {
+    glBindRenderbuffer(GL_RENDERBUFFER, tracker->color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, tracker->pixelWidth, tracker->pixelHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    tracker->full = true;
+}
+
+DamageTracker *createDamageTracker(float width, float height, int pixelWidth, int pixelHeight) {
+    auto tracker = new DamageTracker;
+    tracker->width = width;
+    tracker->height = height;
+    tracker->pixelWidth = pixelWidth;
+    tracker->pixelHeight = pixelHeight;
+    glGenRenderbuffers(1, &tracker->color);
+    allocateFrame(tracker);
+    glGenFramebuffers(1, &tracker->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, tracker->framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, tracker->color);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    return tracker;
+}
+
+void destroyDamageTracker(DamageTracker *tracker) {
+    glDeleteFramebuffers(1, &tracker->framebuffer);
+    glDeleteRenderbuffers(1, &tracker->color);
+    delete tracker;
+}
+
+void resizeDamageTracker(DamageTracker *tracker, int pixelWidth, int pixelHeight) {
+    if (pixelWidth == tracker->pixelWidth && pixelHeight == tracker->pixelHeight) {
+        return;
+    }
+    tracker->pixelWidth = pixelWidth;
+    tracker->pixelHeight = pixelHeight;
+    // a minimized window has no pixels; the storage waits until it comes back
+    if (pixelWidth > 0 && pixelHeight > 0) {
+        allocateFrame(tracker);
+    }
+}
+
+int addDamageObject(DamageTracker *tracker, const DamageRect &bounds) {
+    tracker->objects.push_back({bounds, true});
+    return (int) tracker->objects.size() - 1;
+}
+
+void moveDamageObject(DamageTracker *tracker, int object, const DamageRect &bounds) {
+    DamageObject &o = tracker->objects[object];
+    if (o.bounds.x0 == bounds.x0 && o.bounds.y0 == bounds.y0 && o.bounds.x1 == bounds.x1 &&
+        o.bounds.y1 == bounds.y1) {
+        return;
+    }
+    // what it covered before has to be drawn without it
+    tracker->rects.push_back(o.bounds);
+    o.bounds = bounds;
+    o.dirty = true;
+}
+
+void damageObject(DamageTracker *tracker, int object) {
+    tracker->objects[object].dirty = true;
+}
+
+void damageRect(DamageTracker *tracker, const DamageRect &rect) {
+    tracker->rects.push_back(rect);
+}
+
+void damageAll(DamageTracker *tracker) {
+    tracker->full = true;
+}
+
+static bool overlaps(const DamageRect &a, const DamageRect &b) {
+    return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+}
+
+static void merge(DamageRect &into, const DamageRect &rect) {
+    into.x0 = std::min(into.x0, rect.x0);
+    into.y0 = std::min(into.y0, rect.y0);
+    into.x1 = std::max(into.x1, rect.x1);
+    into.y1 = std::max(into.y1, rect.y1);
+}
+
+const std::vector<DamageRect> &collectDamage(DamageTracker *tracker) {
+    std::vector<DamageRect> &rects = tracker->rects;
+    for (auto &object : tracker->objects) {
+        if (object.dirty) {
+            rects.push_back(object.bounds);
+            object.dirty = false;
+        }
+    }
+    if (tracker->full) {
+        tracker->full = false;
+        rects.assign(1, {0, 0, tracker->width, tracker->height});
+    }
+    size_t count = 0;
+    for (auto &rect : rects) {
+        DamageRect clipped = {std::max(rect.x0, 0.0f), std::max(rect.y0, 0.0f), std::min(rect.x1, tracker->width),
+                              std::min(rect.y1, tracker->height)};
+        if (clipped.x0 < clipped.x1 && clipped.y0 < clipped.y1) {
+            rects[count++] = clipped;
+        }
+    }
+    rects.resize(count);
+    // a merged box can reach boxes it did not before, so merging goes on until nothing overlaps
+    for (size_t i = 0; i < rects.size(); ++i) {
+        for (size_t j = i + 1; j < rects.size(); ++j) {
+            if (overlaps(rects[i], rects[j])) {
+                merge(rects[i], rects[j]);
+                rects.erase(rects.begin() + j);
+                j = i;
+            }
+        }
+    }
+    if (rects.size() > MAX_DAMAGE_RECTS) {
+        for (size_t i = 1; i < rects.size(); ++i) {
+            merge(rects[0], rects[i]);
+        }
+        rects.resize(1);
+    }
+    return rects;
+}
+
+bool isObjectInRect(const DamageTracker *tracker, int object, const DamageRect &rect) {
+    return overlaps(tracker->objects[object].bounds, rect);
+}
+
+void beginDamage(DamageTracker *tracker, const DamageRect &rect) {
+    float sx = tracker->pixelWidth / tracker->width;
+    float sy = tracker->pixelHeight / tracker->height;
+    // whole pixels that hold any of the box
+    int x0 = (int) std::floor(rect.x0 * sx);
+    int y0 = (int) std::floor(rect.y0 * sy);
+    int x1 = (int) std::ceil(rect.x1 * sx);
+    int y1 = (int) std::ceil(rect.y1 * sy);
+    glBindFramebuffer(GL_FRAMEBUFFER, tracker->framebuffer);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(x0, y0, x1 - x0, y1 - y0);
+    glClear(GL_COLOR_BUFFER_BIT);
+}
+
+void presentDamage(DamageTracker *tracker) {
+    PROFILE_SCOPE("present");
+    // the scissor would cut the blit too
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, tracker->framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, tracker->pixelWidth, tracker->pixelHeight, 0, 0, tracker->pixelWidth,
+                      tracker->pixelHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    tracker->rects.clear();
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include <vector>
+#include <glad/glad.h>
+
+// Box in scene units, y up as the projection has it.
+struct DamageRect {
+    float x0;
+    float y0;
+    float x1;
+    float y1;
+};
+
+struct DamageObject {
+    DamageRect bounds;          // where it was drawn last, generous enough to hold every pixel
+    bool dirty;
+};
+
+/*
+ * Retained scene. Frames are drawn into a framebuffer of their own that keeps
+ * its pixels, so a frame only clears and redraws the boxes that changed, with
+ * the objects that touch them, and goes to the window with one blit. A frame
+ * where nothing changed is not drawn or presented at all.
+ *
+ * Damage comes from objects marked dirty, from objects moving, which damages
+ * both where they were and where they are, and from loose boxes.
+ */
+struct DamageTracker {
+    float width;                // scene size, in the projection's units
+    float height;
+    int pixelWidth;             // framebuffer size, more than the scene on HiDPI screens
+    int pixelHeight;
+    std::vector<DamageObject> objects;
+    std::vector<DamageRect> rects;      // loose damage, then the merged boxes of the frame
+    bool full;
+    GLuint framebuffer;
+    GLuint color;               // renderbuffer the frame is kept in
+};
+
+DamageTracker *createDamageTracker(float width, float height, int pixelWidth, int pixelHeight);
+
+void destroyDamageTracker(DamageTracker *tracker);
+
+// Follows the window's framebuffer; the new frame is all damage.
+void resizeDamageTracker(DamageTracker *tracker, int pixelWidth, int pixelHeight);
+
+// Returns the object's index; it is damaged until first drawn.
+int addDamageObject(DamageTracker *tracker, const DamageRect &bounds);
+
+void moveDamageObject(DamageTracker *tracker, int object, const DamageRect &bounds);
+
+void damageObject(DamageTracker *tracker, int object);
+
+void damageRect(DamageTracker *tracker, const DamageRect &rect);
+
+void damageAll(DamageTracker *tracker);
+
+/*
+ * Turns this frame's damage into the boxes to redraw: clipped to the scene,
+ * overlapping ones merged, and all of them merged into one when there are
+ * too many to be worth a pass each. Empty when nothing changed.
+ */
+const std::vector<DamageRect> &collectDamage(DamageTracker *tracker);
+
+bool isObjectInRect(const DamageTracker *tracker, int object, const DamageRect &rect);
+
+// Binds the retained frame, scissored to rect, and clears the box.
+void beginDamage(DamageTracker *tracker, const DamageRect &rect);
+
+// Blits the retained frame to the window's back buffer, which stays bound,
+// and forgets the frame's damage.
+void presentDamage(DamageTracker *tracker);
+
+#endif
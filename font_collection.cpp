@@ -0,0 +1,277 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <cstring>
+#include "font_collection.h"
+#include "ot_font.h"
+#include "profiler.h"
+
+static const unsigned int MAX_CODEPOINT = 0x10ffff;
+static const int BLOCK_WORDS = 4;
+
+FontCollection *createFontCollection(FT_Library library) {
+    auto fonts = new FontCollection;
+    fonts->library = library;
+    fonts->size = 0;
+    return fonts;
+}
+
+void destroyFontCollection(FontCollection *fonts) {
+    for (auto &face : fonts->faces) {
+        hb_font_destroy(face.font);
+        FT_Done_Face(face.face);
+        if (!face.sharedFile) {
+            unmapFile(face.file);
+        }
+    }
+    delete fonts;
+}
+
+// Walks the cmap once; only the blocks with a mapped code point get words.
+static void buildCoverage(FontFace *face) {
+    face->blocks.assign((MAX_CODEPOINT >> 8) + 1, -1);
+    face->bits.clear();
+    FT_UInt glyph;
+    FT_ULong codepoint = FT_Get_First_Char(face->face, &glyph);
+    while (glyph) {
+        if (codepoint <= MAX_CODEPOINT) {
+            int &block = face->blocks[codepoint >> 8];
+            if (block < 0) {
+                block = (int) face->bits.size();
+                face->bits.resize(face->bits.size() + BLOCK_WORDS, 0);
+            }
+            face->bits[block + ((codepoint >> 6) & 3)] |= 1ULL << (codepoint & 63);
+        }
+        codepoint = FT_Get_Next_Char(face->face, codepoint, &glyph);
+    }
+}
+
+// FNV-1a a word at a time.
+static unsigned long long hashBytes(unsigned long long h, const char *data, size_t size) {
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        unsigned long long word;
+        memcpy(&word, data + i, 8);
+        h = (h ^ word) * 1099511628211ULL;
+    }
+    for (; i < size; ++i) {
+        h = (h ^ (unsigned char) data[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static unsigned int readBigEndian(const char *data, int bytes) {
+    unsigned int value = 0;
+    for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | (unsigned char) data[i];
+    }
+    return value;
+}
+
+/*
+ * Names the font's bytes without reading all of them on every start: an sfnt
+ * table directory holds a checksum of every table, so hashing the directory
+ * and the size stands in for hashing the file. Anything else is hashed whole.
+ */
+static unsigned long long hashFile(const MappedFile *file, long index) {
+    unsigned long long h = 14695981039346656037ULL ^ file->size;
+    size_t offset = 0;
+    if (file->size >= 12 && !memcmp(file->data, "ttcf", 4)) {
+        size_t entry = 12 + 4 * (size_t) index;
+        offset = entry + 4 <= file->size ? readBigEndian(file->data + entry, 4) : file->size;
+    }
+    unsigned int version = offset + 12 <= file->size ? readBigEndian(file->data + offset, 4) : 0;
+    if (version == 0x00010000 || version == 0x4f54544f || version == 0x74727565) {
+        // 1.0, 'OTTO' or 'true'
+        size_t directory = 12 + 16 * (size_t) readBigEndian(file->data + offset + 4, 2);
+        if (offset + directory <= file->size) {
+            return hashBytes(h, file->data + offset, directory);
+        }
+    }
+    return hashBytes(h, file->data, file->size);
+}
+
+int addFontFace(FontCollection *fonts, const char *path, long index) {
+    FontFace face;
+    face.file = mapFile(path);
+    if (!face.file) {
+        return -1;
+    }
+    if (FT_New_Memory_Face(fonts->library, (const FT_Byte *) face.file->data, (FT_Long) face.file->size, index,
+                           &face.face)) {
+        unmapFile(face.file);
+        return -1;
+    }
+    // prefers a UCS-4 cmap, so emoji past the BMP are covered
+    FT_Select_Charmap(face.face, FT_ENCODING_UNICODE);
+    // HarfBuzz reads the tables from the same mapping; FreeType only rasterizes
+    face.font = createOTFont(face.file->data, face.file->size, index);
+    face.hash = hashFile(face.file, index);
+    face.path = path;
+    face.index = index;
+    face.sharedFile = false;
+    buildCoverage(&face);
+    fonts->faces.push_back(face);
+    // the new face has not been scaled yet
+    fonts->size = 0;
+    return (int) fonts->faces.size() - 1;
+}
+
+int shareFontFace(FontCollection *fonts, const FontFace &source) {
+    FontFace face = source;
+    if (FT_New_Memory_Face(fonts->library, (const FT_Byte *) face.file->data, (FT_Long) face.file->size, face.index,
+                           &face.face)) {
+        return -1;
+    }
+    FT_Select_Charmap(face.face, FT_ENCODING_UNICODE);
+    face.font = createOTFont(face.file->data, face.file->size, face.index);
+    face.sharedFile = true;
+    fonts->faces.push_back(face);
+    fonts->size = 0;
+    return (int) fonts->faces.size() - 1;
+}
+
+bool faceCovers(const FontFace *face, unsigned int codepoint) {
+    if (codepoint > MAX_CODEPOINT) {
+        return false;
+    }
+    int block = face->blocks[codepoint >> 8];
+    return block >= 0 && (face->bits[block + ((codepoint >> 6) & 3)] >> (codepoint & 63) & 1);
+}
+
+int resolveFontFace(const FontCollection *fonts, unsigned int codepoint) {
+    for (size_t i = 0; i < fonts->faces.size(); ++i) {
+        if (faceCovers(&fonts->faces[i], codepoint)) {
+            return (int) i;
+        }
+    }
+    return -1;
+}
+
+// Characters that belong to the one before them, whatever faces map them.
+static bool joinsPrevious(unsigned int c) {
+    if (c < 0x300) {
+        return false;
+    }
+    if (c == 0x200c || c == 0x200d || c == 0x20e3 || (c >= 0xfe00 && c <= 0xfe0f) ||
+        (c >= 0x1f3fb && c <= 0x1f3ff) || (c >= 0xe0020 && c <= 0xe01ef)) {
+        return true;
+    }
+    switch (hb_unicode_general_category(hb_unicode_funcs_get_default(), c)) {
+        case HB_UNICODE_GENERAL_CATEGORY_NON_SPACING_MARK:
+        case HB_UNICODE_GENERAL_CATEGORY_SPACING_MARK:
+        case HB_UNICODE_GENERAL_CATEGORY_ENCLOSING_MARK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void splitFontRuns(const FontCollection *fonts, const char *text, size_t length, std::vector<FontRun> &runs) {
+    runs.clear();
+    auto bytes = (const unsigned char *) text;
+    int current = -1;
+    size_t size;
+    for (size_t i = 0; i < length; i += size) {
+        unsigned int c;
+        if (bytes[i] < 0x80) {
+            c = bytes[i];
+            size = 1;
+        } else {
+            c = decodeUtf8(bytes + i, length - i, &size);
+        }
+        int face = resolveFontFace(fonts, c);
+        if (face != current) {
+            // only asked where the face changes, most characters never get here
+            if (current >= 0 && (face < 0 || joinsPrevious(c))) {
+                continue;
+            }
+            if (face < 0) {
+                face = 0;
+            }
+            if (!runs.empty()) {
+                runs.back().end = i;
+            }
+            runs.push_back({i, length, face});
+            current = face;
+        }
+    }
+}
+
+void splitParagraphs(const FontCollection *fonts, const char *text, size_t length, size_t minBytes,
+                     std::vector<size_t> &ends) {
+    ends.clear();
+    auto bytes = (const unsigned char *) text;
+    size_t from = minBytes;     // where the end of the next piece is looked for
+    while (from < length) {
+        auto newline = (const char *) memchr(text + from, '\n', length - from);
+        if (!newline) {
+            break;
+        }
+        size_t end = newline - text + 1;
+        from = end;
+        if (end < length) {
+            // unmapped characters and marks would go with the run before the cut
+            size_t size;
+            unsigned int c = bytes[end] < 0x80 ? bytes[end] : decodeUtf8(bytes + end, length - end, &size);
+            if (resolveFontFace(fonts, c) < 0 || joinsPrevious(c)) {
+                continue;
+            }
+        }
+        ends.push_back(end);
+        from = end + minBytes;
+    }
+    if (!ends.empty() && length - ends.back() < minBytes) {
+        ends.back() = length;
+    } else {
+        ends.push_back(length);
+    }
+}
+
+void setFontSize(FontCollection *fonts, unsigned int size) {
+    if (fonts->size == size) {
+        return;
+    }
+    for (auto &face : fonts->faces) {
+        hb_font_set_ppem(face.font, size, size);
+        // 26.6, the units hb-ft gave and the layout divides by 64
+        hb_font_set_scale(face.font, size << 6, size << 6);
+    }
+    fonts->size = size;
+}
+
+void shapeFontRuns(FontCollection *fonts, ShapeCache *cache, unsigned int size, const TextSpan &text,
+                   std::vector<hb_glyph_info_t> &infos, std::vector<hb_glyph_position_t> &positions,
+                   std::vector<FaceRun> &faces) {
+    PROFILE_SCOPE("shape");
+    setFontSize(fonts, size);
+    std::vector<FontRun> &runs = fonts->runs;
+    splitFontRuns(fonts, text.data, text.length, runs);
+    faces.clear();
+    if (runs.size() <= 1) {
+        const FontFace &face = fonts->faces[runs.empty() ? 0 : runs[0].face];
+        shapeText(cache, face.font, size, text, infos, positions);
+        faces.push_back({0, face.face});
+        return;
+    }
+
+    infos.clear();
+    positions.clear();
+    bool backward = HB_DIRECTION_IS_BACKWARD(text.direction);
+    for (size_t k = 0; k < runs.size(); ++k) {
+        const FontRun &r = runs[backward ? runs.size() - 1 - k : k];
+        const FontFace &face = fonts->faces[r.face];
+        shapeText(cache, face.font, size, sliceText(text, r.start, r.end), fonts->infos, fonts->positions);
+        if (fonts->infos.empty()) {
+            continue;
+        }
+        faces.push_back({(int) infos.size(), face.face});
+        for (auto info : fonts->infos) {
+            info.cluster += (unsigned int) r.start;
+            infos.push_back(info);
+        }
+        positions.insert(positions.end(), fonts->positions.begin(), fonts->positions.end());
+    }
+    if (faces.empty()) {
+        faces.push_back({0, fonts->faces[0].face});
+    }
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef FONT_COLLECTION_H
+#define FONT_COLLECTION_H
+
+#include <string>
+#include <vector>
+#include <hb.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "mapped_file.h"
+#include "shape_cache.h"
+#include "text.h"
+#include "text_layout.h"
+
+struct FontFace {
+    FT_Face face;
+    hb_font_t *font;
+    MappedFile *file;                       // FreeType and HarfBuzz both read the font from here
+    unsigned long long hash;                // names the file's bytes, from its table checksums
+    std::string path;
+    long index;
+    std::vector<int> blocks;                // per 256 code points, its first word in bits, -1 when none is mapped
+    std::vector<unsigned long long> bits;   // 4 words per block that has any code point mapped
+    bool sharedFile;                        // file belongs to the face this one was copied from
+};
+
+// Bytes [start, end) of a text resolved to faces[face].
+struct FontRun {
+    size_t start;
+    size_t end;
+    int face;
+};
+
+/*
+ * Ordered fallback chain of faces: every character is drawn with the first
+ * face whose cmap maps it. The cmaps are walked once when a face is added
+ * and kept as a two-level bitset, so resolving a character is a couple of
+ * loads per face instead of an FT_Get_Char_Index() into each of them.
+ * Marks, joiners, variation selectors and skin tone modifiers stay with the
+ * character before them so clusters are never split across faces.
+ *
+ * Every face has its own hb_font_t, made by createOTFont(); glyphs keep the
+ * face they came from, so runs in different faces share the one glyph cache.
+ * Font files are mapped, not read: FreeType opens a memory face over the
+ * mapping and HarfBuzz wraps the same bytes in a blob, so no table is ever
+ * copied.
+ */
+struct FontCollection {
+    FT_Library library;
+    std::vector<FontFace> faces;
+    unsigned int size;                      // hb_font_t scale of every face, 0 before the first shape
+    std::vector<FontRun> runs;
+    std::vector<hb_glyph_info_t> infos;
+    std::vector<hb_glyph_position_t> positions;
+};
+
+FontCollection *createFontCollection(FT_Library library);
+
+void destroyFontCollection(FontCollection *fonts);
+
+// Maps the file and appends its face to the end of the chain. Returns its
+// index, or -1 when it can not be loaded.
+int addFontFace(FontCollection *fonts, const char *path, long index = 0);
+
+/*
+ * Appends a face over the file source already maps, with an FT_Face and
+ * hb_font_t of its own so another thread can shape with it; the bytes and the
+ * coverage are not read again. source's collection has to outlive fonts.
+ */
+int shareFontFace(FontCollection *fonts, const FontFace &source);
+
+bool faceCovers(const FontFace *face, unsigned int codepoint);
+
+// Index of the first face that maps codepoint, -1 when none does.
+int resolveFontFace(const FontCollection *fonts, unsigned int codepoint);
+
+// Cuts text into runs of the same face. Characters no face maps stay in the
+// run before them, or go to the first face.
+void splitFontRuns(const FontCollection *fonts, const char *text, size_t length, std::vector<FontRun> &runs);
+
+/*
+ * Cuts text after newlines into pieces of at least minBytes, the last one
+ * excepted, that shapeFontRuns() shapes on their own exactly as it does
+ * them inside the whole text: a cut only goes where the next character
+ * starts a font run of its own. ends gets the end of every piece.
+ */
+void splitParagraphs(const FontCollection *fonts, const char *text, size_t length, size_t minBytes,
+                     std::vector<size_t> &ends);
+
+// Scales every face's hb_font_t to size pixels. The FT_Face is sized by the
+// glyph cache when it rasterizes; shaping never touches it.
+void setFontSize(FontCollection *fonts, unsigned int size);
+
+/*
+ * Shapes every run of text with its own face, scaled to size first, and
+ * joins the results as if it was shaped in one call: clusters are byte
+ * offsets into text.data and backward text comes out in visual order.
+ * faces tells which face each span of glyphs came from.
+ */
+void shapeFontRuns(FontCollection *fonts, ShapeCache *cache, unsigned int size, const TextSpan &text,
+                   std::vector<hb_glyph_info_t> &infos, std::vector<hb_glyph_position_t> &positions,
+                   std::vector<FaceRun> &faces);
+
+#endif
@@ -0,0 +1,202 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <cstdio>
+#include <cstring>
+#include "frame_capture.h"
+#include "image_write.h"
+#include "profiler.h"
+
+// Frames mapped but not written yet; past this readbacks stay in their slots.
+static const int MAX_BUFFERS = 6;
+
+static void encodeFrames(FrameCapture *capture) {
+    std::unique_lock<std::mutex> lock(capture->mutex);
+    for (;;) {
+        capture->wake.wait(lock, [capture] { return capture->stop || !capture->jobs.empty(); });
+        if (capture->jobs.empty()) {
+            return;
+        }
+        CaptureJob job = std::move(capture->jobs.front());
+        capture->jobs.pop_front();
+        lock.unlock();
+        // rows were flipped when copied out of the mapping, so saveImage() needs no copy
+        bool saved = saveImage(job.path.c_str(), job.width, job.height, 3, job.pixels.data(), 0) != 0;
+        lock.lock();
+        if (saved) {
+            capture->written++;
+        }
+        capture->pool.push_back(std::move(job.pixels));
+        capture->returned.notify_one();
+    }
+}
+
+FrameCapture *createFrameCapture(int slots) {
+    auto capture = new FrameCapture;
+    capture->slots.resize(slots);
+    for (auto &slot : capture->slots) {
+        glGenBuffers(1, &slot.buffer);
+        slot.size = 0;
+        slot.fence = nullptr;
+        slot.width = 0;
+        slot.height = 0;
+    }
+    capture->next = 0;
+    capture->buffers = 0;
+    capture->stop = false;
+    capture->recordLeft = 0;
+    capture->recorded = 0;
+    capture->dropped = 0;
+    capture->written = 0;
+    capture->encoder = std::thread(encodeFrames, capture);
+    return capture;
+}
+
+static void releaseSlot(CaptureSlot &slot) {
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+}
+
+/*
+ * Moves a landed readback to the encoder. False, with the slot untouched,
+ * when the fence has not signalled or the encoder has no buffer to spare.
+ * A fence that can not be waited on frees the slot and drops the frame.
+ */
+static bool finishSlot(FrameCapture *capture, CaptureSlot &slot) {
+    GLenum status = glClientWaitSync(slot.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+        if (status == GL_TIMEOUT_EXPIRED) {
+            return false;
+        }
+        // GL_WAIT_FAILED: the buffer may never hold the frame
+        releaseSlot(slot);
+        capture->dropped++;
+        return true;
+    }
+    std::vector<unsigned char> pixels;
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        if (!capture->pool.empty()) {
+            pixels.swap(capture->pool.back());
+            capture->pool.pop_back();
+        } else if (capture->buffers < MAX_BUFFERS) {
+            capture->buffers++;
+        } else {
+            return false;
+        }
+    }
+    size_t row = (size_t) slot.width * 3;
+    pixels.resize(row * slot.height);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    auto src = (const unsigned char *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr) pixels.size(),
+                                                        GL_MAP_READ_BIT);
+    if (src) {
+        // GL rows start at the bottom
+        for (int y = 0; y < slot.height; ++y) {
+            memcpy(&pixels[y * row], src + (slot.height - 1 - y) * row, row);
+        }
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    releaseSlot(slot);
+
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        if (src) {
+            capture->jobs.push_back({std::move(pixels), slot.width, slot.height, slot.path});
+        } else {
+            capture->pool.push_back(std::move(pixels));
+        }
+    }
+    capture->wake.notify_one();
+    return true;
+}
+
+void destroyFrameCapture(FrameCapture *capture) {
+    glFinish();
+    int count = (int) capture->slots.size();
+    for (int i = 0; i < count; ++i) {
+        CaptureSlot &slot = capture->slots[(capture->next + i) % count];
+        while (slot.fence && !finishSlot(capture, slot)) {
+            // glFinish() signalled the fence, so every buffer is queued: sleep until the encoder frees one
+            std::unique_lock<std::mutex> lock(capture->mutex);
+            capture->returned.wait(lock, [capture] { return !capture->pool.empty(); });
+        }
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    {
+        std::lock_guard<std::mutex> lock(capture->mutex);
+        capture->stop = true;
+    }
+    capture->wake.notify_one();
+    capture->encoder.join();
+    delete capture;
+}
+
+bool captureFrame(FrameCapture *capture, int width, int height, const char *path) {
+    int count = (int) capture->slots.size();
+    CaptureSlot *slot = nullptr;
+    for (int i = 0; i < count && !slot; ++i) {
+        int index = (capture->next + i) % count;
+        if (!capture->slots[index].fence) {
+            slot = &capture->slots[index];
+            capture->next = (index + 1) % count;
+        }
+    }
+    if (!slot) {
+        capture->dropped++;
+        return false;
+    }
+    auto size = (GLsizeiptr) width * height * 3;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    if (slot->size < size) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+        slot->size = size;
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    // returns at once, the copy runs on the GPU into the bound buffer
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot->width = width;
+    slot->height = height;
+    slot->path = path;
+    return true;
+}
+
+void recordFrames(FrameCapture *capture, const char *pattern, int count) {
+    capture->pattern = pattern;
+    capture->recordLeft = count;
+    capture->recorded = 0;
+}
+
+void updateFrameCapture(FrameCapture *capture, int width, int height) {
+    PROFILE_SCOPE("capture");
+    int count = (int) capture->slots.size();
+    // oldest first, so frames reach the encoder in order
+    for (int i = 0; i < count; ++i) {
+        CaptureSlot &slot = capture->slots[(capture->next + i) % count];
+        if (slot.fence) {
+            finishSlot(capture, slot);
+        }
+    }
+    if (capture->recordLeft > 0) {
+        char path[512];
+        snprintf(path, sizeof(path), capture->pattern.c_str(), capture->recorded);
+        if (captureFrame(capture, width, height, path)) {
+            capture->recorded++;
+            capture->recordLeft--;
+        }
+    }
+}
+
+bool isFrameCaptureBusy(const FrameCapture *capture) {
+    if (capture->recordLeft > 0) {
+        return true;
+    }
+    for (const auto &slot : capture->slots) {
+        if (slot.fence) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glad/glad.h>
+
+// A readback in flight: glReadPixels went into buffer, fence says when it landed.
+struct CaptureSlot {
+    GLuint buffer;              // GL_PIXEL_PACK_BUFFER
+    GLsizeiptr size;
+    GLsync fence;               // null while the slot is free
+    int width;
+    int height;
+    std::string path;
+};
+
+struct CaptureJob {
+    std::vector<unsigned char> pixels;  // RGB, top row first
+    int width;
+    int height;
+    std::string path;
+};
+
+/*
+ * Screenshots without a hitch. A frame is read into a pixel pack buffer and
+ * fenced; a later frame maps it once the fence has signalled, copies the rows
+ * into a pooled buffer and hands that to an encoder thread, which writes PNG
+ * or BMP and gives the buffer back. Nothing waits on the GPU or the encoder:
+ * when every slot is still in flight, or too many frames wait for encoding,
+ * the frame is skipped and counted in dropped.
+ */
+struct FrameCapture {
+    std::vector<CaptureSlot> slots;
+    int next;                   // slot the next readback tries first
+
+    std::thread encoder;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable returned;   // signalled when the encoder puts a buffer back in pool
+    std::deque<CaptureJob> jobs;
+    std::vector<std::vector<unsigned char>> pool;   // pixel buffers free for reuse
+    int buffers;                // pixel buffers handed out, queued or free
+    bool stop;
+
+    std::string pattern;        // printf pattern taking the frame number, while recording
+    int recordLeft;             // frames still to record
+    int recorded;
+    unsigned long dropped;
+    unsigned long written;      // files the encoder finished, under mutex
+};
+
+// slots readbacks can be in flight at once; 2 or 3 hide the transfer.
+FrameCapture *createFrameCapture(int slots = 3);
+
+// Waits for the readbacks in flight and the encoder, so every frame asked
+// for is on disk afterwards.
+void destroyFrameCapture(FrameCapture *capture);
+
+/*
+ * Starts reading the width x height framebuffer that is drawn to now into
+ * path. Call after drawing, before swapping. False when the frame had to be
+ * dropped.
+ */
+bool captureFrame(FrameCapture *capture, int width, int height, const char *path);
+
+// Captures the next count frames to pattern, e.g. "frame_%04d.png".
+void recordFrames(FrameCapture *capture, const char *pattern, int count);
+
+// Call once per frame, where captureFrame() could be: hands finished readbacks
+// to the encoder and captures the frame when recording.
+void updateFrameCapture(FrameCapture *capture, int width, int height);
+
+// True while frames are being recorded or readbacks wait for the GPU, both
+// of which need updateFrameCapture() to be called again soon.
+bool isFrameCaptureBusy(const FrameCapture *capture);
+
+#endif
@@ -0,0 +1,108 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "gl_renderer.h"
+#include "profiler.h"
+
+struct GLRenderer : TextRenderer {
+    GLuint program;
+    GLint textColorLocation;
+    GLuint vao;
+    GLuint ibo;
+    int quadCapacity;
+    StreamBuffer *stream;
+    GlyphCache *glyphCache;
+
+    ~GLRenderer() override {
+        glDeleteVertexArrays(1, &vao);
+        glDeleteBuffers(1, &ibo);
+    }
+
+    void clear(float r, float g, float b) override {
+        glClearColor(r, g, b, 1);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    void drawText(Atlas *atlas, float r, float g, float b) override;
+};
+
+TextRenderer *createGLRenderer(GLuint program, GlyphCache *glyphCache, StreamBuffer *stream) {
+    auto renderer = new GLRenderer;
+    renderer->program = program;
+    renderer->textColorLocation = glGetUniformLocation(program, "textColor");
+    renderer->quadCapacity = 0;
+    renderer->stream = stream;
+    renderer->glyphCache = glyphCache;
+
+    glGenVertexArrays(1, &renderer->vao);
+    glBindVertexArray(renderer->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), nullptr);
+    glGenBuffers(1, &renderer->ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, renderer->ibo);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return renderer;
+}
+
+/*
+ * Every quad uses the same six indices, so one static buffer serves all
+ * streamed text and only vertices go through the ring.
+ */
+static void reserveQuadIndices(GLRenderer *renderer, int quads) {
+    if (quads <= renderer->quadCapacity) {
+        return;
+    }
+    renderer->quadCapacity = std::max(quads, renderer->quadCapacity * 2);
+    std::vector<GLuint> indices(renderer->quadCapacity * 6);
+    for (int i = 0; i < renderer->quadCapacity; ++i) {
+        GLuint index = i * 4;
+        GLuint quad[] = {index, index + 1, index + 2, index, index + 2, index + 3};
+        std::copy(quad, quad + 6, indices.begin() + i * 6);
+    }
+    glBindVertexArray(renderer->vao);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+}
+
+/*
+ * Immediate path for text that changes every frame: the quads are copied
+ * into the streaming ring and drawn from there, never with glBufferData.
+ */
+void GLRenderer::drawText(Atlas *atlas, float r, float g, float b) {
+    PROFILE_GPU_SCOPE("draw");
+    glUseProgram(program);
+    glUniform3f(textColorLocation, r, g, b);
+    if (isAtlasStale(atlas, glyphCache)) {
+        // a page this text used was recycled, pick the glyphs up again
+        buildAtlas(atlas, glyphCache);
+    }
+    reserveQuadIndices(this, atlas->vc / 4);
+    int regionQuads = (int) (stream->regionSize / (4 * sizeof(Point)));
+
+    glBindVertexArray(vao);
+    for (int i = 0; i < atlas->rc; ++i) {
+        const AtlasRange &range = atlas->ranges[i];
+        touchGlyphPage(glyphCache, range.page);
+        bindGlyphPage(glyphCache, range.page);
+        int first = range.first / 6;
+        int last = first + range.count / 6;
+        while (first < last) {
+            int quads = std::min(last - first, regionQuads);
+            GLsizeiptr bytes = quads * 4 * sizeof(Point);
+            GLintptr offset;
+            void *dst = mapStream(stream, bytes, sizeof(Point), &offset);
+            memcpy(dst, atlas->vertices + first * 4, bytes);
+            unmapStream(stream);
+            glDrawElementsBaseVertex(GL_TRIANGLES, quads * 6, GL_UNSIGNED_INT, nullptr,
+                                     (GLint) (offset / sizeof(Point)));
+            first += quads;
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,15 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef GL_RENDERER_H
+#define GL_RENDERER_H
+
+#include <glad/glad.h>
+#include "glyph_cache.h"
+#include "stream_buffer.h"
+#include "text_renderer.h"
+
+// program is built from res/vs_texture.glsl and res/fs_texture.glsl, quads go
+// through stream. Neither is owned.
+TextRenderer *createGLRenderer(GLuint program, GlyphCache *glyphCache, StreamBuffer *stream);
+
+#endif
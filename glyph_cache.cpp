@@ -0,0 +1,690 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#define STB_RECT_PACK_IMPLEMENTATION
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "glyph_cache.h"
+#include "mapped_file.h"
+#include "profiler.h"
+#include "sdf.h"
+
+// one texel of gutter keeps linear filtering from bleeding neighbours in
+static const int GLYPH_PADDING = 1;
+// empty texels around distance fields, so offset shadow taps never land on a
+// neighbouring coverage bitmap
+static const int SDF_MARGIN = SDF_SPREAD / 2;
+// distance field rows per task when a single glyph is generated
+static const int SDF_ROWS_PER_TASK = 8;
+// bumped whenever anything saveGlyphCache() writes changes shape
+static const unsigned int CACHE_VERSION = 1;
+// dirty rects are joined while their bounds copy at most this many times their texels
+static const int DIRTY_MERGE_WASTE = 2;
+
+size_t GlyphKeyHash::operator()(const GlyphKey &key) const {
+    size_t h = std::hash<void *>()(key.face);
+    h ^= key.glyph + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= key.size + 0x9e3779b9 + (h << 6) + (h >> 2);
+    h ^= key.mode + 0x9e3779b9 + (h << 6) + (h >> 2);
+    return h;
+}
+
+static long rectArea(const PageRect &rect) {
+    return (long) rect.w * rect.h;
+}
+
+// Records texels the page's texture lacks, joined with a dirty rect nearby
+// when that costs less to send than a transfer of its own.
+static void markDirty(GlyphCache *cache, AtlasPage &page, PageRect rect) {
+    if (!(cache->storage & GLYPH_STORAGE_GPU)) {
+        return;
+    }
+    // a joined rect can reach others it did not before, so joining goes on until nothing is cheap to join
+    for (size_t i = 0; i < page.dirty.size(); ++i) {
+        const PageRect &other = page.dirty[i];
+        int x0 = std::min(rect.x, other.x);
+        int y0 = std::min(rect.y, other.y);
+        int x1 = std::max(rect.x + rect.w, other.x + other.w);
+        int y1 = std::max(rect.y + rect.h, other.y + other.h);
+        PageRect joined = {x0, y0, x1 - x0, y1 - y0};
+        if (rectArea(joined) <= DIRTY_MERGE_WASTE * (rectArea(rect) + rectArea(other))) {
+            rect = joined;
+            page.dirty.erase(page.dirty.begin() + i);
+            i = (size_t) -1;
+        }
+    }
+    page.dirty.push_back(rect);
+}
+
+static void clearPage(GlyphCache *cache, AtlasPage &page) {
+    page.pixels.assign((size_t) cache->pageSize * cache->pageSize, 0);
+    page.dirty.clear();
+    markDirty(cache, page, {0, 0, cache->pageSize, cache->pageSize});
+    stbrp_init_target(&page.packer, cache->pageSize, cache->pageSize, page.nodes.data(), (int) page.nodes.size());
+}
+
+GlyphCache *createGlyphCache(int pageSize, int pageCount, int storage) {
+    auto cache = new GlyphCache;
+    cache->pageSize = pageSize;
+    cache->storage = storage;
+    cache->pages.resize(pageCount);
+    cache->clock = 0;
+    cache->hits = 0;
+    cache->misses = 0;
+    cache->evictions = 0;
+    cache->pool = nullptr;
+    cache->raster = std::make_shared<RasterQueue>();
+    cache->inFlight = 0;
+    cache->completed = 0;
+    cache->uploads = nullptr;
+    cache->uploadedBytes = 0;
+    cache->uploadCalls = 0;
+
+    bool gpu = (storage & GLYPH_STORAGE_GPU) != 0;
+    if (gpu) {
+        glActiveTexture(GL_TEXTURE0);
+        // a region holds a whole page, which is what a wiped page sends
+        cache->uploads = createStreamBuffer(GL_PIXEL_UNPACK_BUFFER,
+                                            (GLsizeiptr) STREAM_REGIONS * (pageSize * pageSize + 256),
+                                            true);
+    }
+    for (auto &page : cache->pages) {
+        page.texture = 0;
+        if (gpu) {
+            glGenTextures(1, &page.texture);
+            glBindTexture(GL_TEXTURE_2D, page.texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, pageSize, pageSize, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+            /* Clamping to edges is important to prevent artifacts when scaling */
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            /* Linear filtering usually looks best for text */
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        page.nodes.resize(pageSize);
+        page.generation = 1;
+        page.used = 0;
+        clearPage(cache, page);
+    }
+    if (gpu) {
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    return cache;
+}
+
+void destroyGlyphCache(GlyphCache *cache) {
+    for (auto &page : cache->pages) {
+        if (page.texture) {
+            glDeleteTextures(1, &page.texture);
+        }
+    }
+    if (cache->uploads) {
+        destroyStreamBuffer(cache->uploads);
+    }
+    delete cache;
+}
+
+void addFontFile(GlyphCache *cache, FT_Face face, const FontFile &file) {
+    cache->fontFiles[face] = file;
+}
+
+void touchGlyphPage(GlyphCache *cache, int page) {
+    cache->pages[page].used = ++cache->clock;
+}
+
+// Sends the page's dirty rects from its mirror through the unpack ring; the
+// texture must be bound. The copies land in the ring's mapped memory and the
+// GPU pulls them into the texture in order with the draws that follow.
+static void flushPage(GlyphCache *cache, AtlasPage &page) {
+    if (page.dirty.empty()) {
+        return;
+    }
+    PROFILE_SCOPE("upload");
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (const auto &rect : page.dirty) {
+        GLsizeiptr bytes = (GLsizeiptr) rect.w * rect.h;
+        GLintptr offset;
+        auto dst = (unsigned char *) mapStream(cache->uploads, bytes, 4, &offset);
+        const unsigned char *src = &page.pixels[(size_t) rect.y * cache->pageSize + rect.x];
+        for (int row = 0; row < rect.h; ++row) {
+            memcpy(dst + (size_t) row * rect.w, src + (size_t) row * cache->pageSize, (size_t) rect.w);
+        }
+        unmapStream(cache->uploads);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, rect.x, rect.y, rect.w, rect.h, GL_RED, GL_UNSIGNED_BYTE,
+                        (const void *) offset);
+        cache->uploadedBytes += bytes;
+        cache->uploadCalls++;
+        PROFILE_COUNT("atlas_upload_bytes", bytes);
+        PROFILE_COUNT("atlas_uploads", 1);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    page.dirty.clear();
+}
+
+void bindGlyphPage(GlyphCache *cache, int page) {
+    glBindTexture(GL_TEXTURE_2D, cache->pages[page].texture);
+    flushPage(cache, cache->pages[page]);
+}
+
+void flushGlyphUploads(GlyphCache *cache) {
+    if (!(cache->storage & GLYPH_STORAGE_GPU)) {
+        return;
+    }
+    for (auto &page : cache->pages) {
+        if (!page.dirty.empty()) {
+            glBindTexture(GL_TEXTURE_2D, page.texture);
+            flushPage(cache, page);
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+static int evictPage(GlyphCache *cache) {
+    int victim = 0;
+    for (int i = 1; i < (int) cache->pages.size(); ++i) {
+        if (cache->pages[i].used < cache->pages[victim].used) {
+            victim = i;
+        }
+    }
+    AtlasPage &page = cache->pages[victim];
+    for (const auto &key : page.keys) {
+        cache->glyphs.erase(key);
+    }
+    page.keys.clear();
+    page.generation++;
+    clearPage(cache, page);
+    cache->evictions++;
+    return victim;
+}
+
+static bool packGlyph(GlyphCache *cache, int page, stbrp_rect &rect) {
+    PROFILE_SCOPE("pack");
+    stbrp_pack_rects(&cache->pages[page].packer, &rect, 1);
+    return rect.was_packed != 0;
+}
+
+// Packs g's pixels into a page, evicting one when all are full, and records it.
+static const Glyph *storeGlyph(GlyphCache *cache, const GlyphKey &key, Glyph g,
+                               const unsigned char *pixels, int pitch, int margin) {
+    int pad = GLYPH_PADDING + 2 * margin;
+    if (g.w && g.h && g.w + pad <= cache->pageSize && g.h + pad <= cache->pageSize) {
+        stbrp_rect rect = {};
+        rect.w = (stbrp_coord) (g.w + pad);
+        rect.h = (stbrp_coord) (g.h + pad);
+        int page = -1;
+        for (int i = 0; i < (int) cache->pages.size() && page < 0; ++i) {
+            if (packGlyph(cache, i, rect)) {
+                page = i;
+            }
+        }
+        if (page < 0) {
+            page = evictPage(cache);
+            if (!packGlyph(cache, page, rect)) {
+                page = -1;
+            }
+        }
+        if (page >= 0) {
+            g.page = page;
+            g.x = rect.x + margin;
+            g.y = rect.y + margin;
+            cache->pages[page].keys.push_back(key);
+            touchGlyphPage(cache, page);
+            AtlasPage &target = cache->pages[page];
+            unsigned char *dst = &target.pixels[(size_t) g.y * cache->pageSize + g.x];
+            for (int row = 0; row < g.h; ++row) {
+                memcpy(dst + (size_t) row * cache->pageSize, pixels + row * pitch, (size_t) g.w);
+            }
+            markDirty(cache, target, {g.x, g.y, g.w, g.h});
+        }
+    }
+    return &cache->glyphs.emplace(key, g).first->second;
+}
+
+static const Glyph *storeSdf(GlyphCache *cache, const GlyphKey &key, const SdfBitmap &bitmap) {
+    Glyph g = {-1, 0, 0, bitmap.width, bitmap.rows, bitmap.left, bitmap.top};
+    return storeGlyph(cache, key, g, bitmap.pixels.data(), bitmap.width, SDF_MARGIN);
+}
+
+/*
+ * FreeType objects can not be shared between threads, so every worker lazily
+ * opens its own library and faces; they live until the thread exits.
+ */
+struct RasterThread {
+    FT_Library library = nullptr;
+    std::unordered_map<std::string, FT_Face> faces;
+
+    ~RasterThread() {
+        for (auto &entry : faces) {
+            FT_Done_Face(entry.second);
+        }
+        if (library) {
+            FT_Done_FreeType(library);
+        }
+    }
+};
+
+static FT_Face workerFace(const FontFile &file) {
+    static thread_local RasterThread thread;
+    if (!thread.library && FT_Init_FreeType(&thread.library)) {
+        thread.library = nullptr;
+        return nullptr;
+    }
+    // the mapping is part of the name, a face over an old one is never reused
+    std::string name = file.path + "#" + std::to_string(file.index) + "@" + std::to_string((size_t) file.data);
+    auto found = thread.faces.find(name);
+    if (found != thread.faces.end()) {
+        return found->second;
+    }
+    FT_Face face = nullptr;
+    FT_Error error = file.data ? FT_New_Memory_Face(thread.library, (const FT_Byte *) file.data, (FT_Long) file.size,
+                                                    file.index, &face)
+                               : FT_New_Face(thread.library, file.path.c_str(), file.index, &face);
+    if (error) {
+        face = nullptr;
+    }
+    thread.faces[name] = face;
+    return face;
+}
+
+static void rasterizeGlyph(const FontFile &file, RasterResult &result) {
+    PROFILE_SCOPE("raster");
+    FT_Face face = workerFace(file);
+    if (!face) {
+        return;
+    }
+    unsigned int size = result.key.size;
+    if (face->size->metrics.y_ppem != size) {
+        FT_Set_Pixel_Sizes(face, 0, size);
+    }
+    if (FT_Load_Glyph(face, result.key.glyph, FT_LOAD_RENDER)) {
+        return;
+    }
+    FT_GlyphSlot slot = face->glyph;
+    const FT_Bitmap &bitmap = slot->bitmap;
+    Glyph &g = result.glyph;
+    g.w = bitmap.width;
+    g.h = bitmap.rows;
+    g.left = slot->bitmap_left;
+    g.top = slot->bitmap_top;
+    result.pixels.resize((size_t) g.w * g.h);
+    for (int row = 0; row < g.h; ++row) {
+        memcpy(&result.pixels[(size_t) row * g.w], bitmap.buffer + row * bitmap.pitch, (size_t) g.w);
+    }
+}
+
+static void queueGlyph(GlyphCache *cache, const FontFile &file, const GlyphKey &key) {
+    std::shared_ptr<RasterQueue> raster = cache->raster;
+    cache->inFlight++;
+    submitTask(cache->pool, [raster, file, key] {
+        RasterResult result = {key, {-1, 0, 0, 0, 0, 0, 0}, {}};
+        rasterizeGlyph(file, result);
+        {
+            std::lock_guard<std::mutex> lock(raster->mutex);
+            raster->done.push_back(std::move(result));
+        }
+        raster->ready.notify_one();
+    });
+}
+
+int uploadRasterizedGlyphs(GlyphCache *cache) {
+    std::vector<RasterResult> done;
+    {
+        std::lock_guard<std::mutex> lock(cache->raster->mutex);
+        done.swap(cache->raster->done);
+    }
+    for (const auto &result : done) {
+        auto found = cache->glyphs.find(result.key);
+        if (found == cache->glyphs.end() || found->second.page != GLYPH_PENDING) {
+            continue;
+        }
+        cache->glyphs.erase(found);
+        storeGlyph(cache, result.key, result.glyph, result.pixels.data(), result.glyph.w, 0);
+    }
+    cache->inFlight -= (int) done.size();
+    if (!done.empty()) {
+        cache->completed++;
+    }
+    return (int) done.size();
+}
+
+void waitRasterizedGlyphs(GlyphCache *cache) {
+    if (!cache->inFlight) {
+        return;
+    }
+    RasterQueue *raster = cache->raster.get();
+    std::unique_lock<std::mutex> lock(raster->mutex);
+    raster->ready.wait(lock, [raster] { return !raster->done.empty(); });
+}
+
+const Glyph *cacheGlyph(GlyphCache *cache, FT_Face face, unsigned int glyph, unsigned int size,
+                        GlyphMode mode) {
+    GlyphKey key = {face, glyph, size, mode};
+    auto found = cache->glyphs.find(key);
+    if (found != cache->glyphs.end()) {
+        cache->hits++;
+        PROFILE_COUNT("glyph_hits", 1);
+        if (found->second.page >= 0) {
+            touchGlyphPage(cache, found->second.page);
+        }
+        return &found->second;
+    }
+    cache->misses++;
+    PROFILE_COUNT("glyph_misses", 1);
+
+    Glyph g = {-1, 0, 0, 0, 0, 0, 0};
+    if (mode == GLYPH_SDF) {
+        PROFILE_SCOPE("sdf");
+        SdfOutline outline;
+        if (!loadSdfOutline(face, glyph, size, &outline)) {
+            return &cache->glyphs.emplace(key, g).first->second;
+        }
+        SdfBitmap bitmap;
+        layoutSdf(outline, &bitmap);
+        int tasks = (bitmap.rows + SDF_ROWS_PER_TASK - 1) / SDF_ROWS_PER_TASK;
+        parallelFor(cache->pool, tasks, [&](int task) {
+            int first = task * SDF_ROWS_PER_TASK;
+            generateSdf(outline, &bitmap, first, std::min(first + SDF_ROWS_PER_TASK, bitmap.rows));
+        });
+        return storeSdf(cache, key, bitmap);
+    }
+
+    auto file = cache->fontFiles.find(face);
+    if (file != cache->fontFiles.end() && cache->pool && !cache->pool->threads.empty()) {
+        queueGlyph(cache, file->second, key);
+        g.page = GLYPH_PENDING;
+        return &cache->glyphs.emplace(key, g).first->second;
+    }
+
+    {
+        PROFILE_SCOPE("raster");
+        if (face->size->metrics.y_ppem != size) {
+            FT_Set_Pixel_Sizes(face, 0, size);
+        }
+        if (FT_Load_Glyph(face, glyph, FT_LOAD_RENDER)) {
+            return &cache->glyphs.emplace(key, g).first->second;
+        }
+    }
+    FT_GlyphSlot slot = face->glyph;
+    FT_Bitmap bitmap = slot->bitmap;
+    g.w = bitmap.width;
+    g.h = bitmap.rows;
+    g.left = slot->bitmap_left;
+    g.top = slot->bitmap_top;
+    return storeGlyph(cache, key, g, bitmap.buffer, bitmap.pitch, 0);
+}
+
+/*
+ * Outlines are loaded here, since the face is not thread safe, then each
+ * missing field is generated whole on one worker and uploaded afterwards.
+ */
+void prefetchGlyphs(GlyphCache *cache, FT_Face face, const unsigned int *glyphs, int count,
+                    unsigned int size, GlyphMode mode) {
+    if (mode != GLYPH_SDF) {
+        for (int i = 0; i < count; ++i) {
+            cacheGlyph(cache, face, glyphs[i], size, mode);
+        }
+        return;
+    }
+    std::vector<unsigned int> missing;
+    for (int i = 0; i < count; ++i) {
+        GlyphKey key = {face, glyphs[i], size, mode};
+        if (!cache->glyphs.count(key)) {
+            missing.push_back(glyphs[i]);
+        }
+    }
+    std::sort(missing.begin(), missing.end());
+    missing.erase(std::unique(missing.begin(), missing.end()), missing.end());
+
+    std::vector<unsigned int> pending;
+    std::vector<SdfOutline> outlines;
+    for (auto glyph : missing) {
+        SdfOutline outline;
+        if (loadSdfOutline(face, glyph, size, &outline)) {
+            pending.push_back(glyph);
+            outlines.push_back(std::move(outline));
+        } else {
+            cache->misses++;
+            PROFILE_COUNT("glyph_misses", 1);
+            cache->glyphs.emplace(GlyphKey{face, glyph, size, mode}, Glyph{-1, 0, 0, 0, 0, 0, 0});
+        }
+    }
+    std::vector<SdfBitmap> bitmaps(pending.size());
+    PROFILE_SCOPE("sdf");
+    parallelFor(cache->pool, (int) pending.size(), [&](int i) {
+        layoutSdf(outlines[i], &bitmaps[i]);
+        generateSdf(outlines[i], &bitmaps[i], 0, bitmaps[i].rows);
+    });
+    for (size_t i = 0; i < pending.size(); ++i) {
+        cache->misses++;
+        PROFILE_COUNT("glyph_misses", 1);
+        storeSdf(cache, GlyphKey{face, pending[i], size, mode}, bitmaps[i]);
+    }
+}
+
+/*
+ * Saved cache layout: the header, one hash per font file, the glyph records,
+ * then every page as its skyline followed by its texels when anything lives
+ * in it. Everything is in the writer's byte order and struct layout; a
+ * mismatch only costs a cold start.
+ */
+struct CacheHeader {
+    char magic[4];
+    unsigned int version;
+    int pageSize;
+    int pageCount;
+    int fontCount;
+    int glyphCount;
+};
+
+struct CacheGlyph {
+    int font;               // index into the saved hashes
+    unsigned int glyph;
+    unsigned int size;
+    int mode;
+    Glyph g;
+};
+
+struct CachePage {
+    int skyline;            // x, y pairs, the sentinel at the right edge left out
+    int filled;             // pageSize * pageSize texels follow
+};
+
+static const char CACHE_MAGIC[4] = {'G', 'L', 'Y', 'C'};
+
+bool saveGlyphCache(GlyphCache *cache, const char *path) {
+    std::unordered_map<FT_Face, int> fonts;
+    std::vector<unsigned long long> hashes;
+    for (const auto &entry : cache->fontFiles) {
+        if (entry.second.hash) {
+            fonts[entry.first] = (int) hashes.size();
+            hashes.push_back(entry.second.hash);
+        }
+    }
+    std::vector<CacheGlyph> glyphs;
+    for (const auto &entry : cache->glyphs) {
+        auto font = fonts.find(entry.first.face);
+        if (font == fonts.end() || entry.second.page == GLYPH_PENDING) {
+            continue;
+        }
+        glyphs.push_back({font->second, entry.first.glyph, entry.first.size, entry.first.mode, entry.second});
+    }
+
+    // written aside and renamed over, so a crash never leaves half a cache
+    std::string temp = std::string(path) + ".tmp";
+    FILE *out = fopen(temp.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+    CacheHeader header = {{CACHE_MAGIC[0], CACHE_MAGIC[1], CACHE_MAGIC[2], CACHE_MAGIC[3]}, CACHE_VERSION,
+                          cache->pageSize, (int) cache->pages.size(), (int) hashes.size(), (int) glyphs.size()};
+    bool written = fwrite(&header, sizeof(header), 1, out) == 1;
+    written = written && fwrite(hashes.data(), sizeof(hashes[0]), hashes.size(), out) == hashes.size();
+    written = written && fwrite(glyphs.data(), sizeof(CacheGlyph), glyphs.size(), out) == glyphs.size();
+    size_t bytes = (size_t) cache->pageSize * cache->pageSize;
+    std::vector<int> skyline;
+    for (auto &page : cache->pages) {
+        skyline.clear();
+        for (const stbrp_node *node = page.packer.active_head; node->next; node = node->next) {
+            skyline.push_back(node->x);
+            skyline.push_back(node->y);
+        }
+        CachePage saved = {(int) skyline.size() / 2, !page.keys.empty()};
+        written = written && fwrite(&saved, sizeof(saved), 1, out) == 1;
+        written = written && fwrite(skyline.data(), sizeof(int), skyline.size(), out) == skyline.size();
+        if (!saved.filled) {
+            continue;
+        }
+        written = written && fwrite(page.pixels.data(), 1, bytes, out) == bytes;
+    }
+    written = fclose(out) == 0 && written;
+    if (!written) {
+        remove(temp.c_str());
+        return false;
+    }
+    // rename does not replace on Windows
+    remove(path);
+    return rename(temp.c_str(), path) == 0;
+}
+
+// Rebuilds the packer's skyline from saved points, taking nodes from its free list.
+static bool restoreSkyline(AtlasPage &page, const char *points, int count, int pageSize) {
+    stbrp_init_target(&page.packer, pageSize, pageSize, page.nodes.data(), (int) page.nodes.size());
+    if (count < 1 || count > (int) page.nodes.size()) {
+        return false;
+    }
+    stbrp_node *last = page.packer.active_head;
+    stbrp_node *sentinel = last->next;
+    for (int i = 0; i < count; ++i) {
+        int point[2];
+        memcpy(point, points + i * sizeof(point), sizeof(point));
+        if (point[0] < 0 || point[0] >= pageSize || point[1] < 0 || point[1] > pageSize) {
+            return false;
+        }
+        if (i) {
+            last->next = page.packer.free_head;
+            last = last->next;
+            page.packer.free_head = last->next;
+        }
+        last->x = (stbrp_coord) point[0];
+        last->y = (stbrp_coord) point[1];
+    }
+    last->next = sentinel;
+    return true;
+}
+
+/*
+ * Whether a saved glyph can be trusted: a known font and mode, and a rect
+ * inside its page. Glyphs without a page only need sane sizes, since ones
+ * too large for a page are kept with their real size.
+ */
+static bool isSavedGlyphValid(const CacheGlyph &saved, int fontCount, int pageCount, int pageSize) {
+    const Glyph &g = saved.g;
+    if (saved.font < 0 || saved.font >= fontCount || (saved.mode != GLYPH_BITMAP && saved.mode != GLYPH_SDF) ||
+        g.page < -1 || g.page >= pageCount || g.x < 0 || g.y < 0 || g.w < 0 || g.h < 0) {
+        return false;
+    }
+    // subtracted, so a huge w or h can not overflow
+    return g.page < 0 || (g.x <= pageSize - g.w && g.y <= pageSize - g.h);
+}
+
+static void resetGlyphCache(GlyphCache *cache) {
+    cache->glyphs.clear();
+    for (auto &page : cache->pages) {
+        page.keys.clear();
+        clearPage(cache, page);
+    }
+}
+
+bool loadGlyphCache(GlyphCache *cache, const char *path) {
+    if (!cache->glyphs.empty()) {
+        return false;
+    }
+    MappedFile *file = mapFile(path);
+    if (!file) {
+        return false;
+    }
+    const char *cursor = file->data;
+    const char *end = file->data + file->size;
+    auto take = [&](size_t bytes) -> const char * {
+        if ((size_t) (end - cursor) < bytes) {
+            return nullptr;
+        }
+        const char *at = cursor;
+        cursor += bytes;
+        return at;
+    };
+
+    CacheHeader header;
+    const char *at = take(sizeof(header));
+    if (at) {
+        memcpy(&header, at, sizeof(header));
+    }
+    if (!at || memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) || header.version != CACHE_VERSION ||
+        header.pageSize != cache->pageSize || header.pageCount != (int) cache->pages.size() ||
+        header.fontCount < 0 || header.glyphCount < 0) {
+        unmapFile(file);
+        return false;
+    }
+    std::unordered_map<unsigned long long, FT_Face> registered;
+    for (const auto &entry : cache->fontFiles) {
+        if (entry.second.hash) {
+            registered[entry.second.hash] = entry.first;
+        }
+    }
+    std::vector<FT_Face> faces(header.fontCount, nullptr);
+    for (auto &face : faces) {
+        unsigned long long hash;
+        if (!(at = take(sizeof(hash)))) {
+            break;
+        }
+        memcpy(&hash, at, sizeof(hash));
+        auto found = registered.find(hash);
+        face = found == registered.end() ? nullptr : found->second;
+    }
+    const char *glyphs = at ? take((size_t) header.glyphCount * sizeof(CacheGlyph)) : nullptr;
+    bool loaded = glyphs != nullptr || !header.glyphCount;
+
+    size_t bytes = (size_t) cache->pageSize * cache->pageSize;
+    for (auto &page : cache->pages) {
+        CachePage saved;
+        if (!loaded || !(at = take(sizeof(saved)))) {
+            loaded = false;
+            break;
+        }
+        memcpy(&saved, at, sizeof(saved));
+        const char *skyline = saved.skyline > 0 ? take((size_t) saved.skyline * 2 * sizeof(int)) : nullptr;
+        const char *pixels = saved.filled ? take(bytes) : nullptr;
+        if (!skyline || (saved.filled && !pixels) || !restoreSkyline(page, skyline, saved.skyline, cache->pageSize)) {
+            loaded = false;
+            break;
+        }
+        if (!pixels) {
+            continue;
+        }
+        memcpy(page.pixels.data(), pixels, bytes);
+        markDirty(cache, page, {0, 0, cache->pageSize, cache->pageSize});
+    }
+
+    for (int i = 0; loaded && i < header.glyphCount; ++i) {
+        CacheGlyph saved;
+        memcpy(&saved, glyphs + i * sizeof(saved), sizeof(saved));
+        if (!isSavedGlyphValid(saved, header.fontCount, (int) cache->pages.size(), cache->pageSize)) {
+            loaded = false;
+            break;
+        }
+        if (!faces[saved.font]) {
+            continue;
+        }
+        GlyphKey key = {faces[saved.font], saved.glyph, saved.size, (GlyphMode) saved.mode};
+        cache->glyphs.emplace(key, saved.g);
+        if (saved.g.page >= 0) {
+            cache->pages[saved.g.page].keys.push_back(key);
+        }
+    }
+    unmapFile(file);
+    if (!loaded) {
+        resetGlyphCache(cache);
+    }
+    return loaded;
+}
@@ -0,0 +1,191 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef GLYPH_CACHE_H
+#define GLYPH_CACHE_H
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <glad/glad.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include <stb_rect_pack.h>
+#include "stream_buffer.h"
+#include "thread_pool.h"
+
+enum GlyphMode {
+    GLYPH_BITMAP,           // coverage rasterized by FreeType at the drawn size
+    GLYPH_SDF               // signed distance field at SDF_BASE_SIZE, drawn at any size
+};
+
+struct GlyphKey {
+    FT_Face face;
+    unsigned int glyph;
+    unsigned int size;
+    GlyphMode mode;
+
+    bool operator==(const GlyphKey &other) const {
+        return face == other.face && glyph == other.glyph && size == other.size && mode == other.mode;
+    }
+};
+
+struct GlyphKeyHash {
+    size_t operator()(const GlyphKey &key) const;
+};
+
+// Glyph::page while a worker is still rasterizing it; it is drawn as if empty.
+static const int GLYPH_PENDING = -2;
+
+struct Glyph {
+    int page;               // -1 when the glyph has no pixels, e.g. a space
+    int x;                  // texel rect inside the page
+    int y;
+    int w;
+    int h;
+    int left;               // bitmap bearing, as FT_GlyphSlot reports it, at key size
+    int top;
+};
+
+// Where createGlyphCache() keeps page texels, either or both. Every page
+// has a byte mirror; GPU textures are updated from it.
+enum GlyphStorage {
+    GLYPH_STORAGE_GPU = 1,      // a GL texture per page
+    GLYPH_STORAGE_CPU = 2       // the mirror is read for software compositing
+};
+
+// Texels of a page changed since its texture was last updated.
+struct PageRect {
+    int x;
+    int y;
+    int w;
+    int h;
+};
+
+struct AtlasPage {
+    GLuint texture;                 // 0 without GLYPH_STORAGE_GPU
+    std::vector<unsigned char> pixels;  // pageSize * pageSize, where glyphs are written first
+    std::vector<PageRect> dirty;    // with GLYPH_STORAGE_GPU, what the texture still lacks
+    stbrp_context packer;
+    std::vector<stbrp_node> nodes;
+    std::vector<GlyphKey> keys;     // glyphs living in this page, evicted together
+    unsigned int generation;        // bumped every time the page is recycled
+    unsigned long used;             // LRU clock at the last lookup
+};
+
+struct FontFile {
+    std::string path;
+    long index;
+    const char *data;           // the file already mapped, shared by the workers; nullptr to open path
+    size_t size;
+    unsigned long long hash;    // names the file's bytes in saved caches; 0 leaves the face out
+};
+
+struct RasterResult {
+    GlyphKey key;
+    Glyph glyph;
+    std::vector<unsigned char> pixels;  // w * h, tightly packed
+};
+
+// Bitmaps finished by workers, waiting for the GL thread to upload them.
+struct RasterQueue {
+    std::mutex mutex;
+    std::condition_variable ready;      // signalled with every result pushed to done
+    std::vector<RasterResult> done;
+};
+
+/*
+ * Long-lived glyph cache shared by every string. Bitmaps are packed into a
+ * fixed set of pages with the stb skyline packer; a skyline can not give
+ * single rects back, so when every page is full the least recently used page
+ * is wiped and repacked. Anything holding quads must compare the page
+ * generation it built against and rebuild when the page was recycled.
+ *
+ * Glyphs are written into the page's mirror and its rect marked dirty; the
+ * texture is only updated when the page is next bound for drawing. Dirty
+ * rects are merged, copied into a pixel unpack buffer ring and go to the
+ * texture with one glTexSubImage2D each, so a screen of new glyphs costs a
+ * few transfers the GPU does on its own time instead of one call per glyph.
+ *
+ * With a pool and the face's file registered, bitmap misses are rasterized
+ * on the workers, each with its own FT_Face, and come back as GLYPH_PENDING
+ * until uploadRasterizedGlyphs() puts them into a page on the GL thread.
+ */
+struct GlyphCache {
+    int pageSize;
+    int storage;            // GlyphStorage bits
+    std::vector<AtlasPage> pages;
+    std::unordered_map<GlyphKey, Glyph, GlyphKeyHash> glyphs;
+    unsigned long clock;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+    ThreadPool *pool;       // rasterizes and generates distance fields when set, not owned
+    std::unordered_map<FT_Face, FontFile> fontFiles;
+    std::shared_ptr<RasterQueue> raster;
+    int inFlight;
+    unsigned long completed;    // bumped by every upload that resolved pending glyphs
+    StreamBuffer *uploads;      // GL_PIXEL_UNPACK_BUFFER ring, null without GLYPH_STORAGE_GPU
+    unsigned long uploadedBytes;    // texels sent to textures so far
+    unsigned long uploadCalls;      // glTexSubImage2D calls that sent them
+};
+
+// Without GLYPH_STORAGE_GPU the cache makes no GL calls and needs no context.
+GlyphCache *createGlyphCache(int pageSize, int pageCount, int storage = GLYPH_STORAGE_GPU);
+
+void destroyGlyphCache(GlyphCache *cache);
+
+// Lets workers open their own copy of face, and lets saved glyphs of the file
+// find face again; other faces rasterize on the caller. file.data has to stay
+// mapped while the cache is alive.
+void addFontFile(GlyphCache *cache, FT_Face face, const FontFile &file);
+
+// Moves finished worker bitmaps into pages. Call on the GL thread once per
+// frame, before drawing; returns how many glyphs were resolved.
+int uploadRasterizedGlyphs(GlyphCache *cache);
+
+// Sleeps until a worker finishes a glyph; returns at once when one is
+// already waiting for uploadRasterizedGlyphs() or none is in flight.
+void waitRasterizedGlyphs(GlyphCache *cache);
+
+// Returns the cached glyph, rasterizing and uploading it on a miss, or queueing
+// it and returning it GLYPH_PENDING. The pointer is only valid until the next call.
+const Glyph *cacheGlyph(GlyphCache *cache, FT_Face face, unsigned int glyph, unsigned int size,
+                        GlyphMode mode = GLYPH_BITMAP);
+
+// Makes sure glyphs are cached or queued, generating missing distance fields
+// on the pool in parallel.
+void prefetchGlyphs(GlyphCache *cache, FT_Face face, const unsigned int *glyphs, int count,
+                    unsigned int size, GlyphMode mode);
+
+// Marks a page as just used so it is the last candidate for eviction.
+void touchGlyphPage(GlyphCache *cache, int page);
+
+// Binds the page's texture to GL_TEXTURE_2D after sending it the texels
+// written since it was last bound. Draws bind pages through this.
+void bindGlyphPage(GlyphCache *cache, int page);
+
+// Sends every page the texels it lacks, e.g. before timing the uploads.
+void flushGlyphUploads(GlyphCache *cache);
+
+/*
+ * Writes every page, its packer skyline and the glyphs in it to path, so
+ * the next start does not rasterize them again. Glyphs are keyed by the
+ * hash of their font file, size and mode; faces without a hash and glyphs
+ * still pending are left out.
+ */
+bool saveGlyphCache(GlyphCache *cache, const char *path);
+
+/*
+ * Maps a file written by saveGlyphCache() and copies its pages into the
+ * page mirrors, which go to the textures when next bound. Only works on a
+ * cache nothing was cached in yet, with the same page size and count;
+ * glyphs whose font file is not registered with addFontFile() are dropped.
+ * A file with any glyph outside its page, or of an unknown mode, is
+ * rejected whole. False leaves the cache empty.
+ */
+bool loadGlyphCache(GlyphCache *cache, const char *path);
+
+#endif
@@ -0,0 +1,103 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "glyph_instances.h"
+#include "profiler.h"
+
+static_assert(sizeof(GlyphInstance) == 16, "glyph instances must stay 16 bytes");
+
+static GLubyte toByte(float v) {
+    return (GLubyte) std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255.0f);
+}
+
+InstancedText *createInstancedText(GLuint program, GlyphCache *glyphCache, GLsizeiptr streamSize) {
+    auto text = new InstancedText;
+    text->program = program;
+    text->stream = createStreamBuffer(GL_ARRAY_BUFFER, streamSize, true);
+    text->pages.resize(glyphCache->pages.size());
+
+    glGenVertexArrays(1, &text->vao);
+    glBindVertexArray(text->vao);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(0, 1);
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribDivisor(2, 1);
+    glBindVertexArray(0);
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "text"), 0);
+    glUniform1f(glGetUniformLocation(program, "pageSize"), (GLfloat) glyphCache->pageSize);
+    text->originLocation = glGetUniformLocation(program, "origin");
+    glUseProgram(0);
+    return text;
+}
+
+void destroyInstancedText(InstancedText *text) {
+    glDeleteVertexArrays(1, &text->vao);
+    destroyStreamBuffer(text->stream);
+    delete text;
+}
+
+void appendInstances(InstancedText *text, const Atlas *atlas, GlyphCache *glyphCache,
+                     float r, float g, float b, float a) {
+    GlyphInstance instance;
+    instance.color[0] = toByte(r);
+    instance.color[1] = toByte(g);
+    instance.color[2] = toByte(b);
+    instance.color[3] = toByte(a);
+    const GlyphRun &run = atlas->run;
+    for (int f = 0; f < run.faceCount; ++f) {
+        FT_Face face = run.faces[f].face;
+        for (int i = run.faces[f].first, end = faceRunEnd(&run, f); i < end; ++i) {
+            const Glyph *glyph = cacheGlyph(glyphCache, face, run.glyphs[i], atlas->size);
+            if (glyph->page < 0 || !placeInstance(&instance, run.x[i] + glyph->left, run.y[i] + glyph->top)) {
+                continue;
+            }
+            instance.u = (GLushort) glyph->x;
+            instance.v = (GLushort) glyph->y;
+            instance.w = (GLushort) glyph->w;
+            instance.h = (GLushort) glyph->h;
+            text->pages[glyph->page].push_back(instance);
+        }
+    }
+}
+
+void drawInstancedText(InstancedText *text, GlyphCache *glyphCache) {
+    PROFILE_GPU_SCOPE("draw_instanced");
+    int regionInstances = (int) (text->stream->regionSize / sizeof(GlyphInstance));
+
+    glUseProgram(text->program);
+    glUniform2f(text->originLocation, 0, 0);
+    glBindVertexArray(text->vao);
+    glActiveTexture(GL_TEXTURE0);
+    for (int page = 0; page < (int) text->pages.size(); ++page) {
+        std::vector<GlyphInstance> &instances = text->pages[page];
+        if (instances.empty()) {
+            continue;
+        }
+        touchGlyphPage(glyphCache, page);
+        bindGlyphPage(glyphCache, page);
+        for (int first = 0; first < (int) instances.size(); first += regionInstances) {
+            int count = std::min((int) instances.size() - first, regionInstances);
+            GLsizeiptr bytes = count * sizeof(GlyphInstance);
+            GLintptr offset;
+            void *dst = mapStream(text->stream, bytes, sizeof(GlyphInstance), &offset);
+            memcpy(dst, instances.data() + first, bytes);
+            unmapStream(text->stream);
+
+            // GL 3.3 has no base instance, so the attributes move instead
+            glVertexAttribIPointer(0, 2, GL_SHORT, sizeof(GlyphInstance), (void *) offset);
+            glVertexAttribIPointer(1, 4, GL_UNSIGNED_SHORT, sizeof(GlyphInstance), (void *) (offset + 4));
+            glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GlyphInstance), (void *) (offset + 12));
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, count);
+        }
+        instances.clear();
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
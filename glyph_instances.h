@@ -0,0 +1,73 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef GLYPH_INSTANCES_H
+#define GLYPH_INSTANCES_H
+
+#include <cmath>
+#include <vector>
+#include <glad/glad.h>
+#include "atlas.h"
+#include "glyph_cache.h"
+#include "stream_buffer.h"
+
+// What GlyphInstance::x and y hold, in pixels from the origin.
+static const int INSTANCE_COORD_MIN = -32768;
+static const int INSTANCE_COORD_MAX = 32767;
+
+/*
+ * One glyph in 16 bytes. res/vs_instanced.glsl turns it into a quad from
+ * gl_VertexID, so there is no index buffer and no per-corner data.
+ */
+struct GlyphInstance {
+    GLshort x;              // top-left corner in pixels, relative to the origin uniform,
+    GLshort y;              // INSTANCE_COORD_MIN to INSTANCE_COORD_MAX
+    GLushort u;             // texel rect inside the atlas page
+    GLushort v;
+    GLushort w;
+    GLushort h;
+    GLubyte color[4];
+};
+
+/*
+ * Immediate instanced renderer. Strings are appended every frame into one
+ * bucket per atlas page and the buckets go through the streaming ring at
+ * draw time, one glDrawArraysInstanced per page.
+ */
+struct InstancedText {
+    GLuint program;
+    GLuint vao;
+    GLint originLocation;
+    StreamBuffer *stream;
+    std::vector<std::vector<GlyphInstance>> pages;
+};
+
+// program is built from res/vs_instanced.glsl and res/fs_batch.glsl.
+InstancedText *createInstancedText(GLuint program, GlyphCache *glyphCache, GLsizeiptr streamSize);
+
+void destroyInstancedText(InstancedText *text);
+
+// Sets the instance's corner to pixel x rounded and y floored. False, leaving
+// it alone, when that does not fit in a GLshort: the glyph is that far off
+// screen, so it is dropped rather than wrapped back onto it.
+inline bool placeInstance(GlyphInstance *instance, float x, float y) {
+    double px = std::round(x);
+    double py = std::floor(y);
+    // NaN fails every comparison, so it is dropped too
+    if (!(px >= INSTANCE_COORD_MIN && px <= INSTANCE_COORD_MAX && py >= INSTANCE_COORD_MIN &&
+          py <= INSTANCE_COORD_MAX)) {
+        return false;
+    }
+    instance->x = (GLshort) px;
+    instance->y = (GLshort) py;
+    return true;
+}
+
+// Resolves the atlas placements straight to instances, no quads are built.
+// Instances are texel sized, so GLYPH_SDF atlases are drawn from bitmaps.
+void appendInstances(InstancedText *text, const Atlas *atlas, GlyphCache *glyphCache,
+                     float r, float g, float b, float a = 1.0f);
+
+// Draws and empties every bucket.
+void drawInstancedText(InstancedText *text, GlyphCache *glyphCache);
+
+#endif
@@ -0,0 +1,261 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include "atlas.h"
+#include "image_batch.h"
+#include "profiler.h"
+
+// empty pixels around the text
+static const int IMAGE_MARGIN = 4;
+// rebuilds a wave gets before its glyphs are taken to be more than the cache holds
+static const int MAX_SETTLE_PASSES = 4;
+static const size_t JOB_FIELDS = 7;
+static const unsigned long MAX_JOB_SIZE = 4096;
+
+ImageBatch *createImageBatch(GlyphCache *glyphCache, ParallelShaper *shaper, ShapeCache *shapeCache) {
+    auto batch = new ImageBatch;
+    batch->glyphCache = glyphCache;
+    batch->shaper = shaper;
+    batch->shapeCache = shapeCache;
+    batch->arena = createArena();
+    batch->jobs.resize(IMAGE_BATCH_WAVE);
+    batch->count = 0;
+    batch->spans.resize(IMAGE_BATCH_WAVE);
+    batch->sizes.resize(IMAGE_BATCH_WAVE);
+    batch->shaped.resize(IMAGE_BATCH_WAVE);
+    batch->layouts.resize(IMAGE_BATCH_WAVE);
+    batch->atlases.resize(IMAGE_BATCH_WAVE);
+    batch->widths.resize(IMAGE_BATCH_WAVE);
+    batch->heights.resize(IMAGE_BATCH_WAVE);
+    int lanes = shaper->pool ? (int) shaper->pool->threads.size() + 1 : 1;
+    for (int i = 0; i < lanes; ++i) {
+        batch->renderers.push_back(createCPURenderer(glyphCache, 0, 0, PIXEL_RGBA));
+    }
+    batch->rendered = 0;
+    batch->failed = 0;
+    return batch;
+}
+
+void destroyImageBatch(ImageBatch *batch) {
+    for (auto renderer : batch->renderers) {
+        destroyRenderer(renderer);
+    }
+    destroyArena(batch->arena);
+    delete batch;
+}
+
+static void unescape(const std::string &in, size_t start, std::string &out) {
+    out.clear();
+    for (size_t i = start; i < in.size(); ++i) {
+        char c = in[i];
+        if (c == '\\' && i + 1 < in.size()) {
+            char next = in[++i];
+            c = next == 'n' ? '\n' : next == 't' ? '\t' : next;
+        }
+        out += c;
+    }
+}
+
+// The script of the first character that has one of its own.
+static hb_script_t guessScript(const std::string &text) {
+    hb_unicode_funcs_t *unicode = hb_unicode_funcs_get_default();
+    for (size_t at = 0, size; at < text.size(); at += size) {
+        unsigned int cp = decodeUtf8((const unsigned char *) text.data() + at, text.size() - at, &size);
+        hb_script_t script = hb_unicode_script(unicode, cp);
+        if (script != HB_SCRIPT_COMMON && script != HB_SCRIPT_INHERITED && script != HB_SCRIPT_UNKNOWN) {
+            return script;
+        }
+    }
+    return HB_SCRIPT_LATIN;
+}
+
+bool parseImageJob(const std::string &line, ImageJob *job) {
+    // every field but the text, which runs to the end of the line
+    std::string fields[JOB_FIELDS - 1];
+    size_t start = 0;
+    for (auto &field : fields) {
+        size_t tab = line.find('\t', start);
+        if (tab == std::string::npos) {
+            return false;
+        }
+        field.assign(line, start, tab - start);
+        start = tab + 1;
+    }
+    char *end;
+    unsigned long size = strtoul(fields[1].c_str(), &end, 10);
+    if (fields[0].empty() || *end || !size || size > MAX_JOB_SIZE) {
+        return false;
+    }
+    job->path = fields[0];
+    job->size = (unsigned int) size;
+    HBText &text = job->text;
+    unescape(line, start, text.data);
+    text.language = fields[2] == "-" ? "en" : fields[2];
+    text.script = fields[3] == "-" ? guessScript(text.data) : hb_script_from_string(fields[3].c_str(), -1);
+    text.direction = fields[4] == "-" ? hb_script_get_horizontal_direction(text.script)
+                                     : hb_direction_from_string(fields[4].c_str(), -1);
+    if (text.direction == HB_DIRECTION_INVALID) {
+        // scripts written either way have no direction of their own
+        text.direction = HB_DIRECTION_LTR;
+        if (fields[4] != "-") {
+            return false;
+        }
+    }
+    text.space = fields[5] == "-" ? 0 : strtof(fields[5].c_str(), &end);
+    return text.script != HB_SCRIPT_INVALID && (fields[5] == "-" || !*end);
+}
+
+static bool readLine(FILE *in, std::string &line) {
+    line.clear();
+    char chunk[4096];
+    while (fgets(chunk, sizeof(chunk), in)) {
+        line += chunk;
+        if (line.back() == '\n') {
+            break;
+        }
+    }
+    if (line.empty()) {
+        return false;
+    }
+    while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) {
+        line.pop_back();
+    }
+    return true;
+}
+
+/*
+ * Waits for the glyphs the atlases are missing and builds them again until
+ * none is stale. False when pages kept being recycled under them: more
+ * glyphs than the cache holds.
+ */
+static bool settleAtlases(GlyphCache *cache, Atlas **atlases, int count) {
+    for (int pass = 0; pass < MAX_SETTLE_PASSES; ++pass) {
+        // sleeps while the pool rasterizes, so the caller's core is not spent waiting
+        while (cache->inFlight) {
+            waitRasterizedGlyphs(cache);
+            uploadRasterizedGlyphs(cache);
+        }
+        bool stale = false;
+        for (int i = 0; i < count; ++i) {
+            if (isAtlasStale(atlases[i], cache)) {
+                buildAtlas(atlases[i], cache);
+                stale = true;
+            }
+        }
+        if (!stale) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool writeImage(ImageBatch *batch, CPURenderer *renderer, int job) {
+    int width = batch->widths[job];
+    int height = batch->heights[job];
+    renderer->width = width;
+    renderer->height = height;
+    // the allocation only grows, so it settles at the largest image; what is
+    // cleared and written is this image only
+    size_t bytes = (size_t) width * height * 4;
+    if (renderer->pixels.size() < bytes) {
+        renderer->pixels.resize(bytes);
+    }
+    renderer->clear(1, 1, 1);
+    renderer->drawText(batch->atlases[job], 0, 0, 0);
+    PROFILE_SCOPE("encode");
+    return saveCPURenderer(renderer, batch->jobs[job].path.c_str());
+}
+
+static void renderWave(ImageBatch *batch) {
+    int count = batch->count;
+    GlyphCache *cache = batch->glyphCache;
+    ThreadPool *pool = batch->shaper->pool;
+    {
+        PROFILE_SCOPE("batch_shape");
+        for (int i = 0; i < count; ++i) {
+            batch->spans[i] = textSpan(batch->jobs[i].text);
+            batch->sizes[i] = batch->jobs[i].size;
+        }
+        shapeBatch(batch->shaper, batch->shapeCache, batch->spans.data(), batch->sizes.data(), count,
+                   batch->shaped.data());
+        parallelFor(pool, count, [batch](int i) {
+            const ShapePiece &shaped = batch->shaped[i];
+            layoutParagraph(&batch->layouts[i], batch->spans[i], shaped.infos, shaped.positions, shaped.faces,
+                            batch->sizes[i]);
+        });
+    }
+
+    std::vector<Atlas *> &atlases = batch->atlases;
+    {
+        PROFILE_SCOPE("batch_raster");
+        resetArena(batch->arena);
+        // the first face's extents, so every line fits whatever falls back
+        FT_Face face = batch->shaper->fonts->faces[0].face;
+        for (int i = 0; i < count; ++i) {
+            const ParagraphLayout &layout = batch->layouts[i];
+            float scale = (float) layout.size / face->units_per_EM;
+            int ascent = (int) std::ceil(face->ascender * scale);
+            int descent = (int) std::ceil(-face->descender * scale);
+            size_t lines = std::max(layout.lines.size(), (size_t) 1);
+            float width, height;
+            measureParagraph(&layout, &width, &height);
+            batch->widths[i] = (int) std::ceil(width) + 2 * IMAGE_MARGIN;
+            batch->heights[i] = ascent + descent + (int) std::ceil((lines - 1) * layoutLineAdvance(&layout)) +
+                                2 * IMAGE_MARGIN;
+            atlases[i] = createAtlas(batch->arena, &layout, IMAGE_MARGIN,
+                                     (float) (batch->heights[i] - IMAGE_MARGIN - ascent), GLYPH_BITMAP,
+                                     (int) cache->pages.size());
+            buildAtlas(atlases[i], cache);
+        }
+        settleAtlases(cache, atlases.data(), count);
+    }
+
+    // nothing writes to the cache from here on, so every lane reads it at once
+    std::atomic<int> next(0);
+    std::atomic<unsigned long> failed(0);
+    {
+        PROFILE_SCOPE("batch_composite");
+        parallelFor(pool, (int) batch->renderers.size(), [&](int lane) {
+            for (int i = next++; i < count; i = next++) {
+                if (!isAtlasStale(atlases[i], cache) && !writeImage(batch, batch->renderers[lane], i)) {
+                    failed++;
+                }
+            }
+        });
+    }
+    // what did not fit in the cache together goes one job at a time
+    for (int i = 0; i < count; ++i) {
+        if (isAtlasStale(atlases[i], cache) && (!settleAtlases(cache, &atlases[i], 1) ||
+                                                !writeImage(batch, batch->renderers[0], i))) {
+            failed++;
+        }
+    }
+    batch->rendered += count - failed;
+    batch->failed += failed;
+    PROFILE_FRAME();
+}
+
+void runImageBatch(ImageBatch *batch, FILE *in) {
+    std::string line;
+    bool more = true;
+    while (more) {
+        // reading waits for the wave before, which is what holds a fast producer back
+        batch->count = 0;
+        while (batch->count < IMAGE_BATCH_WAVE && (more = readLine(in, line))) {
+            if (line.empty() || line[0] == '#') {
+                continue;
+            }
+            if (parseImageJob(line, &batch->jobs[batch->count])) {
+                batch->count++;
+            } else {
+                batch->failed++;
+            }
+        }
+        if (batch->count) {
+            renderWave(batch);
+        }
+    }
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef IMAGE_BATCH_H
+#define IMAGE_BATCH_H
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "arena.h"
+#include "cpu_renderer.h"
+#include "font_collection.h"
+#include "glyph_cache.h"
+#include "parallel_shaper.h"
+#include "shape_cache.h"
+#include "text.h"
+#include "text_layout.h"
+#include "thread_pool.h"
+
+// Jobs read, shaped, rasterized and written together; what memory is bounded by.
+static const int IMAGE_BATCH_WAVE = 64;
+
+// One image to make: a text, how it is shaped, and the file it goes to.
+struct ImageJob {
+    HBText text;
+    unsigned int size;      // pixels per em
+    std::string path;       // PNG when it ends in .png, BMP otherwise
+};
+
+/*
+ * Headless text to image. Jobs are read a wave at a time and every wave goes
+ * through the stages in order, each on every core:
+ *
+ *   shape       shapeBatch(), a job whole on one shaping lane
+ *   rasterize   atlases built on the caller, misses rasterized by the glyph
+ *               cache's pool until no atlas waits for a glyph
+ *   composite   a CPU renderer per lane, reading the cache's pages only
+ *   encode      on the lane that composited it
+ *
+ * The glyph cache only takes writes on the caller, so a stage does not start
+ * until the one before is done; the next wave is not read before that, so a
+ * slow encoder holds the reader back and a job stream of any length runs in
+ * the memory of one wave. Fonts, shaped words and glyphs are shared by every
+ * job.
+ */
+struct ImageBatch {
+    GlyphCache *glyphCache;             // not owned, GLYPH_STORAGE_CPU
+    ParallelShaper *shaper;             // not owned; its pool runs every stage
+    ShapeCache *shapeCache;             // not owned, the calling thread's
+    Arena *arena;                       // the wave's atlases
+    std::vector<ImageJob> jobs;         // IMAGE_BATCH_WAVE, reused; count are in flight
+    int count;
+    std::vector<TextSpan> spans;
+    std::vector<unsigned int> sizes;
+    std::vector<ShapePiece> shaped;
+    std::vector<ParagraphLayout> layouts;
+    std::vector<Atlas *> atlases;
+    std::vector<int> widths;
+    std::vector<int> heights;
+    std::vector<CPURenderer *> renderers;   // one per lane
+    unsigned long rendered;
+    unsigned long failed;               // lines that did not parse and images that were not written
+};
+
+ImageBatch *createImageBatch(GlyphCache *glyphCache, ParallelShaper *shaper, ShapeCache *shapeCache);
+
+void destroyImageBatch(ImageBatch *batch);
+
+/*
+ * One job per line, fields split by tabs:
+ *
+ *   output  size  language  script  direction  spacing  text
+ *
+ * script is an ISO 15924 tag and direction ltr, rtl, ttb or btt; "-" takes
+ * the language "en", the script of the first letter and that script's
+ * direction. \n, \t and \\ in text stand for themselves. False for lines
+ * that do not parse.
+ */
+bool parseImageJob(const std::string &line, ImageJob *job);
+
+// Renders every job of in, empty lines and lines starting with # left out.
+void runImageBatch(ImageBatch *batch, FILE *in);
+
+#endif
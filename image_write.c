@@ -0,0 +1,33 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <stdlib.h>
+#include <string.h>
+#include "image_write.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+int saveImage(const char *path, int width, int height, int channels, const void *pixels, int flip) {
+    size_t length = strlen(path);
+    size_t row = (size_t) width * channels;
+    unsigned char *flipped = NULL;
+    int saved;
+    // stbi_flip_vertically_on_write() sets a global, and images are written
+    // from several threads at once, so rows are flipped in a copy instead
+    if (flip) {
+        flipped = (unsigned char *) malloc(row * height);
+        if (!flipped) {
+            return 0;
+        }
+        for (int y = 0; y < height; ++y) {
+            memcpy(flipped + row * y, (const unsigned char *) pixels + row * (height - 1 - y), row);
+        }
+        pixels = flipped;
+    }
+    if (length > 4 && strcmp(path + length - 4, ".png") == 0) {
+        saved = stbi_write_png(path, width, height, channels, pixels, (int) row);
+    } else {
+        saved = stbi_write_bmp(path, width, height, channels, pixels);
+    }
+    free(flipped);
+    return saved;
+}
@@ -0,0 +1,20 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef IMAGE_WRITE_H
+#define IMAGE_WRITE_H
+
+/*
+ * Writes 8 bit pixels, top row first unless flip is set, with stb_image_write:
+ * PNG when path ends in .png, BMP otherwise. Returns 0 on failure.
+ */
+int saveImage(const char *path, int width, int height, int channels, const void *pixels, int flip);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
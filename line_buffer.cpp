@@ -0,0 +1,188 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include "line_buffer.h"
+#include "profiler.h"
+
+static const int MIN_SLOT = 16;
+
+LineBuffer *createLineBuffer(GLuint program, GlyphCache *glyphCache, int capacity) {
+    auto buffer = new LineBuffer;
+    buffer->program = program;
+    buffer->capacity = capacity;
+    buffer->head = 0;
+    buffer->epoch = 1;
+    buffer->uploaded = 0;
+    glGenBuffers(1, &buffer->buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->buffer);
+    glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(GlyphInstance), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glGenVertexArrays(1, &buffer->vao);
+    glBindVertexArray(buffer->vao);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    glVertexAttribDivisor(0, 1);
+    glVertexAttribDivisor(1, 1);
+    glVertexAttribDivisor(2, 1);
+    glBindVertexArray(0);
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "text"), 0);
+    glUniform1f(glGetUniformLocation(program, "pageSize"), (GLfloat) glyphCache->pageSize);
+    buffer->originLocation = glGetUniformLocation(program, "origin");
+    glUseProgram(0);
+    return buffer;
+}
+
+void destroyLineBuffer(LineBuffer *buffer) {
+    glDeleteVertexArrays(1, &buffer->vao);
+    glDeleteBuffers(1, &buffer->buffer);
+    delete buffer;
+}
+
+void initLineSlot(LineSlot *slot) {
+    slot->glyphs.clear();
+    slot->ranges.clear();
+    slot->first = 0;
+    slot->capacity = 0;
+    slot->epoch = 0;
+    slot->pending = 0;
+    slot->completed = 0;
+}
+
+bool isLineStale(const LineBuffer *buffer, const LineSlot *slot, const GlyphCache *glyphCache) {
+    if (slot->epoch != buffer->epoch || (slot->pending && slot->completed != glyphCache->completed)) {
+        return true;
+    }
+    for (const auto &range : slot->ranges) {
+        if (glyphCache->pages[range.page].generation != range.generation) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int lineSlotSize(const LineSlot *slot) {
+    return std::max((int) slot->glyphs.size() * 3 / 2, MIN_SLOT);
+}
+
+bool uploadLine(LineBuffer *buffer, LineSlot *slot, GlyphCache *glyphCache, unsigned int size,
+                const GLubyte color[4]) {
+    int pageCount = (int) glyphCache->pages.size();
+    std::vector<int> &counts = buffer->counts;
+    std::vector<Glyph> &resolved = buffer->resolved;
+    counts.assign(pageCount + 1, 0);
+    resolved.resize(slot->glyphs.size());
+    unsigned long evictions = glyphCache->evictions;
+    slot->pending = 0;
+    slot->completed = glyphCache->completed;
+    GlyphInstance instance;
+    for (size_t i = 0; i < slot->glyphs.size(); ++i) {
+        const GlyphPlacement &placement = slot->glyphs[i];
+        Glyph &g = resolved[i];
+        g = *cacheGlyph(glyphCache, placement.face, placement.glyph, size);
+        if (g.page == GLYPH_PENDING) {
+            slot->pending++;
+        } else if (g.page >= 0) {
+            // lines are never wrapped, so a long one runs past what an instance holds
+            if (placeInstance(&instance, placement.x + g.left, placement.y + g.top)) {
+                counts[g.page + 1]++;
+            } else {
+                g.page = -1;
+            }
+        }
+    }
+
+    slot->ranges.clear();
+    for (int page = 0; page < pageCount; ++page) {
+        if (counts[page + 1]) {
+            slot->ranges.push_back({page, glyphCache->pages[page].generation, counts[page], counts[page + 1]});
+        }
+        counts[page + 1] += counts[page];
+    }
+    int count = counts[pageCount];
+    if (slot->epoch != buffer->epoch || count > slot->capacity) {
+        int capacity = std::max(count + count / 2, MIN_SLOT);
+        if (buffer->head + capacity > buffer->capacity) {
+            return false;
+        }
+        slot->first = buffer->head;
+        slot->capacity = capacity;
+        slot->epoch = buffer->epoch;
+        buffer->head += capacity;
+    }
+
+    buffer->instances.resize(count);
+    std::copy(color, color + 4, instance.color);
+    for (size_t i = 0; i < slot->glyphs.size(); ++i) {
+        const Glyph &g = resolved[i];
+        if (g.page < 0) {
+            continue;
+        }
+        placeInstance(&instance, slot->glyphs[i].x + g.left, slot->glyphs[i].y + g.top);
+        instance.u = (GLushort) g.x;
+        instance.v = (GLushort) g.y;
+        instance.w = (GLushort) g.w;
+        instance.h = (GLushort) g.h;
+        buffer->instances[counts[g.page]++] = instance;
+    }
+    if (count) {
+        PROFILE_COUNT("upload_bytes", count * sizeof(GlyphInstance));
+        glBufferSubData(GL_ARRAY_BUFFER, slot->first * sizeof(GlyphInstance), count * sizeof(GlyphInstance),
+                        buffer->instances.data());
+        buffer->uploaded += count;
+    }
+    if (glyphCache->evictions != evictions) {
+        // a page was recycled while resolving, redo it on the next draw
+        for (auto &range : slot->ranges) {
+            range.generation = 0;
+        }
+    }
+    return true;
+}
+
+void resetLineBuffer(LineBuffer *buffer, int needed) {
+    if (needed * 2 > buffer->capacity) {
+        buffer->capacity = std::max(buffer->capacity * 2, needed * 4);
+        glBufferData(GL_ARRAY_BUFFER, buffer->capacity * sizeof(GlyphInstance), nullptr, GL_DYNAMIC_DRAW);
+    }
+    buffer->head = 0;
+    buffer->epoch++;
+}
+
+void drawLines(LineBuffer *buffer, GlyphCache *glyphCache, const LineDraw *lines, int count) {
+    PROFILE_GPU_SCOPE("draw_lines");
+    glUseProgram(buffer->program);
+    glBindVertexArray(buffer->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, buffer->buffer);
+    glActiveTexture(GL_TEXTURE0);
+    for (int page = 0; page < (int) glyphCache->pages.size(); ++page) {
+        bool bound = false;
+        for (int i = 0; i < count; ++i) {
+            const LineSlot *slot = lines[i].slot;
+            for (const auto &range : slot->ranges) {
+                if (range.page != page) {
+                    continue;
+                }
+                if (!bound) {
+                    touchGlyphPage(glyphCache, page);
+                    bindGlyphPage(glyphCache, page);
+                    bound = true;
+                }
+                glUniform2f(buffer->originLocation, lines[i].x, lines[i].y);
+                // GL 3.3 has no base instance, so the attributes move instead
+                GLintptr offset = (slot->first + range.first) * sizeof(GlyphInstance);
+                glVertexAttribIPointer(0, 2, GL_SHORT, sizeof(GlyphInstance), (void *) offset);
+                glVertexAttribIPointer(1, 4, GL_UNSIGNED_SHORT, sizeof(GlyphInstance), (void *) (offset + 4));
+                glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(GlyphInstance), (void *) (offset + 12));
+                glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, range.count);
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
@@ -0,0 +1,84 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef LINE_BUFFER_H
+#define LINE_BUFFER_H
+
+#include <vector>
+#include <glad/glad.h>
+#include "atlas.h"
+#include "glyph_cache.h"
+#include "glyph_instances.h"
+
+/*
+ * One line's glyphs, placed relative to its own pen origin, and the slot its
+ * instances hold in a LineBuffer.
+ */
+struct LineSlot {
+    std::vector<GlyphPlacement> glyphs;
+    std::vector<AtlasRange> ranges;     // per page, first and count in instances inside the slot
+    int first;                          // in LineBuffer::buffer, in instances
+    int capacity;
+    unsigned int epoch;                 // the slot is only valid while it equals LineBuffer::epoch
+    int pending;
+    unsigned long completed;
+};
+
+/*
+ * Instances of many lines in one buffer, every line in a slot of its own so
+ * it can be patched with glBufferSubData without touching the others. Slots
+ * are taken from a bump pointer; once it runs out the owner resets the
+ * buffer, which drops every slot at once, and uploads the lines it still
+ * shows. Lines are drawn through res/vs_instanced.glsl with their origin as
+ * a uniform.
+ */
+struct LineBuffer {
+    GLuint program;
+    GLuint vao;
+    GLuint buffer;
+    GLint originLocation;
+    int capacity;                       // in instances
+    int head;
+    unsigned int epoch;                 // bumped by resetLineBuffer()
+    std::vector<GlyphInstance> instances;
+    std::vector<int> counts;
+    std::vector<Glyph> resolved;
+    unsigned long uploaded;             // instances written with glBufferSubData so far
+};
+
+struct LineDraw {
+    const LineSlot *slot;
+    float x;                            // origin of the line
+    float y;
+};
+
+// program is built from res/vs_instanced.glsl and res/fs_batch.glsl.
+LineBuffer *createLineBuffer(GLuint program, GlyphCache *glyphCache, int capacity);
+
+void destroyLineBuffer(LineBuffer *buffer);
+
+void initLineSlot(LineSlot *slot);
+
+// True when the slot was dropped by a reset, or the pages or pending glyphs
+// its instances were built against changed.
+bool isLineStale(const LineBuffer *buffer, const LineSlot *slot, const GlyphCache *glyphCache);
+
+// Instances a slot for the line's glyphs takes, with room to grow.
+int lineSlotSize(const LineSlot *slot);
+
+/*
+ * Resolves the slot's glyphs to instances grouped by page and writes them
+ * into its slot, moving it to the head when it grew. buffer->buffer has to
+ * be bound to GL_ARRAY_BUFFER. Glyphs further from the line's origin than an
+ * instance holds are left out. Returns false when the buffer is out of room.
+ */
+bool uploadLine(LineBuffer *buffer, LineSlot *slot, GlyphCache *glyphCache, unsigned int size,
+                const GLubyte color[4]);
+
+// Drops every slot, growing the buffer when the lines about to be uploaded
+// again need more than half of it. buffer->buffer has to be bound.
+void resetLineBuffer(LineBuffer *buffer, int needed);
+
+// One glDrawArraysInstanced per line and page, page by page.
+void drawLines(LineBuffer *buffer, GlyphCache *glyphCache, const LineDraw *lines, int count);
+
+#endif
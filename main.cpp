@@ -2,10 +2,34 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
-#include "screenshot.h"
 #include "shader.h"
+#include "arena.h"
+#include "atlas.h"
+#include "font_collection.h"
+#include "glyph_cache.h"
+#include "shape_cache.h"
+#include "text.h"
+#include "text_batch.h"
+#include "stream_buffer.h"
+#include "glyph_instances.h"
+#include "curve_text.h"
+#include "thread_pool.h"
+#include "parallel_shaper.h"
+#include "gl_renderer.h"
+#include "cpu_renderer.h"
+#include "text_document.h"
+#include "text_view.h"
+#include "frame_capture.h"
+#include "damage.h"
+#include "image_batch.h"
+#include "profiler.h"
 
 #include <vector>
 #include "hb-icu.h"
@@ -22,9 +46,45 @@
 const unsigned int WINDOW_WIDTH = 800;
 const unsigned int WINDOW_HEIGHT = 600;
 static int shot = 0;
+static int cpuShot = 0;
+static int record = 0;
+// F8 records this many frames; BMP, since PNG encodes too slowly to keep up
+static const int RECORD_FRAMES = 120;
+static const char *RECORD_PATTERN = "record_%04d.bmp";
+
+enum DrawMode {
+    DRAW_BATCH,
+    DRAW_INSTANCED,
+    DRAW_IMMEDIATE,
+    DRAW_CURVES,
+    DRAW_MODES
+};
+static int drawMode = DRAW_BATCH;
+// F9 stops the colors and the zoom, and with nothing else changing no frame is drawn
+static bool animate = true;
+static DamageTracker *damage;
+static int documentObject;
+static int viewObject = -1;
+// how long an idle loop sleeps without input, and how long while glyphs or readbacks are on their way
+static const double IDLE_WAIT = 0.5;
+static const double BUSY_WAIT = 1.0 / 120;
+#ifdef TEXT_PROFILE
+static bool showHud = false;
+static int hudObject;
+#endif
 
 static void onSizeChange(GLFWwindow *window, int width, int height) {
     glViewport(0, 0, width, height);
+    if (damage) {
+        resizeDamageTracker(damage, width, height);
+    }
+}
+
+// The window was uncovered or its contents lost.
+static void onRefresh(GLFWwindow *window) {
+    if (damage) {
+        damageAll(damage);
+    }
 }
 
 static void processInput(GLFWwindow *window) {
@@ -32,251 +92,232 @@ static void processInput(GLFWwindow *window) {
         glfwSetWindowShouldClose(window, true);
     } else if (glfwGetKey(window, GLFW_KEY_F5) == GLFW_PRESS) {
         shot = 1;
+    } else if (glfwGetKey(window, GLFW_KEY_F7) == GLFW_PRESS) {
+        cpuShot = 1;
+    } else if (glfwGetKey(window, GLFW_KEY_F8) == GLFW_PRESS) {
+        record = RECORD_FRAMES;
     }
-}
-
-struct Point {
-    GLfloat x;
-    GLfloat y;
-    GLfloat s;
-    GLfloat t;
-};
-
-typedef struct {
-    GLuint texture1;
-    int w;
-    int h;
-    Point *vertices;
-    GLuint *indices;
-    int vc;
-    int ic;
-} Atlas;
-
-typedef struct {
-    std::string data;
-    std::string language;
-    hb_script_t script;
-    hb_direction_t direction;
-    float space;
-} HBText;
-
-static void force_ucs2_charmap(FT_Face ftf) {
-    for (int i = 0; i < ftf->num_charmaps; i++) {
-        if (((ftf->charmaps[i]->platform_id == 0)
-             && (ftf->charmaps[i]->encoding_id == 3))
-            || ((ftf->charmaps[i]->platform_id == 3)
-                && (ftf->charmaps[i]->encoding_id == 1))) {
-            FT_Set_Charmap(ftf, ftf->charmaps[i]);
-        }
+    static int toggle = GLFW_RELEASE;
+    int state = glfwGetKey(window, GLFW_KEY_F6);
+    if (state == GLFW_PRESS && toggle == GLFW_RELEASE) {
+        drawMode = (drawMode + 1) % DRAW_MODES;
+        damageAll(damage);
+    }
+    toggle = state;
+    static int animateToggle = GLFW_RELEASE;
+    int animateState = glfwGetKey(window, GLFW_KEY_F9);
+    if (animateState == GLFW_PRESS && animateToggle == GLFW_RELEASE) {
+        animate = !animate;
+    }
+    animateToggle = animateState;
+#ifdef TEXT_PROFILE
+    static int hudToggle = GLFW_RELEASE;
+    int hudState = glfwGetKey(window, GLFW_KEY_F3);
+    if (hudState == GLFW_PRESS && hudToggle == GLFW_RELEASE) {
+        showHud = !showHud;
+        damageObject(damage, hudObject);
     }
+    hudToggle = hudState;
+#endif
 }
 
-static FT_Face face;
+static FT_Library ft;
+static FontCollection *fonts;
 static GLuint program;
-static hb_font_t *hb_font;
-static GLuint VAO, VBO, IBO;
-static const int MAX_WIDTH = 1024;
-static const char CHAR_NEW_LINE = '\n';
+static GLuint batchProgram;
+static GLuint instancedProgram;
+static GLuint sdfProgram;
+static GLuint curveProgram;
+static StreamBuffer *vertexStream;
+static TextRenderer *glRenderer;
+static GlyphCache *glyphCache;
+static ShapeCache *shapeCache;
+static ThreadPool *threadPool;
+static ParallelShaper *shaper;
+static TextDocument *document;
+static TextView *fileView;
+static FrameCapture *frameCapture;
+static int cursorLine = 0;
+static size_t cursorColumn = 0;
+static const int ATLAS_PAGE_SIZE = 1024;
+static const int ATLAS_PAGE_COUNT = 4;
+static const size_t SHAPE_CACHE_CAPACITY = 4096;
+static const GLsizeiptr STREAM_SIZE = 12 * 1024 * 1024;
+// Fallback order: text, then emoji, then icons.
+static const char *FONT_FILES[] = {
+        "fonts/fzhtjt.ttf",
+        "fonts/NotoEmoji-Regular.ttf",
+        "fonts/entypo.ttf"
+};
+// glyphs rasterized by the last run, so a start does not redo them
+static const char *GLYPH_CACHE_FILE = "glyph_cache.bin";
+#ifdef TEXT_PROFILE
+static const char *PROFILE_TRACE_FILE = "profile_trace.json";
+static const int HUD_REFRESH_FRAMES = 30;
+static TextDocument *hud;
+#endif
 
-void *initHB() {
+void initHB() {
 
-    FT_Library ft;
     if (FT_Init_FreeType(&ft)) {
         std::cout << "ERROR::FREETYPE: Could not init FreeType Library" << std::endl;
         exit(1);
     }
-    if (FT_New_Face(ft, "fonts/fzhtjt.ttf", 0, &face)) {
-        std::cout << "ERROR::FREETYPE: Failed to load hb_font" << std::endl;
+    fonts = createFontCollection(ft);
+    for (auto path : FONT_FILES) {
+        int index = addFontFace(fonts, path);
+        if (index < 0) {
+            std::cout << "ERROR::FREETYPE: Failed to load " << path << std::endl;
+            continue;
+        }
+        const FontFace &face = fonts->faces[index];
+        addFontFile(glyphCache, face.face, {face.path, face.index, face.file->data, face.file->size, face.hash});
+    }
+    if (fonts->faces.empty()) {
         exit(1);
     }
-    force_ucs2_charmap(face);
-    hb_font = hb_ft_font_create(face, nullptr);
-    // hb_ft_font_set_funcs(hb_font);
-};
+    if (loadGlyphCache(glyphCache, GLYPH_CACHE_FILE)) {
+        std::cout << "glyph cache: " << glyphCache->glyphs.size() << " glyphs from " << GLYPH_CACHE_FILE << std::endl;
+    }
+    shapeCache = createShapeCache(SHAPE_CACHE_CAPACITY);
+    // long text is shaped on the pool's threads too
+    shaper = createParallelShaper(fonts, threadPool, SHAPE_CACHE_CAPACITY);
+}
 
-static hb_position_t HBFloatToFixed(float v) {
-    return scalbnf(v, +8);
+// Shaping and layout scratch, kept between renderText() calls so only the
+// arena grows.
+static std::vector<hb_glyph_info_t> renderInfos;
+static std::vector<hb_glyph_position_t> renderPositions;
+static std::vector<FaceRun> renderFaces;
+static ParagraphLayout renderLayout;
+
+Atlas *renderText(Arena *arena, const TextSpan &text, unsigned int size, float x = 0, float y = 0,
+                  float lineHeight = 1.0f, GlyphMode mode = GLYPH_BITMAP, float width = 0) {
+    PROFILE_SCOPE("render_text");
+    shapeParallel(shaper, shapeCache, size, text, renderInfos, renderPositions, renderFaces);
+    layoutParagraph(&renderLayout, text, renderInfos, renderPositions, renderFaces, size, lineHeight, width);
+    Atlas *atlas = createAtlas(arena, &renderLayout, x, y, mode, (int) glyphCache->pages.size());
+    buildAtlas(atlas, glyphCache);
+    PROFILE_COUNT("text_quads", atlas->vc / 4);
+    PROFILE_COUNT("text_pending", atlas->pending);
+    return atlas;
 }
 
-static inline bool IsNewlineSegment(const std::string &text, int index) {
-    return text[index] == CHAR_NEW_LINE;
+static void encodeUtf8(unsigned int codepoint, std::string &out) {
+    out.clear();
+    if (codepoint < 0x80) {
+        out += (char) codepoint;
+    } else if (codepoint < 0x800) {
+        out += (char) (0xc0 | (codepoint >> 6));
+        out += (char) (0x80 | (codepoint & 0x3f));
+    } else if (codepoint < 0x10000) {
+        out += (char) (0xe0 | (codepoint >> 12));
+        out += (char) (0x80 | ((codepoint >> 6) & 0x3f));
+        out += (char) (0x80 | (codepoint & 0x3f));
+    } else {
+        out += (char) (0xf0 | (codepoint >> 18));
+        out += (char) (0x80 | ((codepoint >> 12) & 0x3f));
+        out += (char) (0x80 | ((codepoint >> 6) & 0x3f));
+        out += (char) (0x80 | (codepoint & 0x3f));
+    }
 }
 
-Atlas *renderText(HBText text, unsigned int size, float x = 0, float y = 0, float lineHeight = 1.0f) {
-    auto atlas = new Atlas;
-    FT_Set_Pixel_Sizes(face, 0, size);
-    auto buffer = hb_buffer_create();
-    hb_font_set_ppem(hb_font, size, size);
-    hb_font_set_scale(hb_font, HBFloatToFixed(size),
-                      HBFloatToFixed(size));
-    hb_buffer_reset(buffer);
-    hb_buffer_set_direction(buffer, text.direction);
-    hb_buffer_set_script(buffer, text.script);
-    hb_buffer_set_language(buffer, hb_language_from_string(text.language.c_str(), text.language.size()));
-    size_t length = text.data.size();
-
-    hb_buffer_add_utf8(buffer, text.data.c_str(), length, 0, length);
-    hb_shape(hb_font, buffer, nullptr, 0);
-
-
-    unsigned int glyphCount;
-    hb_glyph_info_t *infos = hb_buffer_get_glyph_infos(buffer, &glyphCount);
-    hb_glyph_position_t *positions = hb_buffer_get_glyph_positions(buffer, &glyphCount);
-
-    unsigned int roww = 0;
-    unsigned int rowh = 0;
-    unsigned int tw = 0;
-    unsigned int th = 0;
-    float rx = x;
-
-    for (unsigned int i = 0; i < glyphCount; ++i) {
-
-        hb_glyph_info_t info = infos[i];
-        FT_Load_Glyph(face,
-                      info.codepoint,
-                      FT_LOAD_DEFAULT
-        );
-
-        FT_GlyphSlot slot = face->glyph;
-        FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
-
-        FT_Bitmap bitmap = slot->bitmap;
-
-        if (roww + bitmap.width + 1 >= MAX_WIDTH) {
-            tw = std::max(tw, roww);
-            th += rowh;
-            roww = 0;
-            rowh = 0;
-        }
-        roww += bitmap.width + 1;
-        rowh = std::max(rowh, bitmap.rows);
+// Scrolls the document so the line being typed on stays inside its box, and
+// has the box redrawn.
+static void followCursor() {
+    float advance = documentLineAdvance(document);
+    document->scroll = std::max(0.0f, cursorLine * advance - (document->y - document->bottom));
+    damageObject(damage, documentObject);
+}
+
+void onInputText(GLFWwindow *window, unsigned int codepoint, int mods) {
+    if (!document) {
+        return;
     }
-    tw = std::max(tw, roww);
-    th += rowh;
+    std::string bytes;
+    encodeUtf8(codepoint, bytes);
+    insertText(document, cursorLine, cursorColumn, bytes.data(), bytes.size());
+    cursorColumn += bytes.size();
+    followCursor();
+}
 
-    atlas->w = tw;
-    atlas->h = th;
+static void scrollFileView(double lines) {
+    fileView->scroll = std::max(0.0, fileView->scroll + lines * viewLineAdvance(fileView));
+    damageObject(damage, viewObject);
+}
 
-    glActiveTexture(GL_TEXTURE0);
-    glGenTextures(1, &atlas->texture1);
-    glBindTexture(GL_TEXTURE_2D, atlas->texture1);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, tw, th, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    /* Clamping to edges is important to prevent artifacts when scaling */
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    /* Linear filtering usually looks best for text */
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-    int ox = 0;
-    int oy = 0;
-    rowh = 0;
-    int ic = 0;
-    int vc = 0;
-    atlas->vertices = new Point[4 * glyphCount];
-    atlas->indices = new GLuint[6 * glyphCount];
-    float letterSpace = text.space;
-    float letterSpaceHalfLeft = letterSpace * 0.5f;
-    float letterSpaceHalfRight = letterSpace - letterSpaceHalfLeft;
-
-    if (glyphCount) {
-        x += letterSpaceHalfLeft;
-    }
-    for (unsigned int i = 0; i < glyphCount; ++i) {
-        hb_glyph_info_t info = infos[i];
-        hb_glyph_position_t pos = positions[i];
-
-        FT_Load_Glyph(face,
-                      info.codepoint,
-                      FT_LOAD_DEFAULT
-        );
-
-        FT_GlyphSlot slot = face->glyph;
-        FT_Render_Glyph(slot, FT_RENDER_MODE_NORMAL);
-        FT_Bitmap bitmap = slot->bitmap;
-
-        if (ox + bitmap.width + 1 >= MAX_WIDTH) {
-            oy += rowh;
-            rowh = 0;
-            ox = 0;
-        }
+static void onScroll(GLFWwindow *window, double x, double y) {
+    if (fileView) {
+        scrollFileView(-3 * y);
+    }
+}
 
-        glTexSubImage2D(GL_TEXTURE_2D, 0, ox, oy, bitmap.width, bitmap.rows, GL_RED, GL_UNSIGNED_BYTE, bitmap.buffer);
-        float s0 = ox / (float) tw;
-        float t0 = oy / (float) th;
-
-        float xa = (float) pos.x_advance / 64;
-        float ya = (float) pos.y_advance / 64;
-        // float xo = (float) pos.x_offset / 64;
-        // float yo = (float) pos.y_offset / 64;
-
-        float s1 = s0 + float(bitmap.width) / atlas->w;
-        float t1 = t0 + float(bitmap.rows) / atlas->h;
-        float x0 = x + slot->bitmap_left;
-        float y0 = floor(y + slot->bitmap_top);
-        float x1 = x0 + bitmap.width;
-        float y1 = floor(y0 - bitmap.rows);
-
-        // printf("vertices: %f,%f,%f,%f,%f,%f,%f,%f,%d \n", x0, y0, x1, y1, s0, t0, s1, t1, bitmap.width);
-
-        rowh = std::max(rowh, bitmap.rows);
-        ox += bitmap.width + 1;
-        if (IsNewlineSegment(text.data, i)) {
-            x = rx + letterSpaceHalfLeft;
-            y -= ya + lineHeight * size;
-        } else {
-            x += xa + letterSpace;
-            y -= ya;
+static void onKey(GLFWwindow *window, int key, int scancode, int action, int mods) {
+    if (fileView && action != GLFW_RELEASE) {
+        double page = (fileView->top - fileView->bottom) / viewLineAdvance(fileView);
+        if (key == GLFW_KEY_PAGE_DOWN) {
+            scrollFileView(page);
+        } else if (key == GLFW_KEY_PAGE_UP) {
+            scrollFileView(-page);
+        } else if (key == GLFW_KEY_HOME) {
+            fileView->scroll = 0;
+            damageObject(damage, viewObject);
+        } else if (key == GLFW_KEY_END) {
+            // the only key that makes the whole file get scanned
+            fileView->scroll = 0;
+            scrollFileView(countViewLines(fileView) - page);
         }
-
-        atlas->vertices[vc++] = {
-                x0, y0, s0, t0
-        };
-        atlas->vertices[vc++] = {
-                x0, y1, s0, t1
-        };
-        atlas->vertices[vc++] = {
-                x1, y1, s1, t1
-        };
-        atlas->vertices[vc++] = {
-                x1, y0, s1, t0
-        };
-
-        GLuint index = i * 4;
-        atlas->indices[ic++] = index;
-        atlas->indices[ic++] = index + 1;
-        atlas->indices[ic++] = index + 2;
-        atlas->indices[ic++] = index;
-        atlas->indices[ic++] = index + 2;
-        atlas->indices[ic++] = index + 3;
-    }
-    if (glyphCount) {
-        x += letterSpaceHalfRight;
-    }
-    atlas->vc = vc;
-    atlas->ic = ic;
-
-    printf("atlas: %d, %d, %d, %d, %f \n", atlas->w, atlas->h, atlas->vc, ic, x);
-
-    glBindTexture(GL_TEXTURE_2D, 0);
-    hb_buffer_destroy(buffer);
-    return atlas;
+    }
+    if (!document || action == GLFW_RELEASE) {
+        return;
+    }
+    if (key == GLFW_KEY_ENTER) {
+        insertText(document, cursorLine, cursorColumn, "\n", 1);
+        cursorLine++;
+        cursorColumn = 0;
+    } else if (key == GLFW_KEY_BACKSPACE) {
+        if (cursorColumn) {
+            std::string line;
+            getParagraphText(document, cursorLine, line);
+            size_t start = cursorColumn - 1;
+            while (start && (line[start] & 0xc0) == 0x80) {
+                start--;
+            }
+            eraseText(document, cursorLine, start, cursorColumn - start);
+            cursorColumn = start;
+        } else if (cursorLine) {
+            cursorLine--;
+            cursorColumn = document->paragraphs[cursorLine]->length;
+            eraseText(document, cursorLine, cursorColumn, 1);
+        }
+    }
+    followCursor();
 }
 
-void onInputText(GLFWwindow *window, unsigned int codepoint, int mods) {
-    std::cout << codepoint << " : " << mods << std::endl;
-    if (mods == 1) {
-        std::cout << "Shift key pressed aswell" << std::endl;
+#ifdef TEXT_PROFILE
+// The profiler's averages, drawn as a document of their own in the corner.
+static void refreshHud() {
+    if (hud) {
+        destroyTextDocument(hud);
     }
+    HBText text = {"", "en", HB_SCRIPT_LATIN, HB_DIRECTION_LTR};
+    formatProfile(text.data);
+    hud = createTextDocument(instancedProgram, glyphCache, text, fonts, 12, 1.2f);
+    hud->x = 620;
+    hud->y = 260;
+    hud->top = 270;
+    hud->bottom = 10;
+    hud->color[0] = 160;
 }
+#endif
 
 GLFWwindow *initWindow() {
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_SAMPLES, 1);
+    // frames are drawn into the damage tracker's framebuffer, and a blit can not go to a multisampled one
+    glfwWindowHint(GLFW_SAMPLES, 0);
     GLFWwindow *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "LearnOpenGL", nullptr, nullptr);
     if (window == nullptr) {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -294,6 +335,9 @@ GLFWwindow *initWindow() {
     glfwMakeContextCurrent(window);
     glfwSetFramebufferSizeCallback(window, onSizeChange);
     glfwSetCharModsCallback(window, onInputText);
+    glfwSetKeyCallback(window, onKey);
+    glfwSetScrollCallback(window, onScroll);
+    glfwSetWindowRefreshCallback(window, onRefresh);
     if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
         std::cout << "Failed to initialize GLAD" << std::endl;
         glfwTerminate();
@@ -302,8 +346,11 @@ GLFWwindow *initWindow() {
     return window;
 }
 
-void initGL() {
-    glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+void initGL(GLFWwindow *window) {
+    // on HiDPI screens the framebuffer has more pixels than the window
+    int framebufferWidth, framebufferHeight;
+    glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+    glViewport(0, 0, framebufferWidth, framebufferHeight);
     glClearColor(1, 1, 1, 1);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     glDisable(GL_DEPTH_TEST);
@@ -319,39 +366,143 @@ void initGL() {
     glUseProgram(program);
     glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
 
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &IBO);
-    glBindVertexArray(0);
+    batchProgram = shader_load("res/vs_batch.glsl",
+                               "res/fs_batch.glsl");
+    glUseProgram(batchProgram);
+    glUniformMatrix4fv(glGetUniformLocation(batchProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+
+    instancedProgram = shader_load("res/vs_instanced.glsl",
+                                   "res/fs_batch.glsl");
+    glUseProgram(instancedProgram);
+    glUniformMatrix4fv(glGetUniformLocation(instancedProgram, "projection"), 1, GL_FALSE,
+                       glm::value_ptr(projection));
+
+    sdfProgram = shader_load("res/vs_batch.glsl",
+                             "res/fs_sdf.glsl");
+    glUseProgram(sdfProgram);
+    glUniformMatrix4fv(glGetUniformLocation(sdfProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUniform4f(glGetUniformLocation(sdfProgram, "outlineColor"), 1.0f, 0.8f, 0.0f, 1.0f);
+    glUniform1f(glGetUniformLocation(sdfProgram, "outlineWidth"), 0.12f);
+    glUniform4f(glGetUniformLocation(sdfProgram, "shadowColor"), 0.0f, 0.0f, 0.0f, 0.4f);
+    glUniform2f(glGetUniformLocation(sdfProgram, "shadowOffset"), 2.0f / ATLAS_PAGE_SIZE, 2.0f / ATLAS_PAGE_SIZE);
+    glUniform1f(glGetUniformLocation(sdfProgram, "shadowSoftness"), 0.1f);
+
+    curveProgram = shader_load("res/vs_curve.glsl",
+                               "res/fs_curve.glsl");
+    glUseProgram(curveProgram);
+    glUniformMatrix4fv(glGetUniformLocation(curveProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
+    glUseProgram(0);
+
+    loadBufferStorage((GLADloadproc) glfwGetProcAddress);
+    vertexStream = createStreamBuffer(GL_ARRAY_BUFFER, STREAM_SIZE, true);
+
+    threadPool = createThreadPool(0);
+    // the CPU mirror lets F7 composite the same glyphs without GL
+    glyphCache = createGlyphCache(ATLAS_PAGE_SIZE, ATLAS_PAGE_COUNT, GLYPH_STORAGE_GPU | GLYPH_STORAGE_CPU);
+    glyphCache->pool = threadPool;
+    glRenderer = createGLRenderer(program, glyphCache, vertexStream);
+    frameCapture = createFrameCapture();
 }
 
-void drawText(Atlas *atlas) {
-    glBindTexture(GL_TEXTURE_2D, atlas->texture1);
-    glBindVertexArray(VAO);
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), nullptr);
-    glBufferData(GL_ARRAY_BUFFER, atlas->vc * 4 * sizeof(GLfloat), atlas->vertices, GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, atlas->ic * sizeof(GLfloat), atlas->indices, GL_DYNAMIC_DRAW);
-    glDrawElements(GL_TRIANGLES, atlas->ic, GL_UNSIGNED_INT, nullptr);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    glBindVertexArray(0);
+// Box around the pen positions of a run, wide enough for any glyph drawn at them.
+static DamageRect atlasBounds(const Atlas *atlas) {
+    const GlyphRun &run = atlas->run;
+    float size = (float) atlas->size;
+    DamageRect box = {0, 0, 0, 0};
+    for (int i = 0; i < run.count; ++i) {
+        if (i == 0) {
+            box = {run.x[i], run.y[i], run.x[i], run.y[i]};
+        }
+        box.x0 = std::min(box.x0, run.x[i]);
+        box.y0 = std::min(box.y0, run.y[i]);
+        box.x1 = std::max(box.x1, run.x[i]);
+        box.y1 = std::max(box.y1, run.y[i]);
+    }
+    return {box.x0 - size * 0.5f, box.y0 - size * 0.5f, box.x1 + size * 1.5f, box.y1 + size * 1.5f};
+}
+
+// Lines with their baseline in [bottom, top], from x to the right edge.
+static DamageRect linesBounds(float x, float top, float bottom, unsigned int size) {
+    return {x - size, bottom - size, (float) WINDOW_WIDTH, top + size};
+}
+
+// Box around rect after the affine transform [a c tx; b d ty].
+static DamageRect transformRect(const DamageRect &rect, float a, float b, float c, float d, float tx, float ty) {
+    float xs[] = {rect.x0, rect.x1, rect.x0, rect.x1};
+    float ys[] = {rect.y0, rect.y0, rect.y1, rect.y1};
+    DamageRect box = {FLT_MAX, FLT_MAX, -FLT_MAX, -FLT_MAX};
+    for (int i = 0; i < 4; ++i) {
+        float x = a * xs[i] + c * ys[i] + tx;
+        float y = b * xs[i] + d * ys[i] + ty;
+        box.x0 = std::min(box.x0, x);
+        box.y0 = std::min(box.y0, y);
+        box.x1 = std::max(box.x1, x);
+        box.y1 = std::max(box.y1, y);
+    }
+    return box;
 }
 
-void destroyAtlas(Atlas *a) {
-    glDeleteTextures(1, &a->texture1);
-    delete[] a->indices;
-    delete[] a->vertices;
-    delete a;
+// The plain text, drawn through whichever renderer is given.
+static void drawScene(TextRenderer *renderer, Atlas **atlases, float value) {
+    renderer->drawText(atlases[0], 0, 1.0, value);
+    renderer->drawText(atlases[1], 0, value, value);
+    renderer->drawText(atlases[2], 0.5, 0, value);
+    renderer->drawText(atlases[3], 0, 0, value);
+    renderer->drawText(atlases[4], 0.3, 0.3, 0.3);
 }
 
-int main() {
+// Renders the jobs of path, or of stdin for "-", with no window or GL.
+static int runBatch(const char *path) {
+    FILE *in = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+    if (!in) {
+        std::cout << "ERROR::BATCH: Failed to open " << path << std::endl;
+        return 1;
+    }
+    threadPool = createThreadPool(0);
+    glyphCache = createGlyphCache(ATLAS_PAGE_SIZE, ATLAS_PAGE_COUNT, GLYPH_STORAGE_CPU);
+    glyphCache->pool = threadPool;
+    initHB();
+    ImageBatch *images = createImageBatch(glyphCache, shaper, shapeCache);
+    auto start = std::chrono::steady_clock::now();
+    runImageBatch(images, in);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (in != stdin) {
+        fclose(in);
+    }
+    std::cout << "batch: " << images->rendered << " images in " << seconds << " s, "
+              << (seconds > 0 ? images->rendered / seconds : 0) << " per second, " << images->failed << " failed"
+              << std::endl;
+    int status = images->failed ? 1 : 0;
+    destroyImageBatch(images);
+#ifdef TEXT_PROFILE
+    if (saveProfileTrace(PROFILE_TRACE_FILE)) {
+        std::cout << "profile: trace written to " << PROFILE_TRACE_FILE << std::endl;
+    }
+#endif
+    // not saved: the window's next start should find its own glyphs, not the jobs'
+    destroyGlyphCache(glyphCache);
+    destroyThreadPool(threadPool);
+    destroyParallelShaper(shaper);
+    destroyShapeCache(shapeCache);
+    destroyFontCollection(fonts);
+    FT_Done_FreeType(ft);
+    return status;
+}
+
+// text [--record frames] [file]: file is shown in a scrolling view, however
+// big it is; --record writes the first frames out, as F8 does.
+// text --batch jobs: one image per line of jobs, see image_batch.h.
+int main(int argc, char **argv) {
+    if (argc > 2 && !strcmp(argv[1], "--batch")) {
+        return runBatch(argv[2]);
+    }
+    if (argc > 2 && !strcmp(argv[1], "--record")) {
+        record = atoi(argv[2]);
+        argc -= 2;
+        argv += 2;
+    }
     GLFWwindow *window = initWindow();
-    initGL();
+    initGL(window);
     initHB();
 
     HBText text0 = {
@@ -384,50 +535,256 @@ int main() {
             1.2f
     };
 
-    auto a1 = renderText(text1, 30, 20, WINDOW_HEIGHT - 50);
-    auto a2 = renderText(text2, 40, 20, WINDOW_HEIGHT - 200);
-    auto a3 = renderText(text3, 50, 20, WINDOW_HEIGHT - 350);
-    auto a4 = renderText(text0, 30, 20, WINDOW_HEIGHT - 450, 1.2f);
-
-    while (!glfwWindowShouldClose(window)) {
-        processInput(window);
-
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        float timeValue = glfwGetTime();
-        float value = sin(timeValue);
-        glUseProgram(program);
-        glActiveTexture(GL_TEXTURE0);
+    HBText text4 = {
+            "SDF 缩放 Zoom",
+            "zh",
+            HB_SCRIPT_HAN,
+            HB_DIRECTION_LTR
+    };
 
-        glUniform3f(glGetUniformLocation(program, "textColor"), 0, 1.0, value);
-        drawText(a1);
+    HBText text5 = {
+            "Lines wrap at break opportunities, 中文在字与字之间换行。",
+            "zh",
+            HB_SCRIPT_HAN,
+            HB_DIRECTION_LTR
+    };
 
-        glUniform3f(glGetUniformLocation(program, "textColor"), 0, value, value);
-        drawText(a2);
+    // the scene's atlases live as long as the window, and go with the arena
+    Arena *sceneArena = createArena();
+    auto a1 = renderText(sceneArena, textSpan(text1), 30, 20, WINDOW_HEIGHT - 50);
+    auto a2 = renderText(sceneArena, textSpan(text2), 40, 20, WINDOW_HEIGHT - 200);
+    auto a3 = renderText(sceneArena, textSpan(text3), 50, 20, WINDOW_HEIGHT - 350);
+    auto a4 = renderText(sceneArena, textSpan(text0), 30, 20, WINDOW_HEIGHT - 450, 1.2f);
+    auto a5 = renderText(sceneArena, textSpan(text4), 40, 20, 40, 1.0f, GLYPH_SDF);
+    auto a6 = renderText(sceneArena, textSpan(text5), 18, 540, WINDOW_HEIGHT - 40, 1.2f, GLYPH_BITMAP, 220);
+
+    TextBatch *batch = createTextBatch(batchProgram);
+    int r1 = addTextRun(batch, a1, 0, 1.0, 0);
+    int r2 = addTextRun(batch, a2, 0, 0, 0);
+    int r3 = addTextRun(batch, a3, 0.5, 0, 0);
+    int r4 = addTextRun(batch, a4, 0, 0, 0);
+    addTextRun(batch, a6, 0.3, 0.3, 0.3);
+    // distance field text keeps its edges while zooming, without new glyphs
+    TextBatch *sdfBatch = createTextBatch(sdfProgram);
+    int r5 = addTextRun(sdfBatch, a5, 0.2, 0.2, 0.8);
+    InstancedText *instances = createInstancedText(instancedProgram, glyphCache, STREAM_SIZE);
+    // outlines straight to the GPU: zooming and turning never rasterize a glyph
+    CurveText *curves = createCurveText(curveProgram, STREAM_SIZE);
+    // typing goes here; edits reshape and re-upload only the line they touch
+    HBText note = {
+            "✎ 输入 Type here 👇: ",
+            "zh",
+            HB_SCRIPT_HAN,
+            HB_DIRECTION_LTR
+    };
+    document = createTextDocument(instancedProgram, glyphCache, note, fonts, 20, 1.2f);
+    document->x = 420;
+    document->y = 200;
+    document->top = 210;
+    document->bottom = 110;
+    document->color[2] = 160;
+    cursorColumn = document->paragraphs[0]->length;
+    if (argc > 1) {
+        HBText style = {"", "en", HB_SCRIPT_LATIN, HB_DIRECTION_LTR};
+        fileView = openTextView(argv[1], instancedProgram, glyphCache, style, fonts, 12);
+        if (fileView) {
+            fileView->x = 620;
+            fileView->y = 470;
+            fileView->top = 480;
+            fileView->bottom = 280;
+            fileView->color[0] = 120;
+        } else {
+            std::cout << "ERROR::VIEW: Failed to open " << argv[1] << std::endl;
+        }
+    }
+    Atlas *scene[] = {a1, a2, a3, a4, a6};
+
+    // what can change once drawn, in boxes that hold every pixel of it
+    int pixelWidth, pixelHeight;
+    glfwGetFramebufferSize(window, &pixelWidth, &pixelHeight);
+    damage = createDamageTracker(WINDOW_WIDTH, WINDOW_HEIGHT, pixelWidth, pixelHeight);
+    int animated[] = {addDamageObject(damage, atlasBounds(a1)), addDamageObject(damage, atlasBounds(a2)),
+                      addDamageObject(damage, atlasBounds(a3)), addDamageObject(damage, atlasBounds(a4))};
+    int zoomObject = addDamageObject(damage, atlasBounds(a5));
+    documentObject = addDamageObject(damage, linesBounds(document->x, document->top, document->bottom,
+                                                         document->size));
+    if (fileView) {
+        viewObject = addDamageObject(damage, linesBounds(fileView->x, fileView->top, fileView->bottom,
+                                                         fileView->size));
+    }
+#ifdef TEXT_PROFILE
+    // the box refreshHud() puts it in
+    hudObject = addDamageObject(damage, linesBounds(620, 270, 10, 12));
+#endif
 
-        glUniform3f(glGetUniformLocation(program, "textColor"), 0.5, 0, value);
-        drawText(a3);
+    float value = 0;
+    while (!glfwWindowShouldClose(window)) {
+        processInput(window);
+        if (!damage->pixelWidth || !damage->pixelHeight) {
+            // minimized, nothing to draw to until it is back
+            glfwWaitEvents();
+            continue;
+        }
 
-        glUniform3f(glGetUniformLocation(program, "textColor"), 0, 0, value);
-        drawText(a4);
+        // glyphs still rasterizing are skipped, text fills in as they land
+        if (uploadRasterizedGlyphs(glyphCache)) {
+            damageAll(damage);
+        }
+        if (animate) {
+            float timeValue = glfwGetTime();
+            value = sin(timeValue);
+            for (int object : animated) {
+                damageObject(damage, object);
+            }
+        }
+        // zooms about the label's origin; curves turn it as well
+        float zoom = 1.5f + value;
+        float angle = drawMode == DRAW_CURVES ? 0.2f * value : 0.0f;
+        float za = zoom * cos(angle), zb = zoom * sin(angle);
+        float ztx = 20 - (za * 20 - zb * 40), zty = 40 - (zb * 20 + za * 40);
+        DamageRect zoomBounds = atlasBounds(a5);
+        if (drawMode == DRAW_BATCH || drawMode == DRAW_CURVES) {
+            zoomBounds = transformRect(zoomBounds, za, zb, -zb, za, ztx, zty);
+        }
+        moveDamageObject(damage, zoomObject, zoomBounds);
+#ifdef TEXT_PROFILE
+        static int hudFrames = 0;
+        if (showHud) {
+            if (!hud || ++hudFrames == HUD_REFRESH_FRAMES) {
+                hudFrames = 0;
+                refreshHud();
+            }
+            // it shows frame times, so frames keep coming while it is up
+            damageObject(damage, hudObject);
+        }
+#endif
+
+        // every damaged box is cleared and drawn again with what touches it
+        const std::vector<DamageRect> &rects = collectDamage(damage);
+        for (const DamageRect &rect : rects) {
+            beginDamage(damage, rect);
+            if (drawMode == DRAW_IMMEDIATE) {
+                drawScene(glRenderer, scene, value);
+            } else if (drawMode == DRAW_INSTANCED) {
+                appendInstances(instances, a1, glyphCache, 0, 1.0, value);
+                appendInstances(instances, a2, glyphCache, 0, value, value);
+                appendInstances(instances, a3, glyphCache, 0.5, 0, value);
+                appendInstances(instances, a4, glyphCache, 0, 0, value);
+                appendInstances(instances, a5, glyphCache, 0.2, 0.2, 0.8);
+                appendInstances(instances, a6, glyphCache, 0.3, 0.3, 0.3);
+                drawInstancedText(instances, glyphCache);
+            } else if (drawMode == DRAW_CURVES) {
+                appendCurveInstances(curves, &a1->run, a1->size, 0, 1.0, value);
+                appendCurveInstances(curves, &a2->run, a2->size, 0, value, value);
+                appendCurveInstances(curves, &a3->run, a3->size, 0.5, 0, value);
+                appendCurveInstances(curves, &a4->run, a4->size, 0, 0, value);
+                appendCurveInstances(curves, &a6->run, a6->size, 0.3, 0.3, 0.3);
+                setCurveTextTransform(curves, 1, 0, 0, 1, 0, 0);
+                drawCurveText(curves);
+                appendCurveInstances(curves, &a5->run, a5->size, 0.2, 0.2, 0.8);
+                setCurveTextTransform(curves, za, zb, -zb, za, ztx, zty);
+                drawCurveText(curves);
+            } else {
+                setTextRunColor(batch, r1, 0, 1.0, value);
+                setTextRunColor(batch, r2, 0, value, value);
+                setTextRunColor(batch, r3, 0.5, 0, value);
+                setTextRunColor(batch, r4, 0, 0, value);
+                drawTextBatch(batch, glyphCache);
+                setTextRunTransform(sdfBatch, r5, za, zb, -zb, za, ztx, zty);
+                drawTextBatch(sdfBatch, glyphCache);
+            }
+            if (isObjectInRect(damage, documentObject, rect)) {
+                drawTextDocument(document, glyphCache, shapeCache);
+            }
+            if (fileView && isObjectInRect(damage, viewObject, rect)) {
+                drawTextView(fileView, glyphCache, shapeCache);
+            }
+#ifdef TEXT_PROFILE
+            if (showHud && isObjectInRect(damage, hudObject, rect)) {
+                drawTextDocument(hud, glyphCache, shapeCache);
+            }
+#endif
+        }
 
         glUseProgram(0);
 
+        if (cpuShot) {
+            cpuShot = 0;
+            CPURenderer *cpu = createCPURenderer(glyphCache, WINDOW_WIDTH, WINDOW_HEIGHT, PIXEL_RGBA);
+            cpu->clear(1, 1, 1);
+            drawScene(cpu, scene, value);
+            saveCPURenderer(cpu, "screenshot_cpu.png");
+            destroyRenderer(cpu);
+        }
+        int framebufferWidth, framebufferHeight;
+        glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+        if (record) {
+            recordFrames(frameCapture, RECORD_PATTERN, record);
+            record = 0;
+        }
+        if (rects.empty() && !shot && frameCapture->recordLeft == 0) {
+            // nothing changed: no frame, just readbacks to finish, then sleep until there is input,
+            // or only briefly while glyphs or readbacks are still on their way
+            updateFrameCapture(frameCapture, framebufferWidth, framebufferHeight);
+            bool busy = glyphCache->inFlight > 0 || isFrameCaptureBusy(frameCapture);
+            glfwWaitEventsTimeout(busy ? BUSY_WAIT : IDLE_WAIT);
+            continue;
+        }
+        presentDamage(damage);
+        updateFrameCapture(frameCapture, framebufferWidth, framebufferHeight);
         if (shot) {
             shot = 0;
-            saveScreenShot(window, "screenshot.bmp");
+            // read back without waiting, written out by the encoder a few frames later
+            captureFrame(frameCapture, framebufferWidth, framebufferHeight, "screenshot.bmp");
         }
-        glfwSwapBuffers(window);
+        {
+            PROFILE_SCOPE("swap");
+            glfwSwapBuffers(window);
+        }
+        PROFILE_FRAME();
         glfwPollEvents();
     }
-    destroyAtlas(a1);
-    destroyAtlas(a2);
-    destroyAtlas(a3);
-    glDeleteVertexArrays(1, &VAO);
-    glDeleteBuffers(1, &VBO);
-    glDeleteBuffers(1, &IBO);
+    destroyTextBatch(batch);
+    destroyTextBatch(sdfBatch);
+    destroyInstancedText(instances);
+    destroyCurveText(curves);
+    destroyTextDocument(document);
+    document = nullptr;
+#ifdef TEXT_PROFILE
+    if (hud) {
+        destroyTextDocument(hud);
+        hud = nullptr;
+    }
+    if (saveProfileTrace(PROFILE_TRACE_FILE)) {
+        std::cout << "profile: trace written to " << PROFILE_TRACE_FILE << std::endl;
+    }
+#endif
+    if (fileView) {
+        closeTextView(fileView);
+        fileView = nullptr;
+    }
+    destroyArena(sceneArena);
+    if (frameCapture->recorded || frameCapture->dropped) {
+        std::cout << "capture: " << frameCapture->recorded << " frames recorded, " << frameCapture->dropped
+                  << " dropped" << std::endl;
+    }
+    destroyFrameCapture(frameCapture);
+    destroyDamageTracker(damage);
+    damage = nullptr;
+    saveGlyphCache(glyphCache, GLYPH_CACHE_FILE);
+    destroyGlyphCache(glyphCache);
+    destroyThreadPool(threadPool);
+    destroyRenderer(glRenderer);
+    destroyStreamBuffer(vertexStream);
     glDeleteProgram(program);
-    FT_Done_Face(face);
-    hb_font_destroy(hb_font);
+    glDeleteProgram(batchProgram);
+    glDeleteProgram(instancedProgram);
+    glDeleteProgram(sdfProgram);
+    glDeleteProgram(curveProgram);
+    destroyParallelShaper(shaper);
+    destroyShapeCache(shapeCache);
+    destroyFontCollection(fonts);
+    FT_Done_FreeType(ft);
     glfwTerminate();
     return 0;
 }
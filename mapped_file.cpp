@@ -0,0 +1,92 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+MappedFile *mapFile(const char *path) {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return nullptr;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    auto mapped = new MappedFile;
+    mapped->file = file;
+    mapped->mapping = nullptr;
+    mapped->data = nullptr;
+    mapped->size = (size_t) size.QuadPart;
+    if (mapped->size) {
+        mapped->mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapped->mapping) {
+            mapped->data = (const char *) MapViewOfFile(mapped->mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+        if (!mapped->data) {
+            unmapFile(mapped);
+            return nullptr;
+        }
+    }
+    return mapped;
+}
+
+void unmapFile(MappedFile *file) {
+    if (file->data) {
+        UnmapViewOfFile(file->data);
+    }
+    if (file->mapping) {
+        CloseHandle(file->mapping);
+    }
+    CloseHandle(file->file);
+    delete file;
+}
+
+#else
+
+MappedFile *mapFile(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    auto mapped = new MappedFile;
+    mapped->fd = fd;
+    mapped->data = nullptr;
+    mapped->size = (size_t) st.st_size;
+    if (mapped->size) {
+        void *data = mmap(nullptr, mapped->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            mapped->size = 0;
+            unmapFile(mapped);
+            return nullptr;
+        }
+        mapped->data = (const char *) data;
+    }
+    return mapped;
+}
+
+void unmapFile(MappedFile *file) {
+    if (file->data) {
+        munmap((void *) file->data, file->size);
+    }
+    close(file->fd);
+    delete file;
+}
+
+#endif
@@ -0,0 +1,29 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+
+/*
+ * A file mapped read-only into memory. Pages are read in by the OS on first
+ * touch, so mapping costs the same for any file size.
+ */
+struct MappedFile {
+    const char *data;
+    size_t size;
+#ifdef _WIN32
+    void *file;
+    void *mapping;
+#else
+    int fd;
+#endif
+};
+
+// nullptr when the file can not be opened or mapped. Empty files map to a
+// null data pointer and size 0.
+MappedFile *mapFile(const char *path);
+
+void unmapFile(MappedFile *file);
+
+#endif
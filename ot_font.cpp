@@ -0,0 +1,154 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <climits>
+#include "hb-ot.h"
+#include "ot_font.h"
+
+static const hb_position_t OT_FONT_UNKNOWN = INT_MIN;
+
+static void destroyMetricsCache(void *data) {
+    delete (MetricsCache *) data;
+}
+
+// The metrics of the font's scale, made or recycled the first time it is asked for.
+static GlyphMetrics *metricsOf(MetricsCache *cache, hb_font_t *font) {
+    int x, y;
+    hb_font_get_scale(font, &x, &y);
+    GlyphMetrics *metrics = cache->current;
+    if (metrics && metrics->xScale == x && metrics->yScale == y) {
+        return metrics;
+    }
+    metrics = nullptr;
+    for (auto &size : cache->sizes) {
+        if (size.xScale == x && size.yScale == y) {
+            metrics = &size;
+        }
+    }
+    if (!metrics) {
+        if ((int) cache->sizes.size() < OT_FONT_SIZES) {
+            cache->sizes.emplace_back();
+            metrics = &cache->sizes.back();
+        } else {
+            metrics = &cache->sizes[0];
+            for (auto &size : cache->sizes) {
+                metrics = size.used < metrics->used ? &size : metrics;
+            }
+        }
+        metrics->xScale = x;
+        metrics->yScale = y;
+        // arrays are sized when first used: most text never asks for vertical metrics or extents
+        metrics->hAdvances.clear();
+        metrics->vAdvances.clear();
+        metrics->extents.clear();
+        metrics->extentsState.clear();
+    }
+    metrics->used = ++cache->clock;
+    cache->current = metrics;
+    return metrics;
+}
+
+// HarfBuzz's own scaling from the parent's units, truncated the same way.
+static hb_position_t scaleDistance(hb_position_t v, int scale, unsigned int upem) {
+    return (hb_position_t) (v * (long long) scale / (long long) upem);
+}
+
+static hb_position_t lookupAdvance(MetricsCache *cache, std::vector<hb_position_t> &advances, hb_font_t *font,
+                                   hb_codepoint_t glyph, bool vertical, int scale) {
+    if (glyph >= cache->glyphCount) {
+        return 0;
+    }
+    if (advances.empty()) {
+        advances.assign(cache->glyphCount, OT_FONT_UNKNOWN);
+    }
+    hb_position_t &advance = advances[glyph];
+    if (advance == OT_FONT_UNKNOWN) {
+        hb_font_t *parent = hb_font_get_parent(font);
+        hb_position_t v = vertical ? hb_font_get_glyph_v_advance(parent, glyph)
+                                   : hb_font_get_glyph_h_advance(parent, glyph);
+        advance = scaleDistance(v, scale, cache->upem);
+    }
+    return advance;
+}
+
+static hb_position_t getHAdvance(hb_font_t *font, void *data, hb_codepoint_t glyph, void *) {
+    auto cache = (MetricsCache *) data;
+    GlyphMetrics *metrics = metricsOf(cache, font);
+    return lookupAdvance(cache, metrics->hAdvances, font, glyph, false, metrics->xScale);
+}
+
+// What hb_shape() calls: the whole buffer at once, so the scale is looked up once.
+static void getHAdvances(hb_font_t *font, void *data, unsigned int count, hb_codepoint_t *glyphs,
+                         unsigned int glyphStride, hb_position_t *advances, unsigned int advanceStride, void *) {
+    auto cache = (MetricsCache *) data;
+    GlyphMetrics *metrics = metricsOf(cache, font);
+    for (unsigned int i = 0; i < count; ++i) {
+        *advances = lookupAdvance(cache, metrics->hAdvances, font, *glyphs, false, metrics->xScale);
+        glyphs = (hb_codepoint_t *) ((char *) glyphs + glyphStride);
+        advances = (hb_position_t *) ((char *) advances + advanceStride);
+    }
+}
+
+static hb_position_t getVAdvance(hb_font_t *font, void *data, hb_codepoint_t glyph, void *) {
+    auto cache = (MetricsCache *) data;
+    GlyphMetrics *metrics = metricsOf(cache, font);
+    return lookupAdvance(cache, metrics->vAdvances, font, glyph, true, metrics->yScale);
+}
+
+static hb_bool_t getExtents(hb_font_t *font, void *data, hb_codepoint_t glyph, hb_glyph_extents_t *extents,
+                            void *) {
+    auto cache = (MetricsCache *) data;
+    if (glyph >= cache->glyphCount) {
+        return false;
+    }
+    GlyphMetrics *metrics = metricsOf(cache, font);
+    if (metrics->extents.empty()) {
+        metrics->extents.resize(cache->glyphCount);
+        metrics->extentsState.assign(cache->glyphCount, 0);
+    }
+    unsigned char &state = metrics->extentsState[glyph];
+    hb_glyph_extents_t &cached = metrics->extents[glyph];
+    if (!state) {
+        hb_glyph_extents_t e;
+        state = 2;
+        if (hb_font_get_glyph_extents(hb_font_get_parent(font), glyph, &e)) {
+            cached.x_bearing = scaleDistance(e.x_bearing, metrics->xScale, cache->upem);
+            cached.y_bearing = scaleDistance(e.y_bearing, metrics->yScale, cache->upem);
+            cached.width = scaleDistance(e.width, metrics->xScale, cache->upem);
+            cached.height = scaleDistance(e.height, metrics->yScale, cache->upem);
+            state = 1;
+        }
+    }
+    *extents = cached;
+    return state == 1;
+}
+
+static hb_font_funcs_t *createMetricsFuncs() {
+    hb_font_funcs_t *funcs = hb_font_funcs_create();
+    hb_font_funcs_set_glyph_h_advance_func(funcs, getHAdvance, nullptr, nullptr);
+    hb_font_funcs_set_glyph_h_advances_func(funcs, getHAdvances, nullptr, nullptr);
+    hb_font_funcs_set_glyph_v_advance_func(funcs, getVAdvance, nullptr, nullptr);
+    hb_font_funcs_set_glyph_extents_func(funcs, getExtents, nullptr, nullptr);
+    hb_font_funcs_make_immutable(funcs);
+    return funcs;
+}
+
+hb_font_t *createOTFont(const char *data, size_t size, long index) {
+    static hb_font_funcs_t *funcs = createMetricsFuncs();
+    hb_blob_t *blob = hb_blob_create(data, (unsigned int) size, HB_MEMORY_MODE_READONLY, nullptr, nullptr);
+    hb_face_t *face = hb_face_create(blob, (unsigned int) index);
+    hb_blob_destroy(blob);
+    // the parent stays at its default scale, the font's units
+    hb_font_t *parent = hb_font_create(face);
+    hb_ot_font_set_funcs(parent);
+    auto cache = new MetricsCache;
+    cache->glyphCount = hb_face_get_glyph_count(face);
+    cache->upem = hb_face_get_upem(face);
+    cache->clock = 0;
+    cache->current = nullptr;
+    cache->sizes.reserve(OT_FONT_SIZES);
+    hb_face_destroy(face);
+    hb_font_t *font = hb_font_create_sub_font(parent);
+    hb_font_destroy(parent);
+    hb_font_set_funcs(font, funcs, cache, destroyMetricsCache);
+    return font;
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef OT_FONT_H
+#define OT_FONT_H
+
+#include <cstddef>
+#include <vector>
+#include <hb.h>
+
+// Sizes a font keeps metrics for; the least recently used one makes room.
+static const int OT_FONT_SIZES = 8;
+
+// What one scale of a font was asked for, indexed by glyph id.
+struct GlyphMetrics {
+    int xScale;
+    int yScale;
+    unsigned long used;
+    std::vector<hb_position_t> hAdvances;   // INT_MIN until asked
+    std::vector<hb_position_t> vAdvances;
+    std::vector<hb_glyph_extents_t> extents;
+    std::vector<unsigned char> extentsState; // 0 not asked, 1 known, 2 the glyph has none
+};
+
+struct MetricsCache {
+    unsigned int glyphCount;
+    unsigned int upem;
+    unsigned long clock;
+    std::vector<GlyphMetrics> sizes;
+    GlyphMetrics *current;                  // the scale asked for last
+};
+
+/*
+ * hb_font_t that shapes without FreeType. HarfBuzz's OT functions read cmap,
+ * hmtx, vmtx and glyf straight from the font's bytes, unscaled, in a parent
+ * font; the returned font on top of it keeps every advance and extents
+ * HarfBuzz asks for in arrays indexed by glyph id, one set per size, so the
+ * glyphs of long text cost a load after their first use. Other queries go
+ * to the parent. The metrics are not locked: a font belongs to one thread,
+ * as an FT_Face does, while data can be shared by any number of them.
+ *
+ * data has to outlive the font; scale it with hb_font_set_scale() and free
+ * it with hb_font_destroy().
+ */
+hb_font_t *createOTFont(const char *data, size_t size, long index);
+
+#endif
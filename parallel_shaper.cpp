@@ -0,0 +1,169 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <atomic>
+#include "parallel_shaper.h"
+#include "profiler.h"
+
+// Pieces are cut at the first newline past this many bytes: small enough to
+// spread 1 MB over dozens of threads, big enough that handing them out is free.
+static const size_t PIECE_BYTES = 4096;
+
+// Gives every worker the faces added to the collection since it last looked.
+static void shareNewFaces(ParallelShaper *shaper) {
+    const FontCollection *fonts = shaper->fonts;
+    for (auto &worker : shaper->workers) {
+        for (size_t i = worker.fonts->faces.size(); i < fonts->faces.size(); ++i) {
+            if (shareFontFace(worker.fonts, fonts->faces[i]) < 0) {
+                break;
+            }
+        }
+    }
+}
+
+ParallelShaper *createParallelShaper(FontCollection *fonts, ThreadPool *pool, size_t cacheCapacity) {
+    auto shaper = new ParallelShaper;
+    shaper->fonts = fonts;
+    shaper->pool = pool;
+    int threads = pool ? (int) pool->threads.size() : 0;
+    for (int i = 0; i < threads; ++i) {
+        ShapeWorker worker;
+        // a library of its own, as the glyph cache's raster threads have
+        if (FT_Init_FreeType(&worker.library)) {
+            break;
+        }
+        worker.fonts = createFontCollection(worker.library);
+        worker.cache = createShapeCache(cacheCapacity);
+        shaper->workers.push_back(worker);
+    }
+    shareNewFaces(shaper);
+    return shaper;
+}
+
+void destroyParallelShaper(ParallelShaper *shaper) {
+    for (auto &worker : shaper->workers) {
+        destroyShapeCache(worker.cache);
+        destroyFontCollection(worker.fonts);
+        FT_Done_FreeType(worker.library);
+    }
+    delete shaper;
+}
+
+static FT_Face sourceFace(const ParallelShaper *shaper, const FontCollection *fonts, FT_Face face) {
+    for (size_t i = 0; i < fonts->faces.size(); ++i) {
+        if (fonts->faces[i].face == face) {
+            return shaper->fonts->faces[i].face;
+        }
+    }
+    return shaper->fonts->faces[0].face;
+}
+
+// What lane shapes with: the caller's fonts and cache for lane 0, a worker's
+// for the others. False when the worker could not open every face.
+static bool laneShaper(ParallelShaper *shaper, ShapeCache *cache, int lane, FontCollection **fonts,
+                       ShapeCache **laneCache) {
+    *fonts = shaper->fonts;
+    *laneCache = cache;
+    if (lane > 0) {
+        ShapeWorker &worker = shaper->workers[lane - 1];
+        if (worker.fonts->faces.size() != shaper->fonts->faces.size()) {
+            return false;
+        }
+        *fonts = worker.fonts;
+        *laneCache = worker.cache;
+    }
+    return true;
+}
+
+// Points the faces a worker shaped with back at the same faces of shaper->fonts.
+static void mapFaces(const ParallelShaper *shaper, const FontCollection *fonts, std::vector<FaceRun> &faces) {
+    if (fonts != shaper->fonts) {
+        for (auto &run : faces) {
+            run.face = sourceFace(shaper, fonts, run.face);
+        }
+    }
+}
+
+void shapeParallel(ParallelShaper *shaper, ShapeCache *cache, unsigned int size, const TextSpan &text,
+                   std::vector<hb_glyph_info_t> &infos, std::vector<hb_glyph_position_t> &positions,
+                   std::vector<FaceRun> &faces) {
+    FontCollection *fonts = shaper->fonts;
+    std::vector<size_t> &ends = shaper->ends;
+    splitParagraphs(fonts, text.data, text.length, PIECE_BYTES, ends);
+    int count = (int) ends.size();
+    if (count == 1 || shaper->workers.empty()) {
+        shapeFontRuns(fonts, cache, size, text, infos, positions, faces);
+        return;
+    }
+    shareNewFaces(shaper);
+
+    std::vector<ShapePiece> &pieces = shaper->pieces;
+    if ((int) pieces.size() < count) {
+        pieces.resize(count);
+    }
+    for (int i = 0; i < count; ++i) {
+        pieces[i].start = i ? ends[i - 1] : 0;
+        pieces[i].end = ends[i];
+    }
+    // a lane per thread that can shape, each pulling the next piece until none are left
+    std::atomic<int> next(0);
+    parallelFor(shaper->pool, (int) shaper->workers.size() + 1, [&](int lane) {
+        FontCollection *laneFonts;
+        ShapeCache *laneCache;
+        if (!laneShaper(shaper, cache, lane, &laneFonts, &laneCache)) {
+            // a face could not be opened again; the other lanes take its share
+            return;
+        }
+        for (int i = next++; i < count; i = next++) {
+            ShapePiece &piece = pieces[i];
+            shapeFontRuns(laneFonts, laneCache, size, sliceText(text, piece.start, piece.end), piece.infos,
+                          piece.positions, piece.faces);
+            mapFaces(shaper, laneFonts, piece.faces);
+        }
+    });
+
+    PROFILE_SCOPE("shape_merge");
+    infos.clear();
+    positions.clear();
+    faces.clear();
+    // backward pieces come out in visual order, so they are joined last to first
+    bool backward = HB_DIRECTION_IS_BACKWARD(text.direction);
+    for (int k = 0; k < count; ++k) {
+        const ShapePiece &piece = pieces[backward ? count - 1 - k : k];
+        int base = (int) infos.size();
+        for (size_t f = 0; f < piece.faces.size(); ++f) {
+            int end = f + 1 < piece.faces.size() ? piece.faces[f + 1].first : (int) piece.infos.size();
+            // a face going on across the cut is one run, as in the whole text
+            if (piece.faces[f].first < end && (faces.empty() || faces.back().face != piece.faces[f].face)) {
+                faces.push_back({base + piece.faces[f].first, piece.faces[f].face});
+            }
+        }
+        for (auto info : piece.infos) {
+            info.cluster += (unsigned int) piece.start;
+            infos.push_back(info);
+        }
+        positions.insert(positions.end(), piece.positions.begin(), piece.positions.end());
+    }
+    if (faces.empty()) {
+        faces.push_back({0, fonts->faces[0].face});
+    }
+}
+
+void shapeBatch(ParallelShaper *shaper, ShapeCache *cache, const TextSpan *texts, const unsigned int *sizes,
+                int count, ShapePiece *pieces) {
+    shareNewFaces(shaper);
+    std::atomic<int> next(0);
+    parallelFor(shaper->pool, (int) shaper->workers.size() + 1, [&](int lane) {
+        FontCollection *laneFonts;
+        ShapeCache *laneCache;
+        if (!laneShaper(shaper, cache, lane, &laneFonts, &laneCache)) {
+            return;
+        }
+        for (int i = next++; i < count; i = next++) {
+            ShapePiece &piece = pieces[i];
+            piece.start = 0;
+            piece.end = texts[i].length;
+            shapeFontRuns(laneFonts, laneCache, sizes[i], texts[i], piece.infos, piece.positions, piece.faces);
+            mapFaces(shaper, laneFonts, piece.faces);
+        }
+    });
+}
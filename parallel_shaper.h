@@ -0,0 +1,69 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef PARALLEL_SHAPER_H
+#define PARALLEL_SHAPER_H
+
+#include <vector>
+#include <hb.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "font_collection.h"
+#include "shape_cache.h"
+#include "text.h"
+#include "text_layout.h"
+#include "thread_pool.h"
+
+// A piece of the text and its glyphs, clusters still relative to start.
+struct ShapePiece {
+    size_t start;
+    size_t end;
+    std::vector<hb_glyph_info_t> infos;
+    std::vector<hb_glyph_position_t> positions;
+    std::vector<FaceRun> faces;         // already mapped to the faces of ParallelShaper::fonts
+};
+
+// What a pool thread shapes with: a font's cached metrics, like its FT_Face,
+// are only for one thread at a time.
+struct ShapeWorker {
+    FT_Library library;
+    FontCollection *fonts;              // shares the mapped files of ParallelShaper::fonts
+    ShapeCache *cache;
+};
+
+/*
+ * Shapes long text on every core. The text is cut after newlines into
+ * pieces that shape on their own exactly as inside the whole, the pieces are
+ * handed out one at a time to the calling thread and the pool's threads, and
+ * the glyphs are joined in text order, so the result is the same as
+ * shapeFontRuns() over the whole text, whatever thread shaped what.
+ */
+struct ParallelShaper {
+    FontCollection *fonts;              // not owned, shaped with on the calling thread
+    ThreadPool *pool;                   // not owned, null shapes everything on the caller
+    std::vector<ShapeWorker> workers;   // one per pool thread
+    std::vector<size_t> ends;
+    std::vector<ShapePiece> pieces;
+};
+
+// Workers get shape caches of cacheCapacity words each.
+ParallelShaper *createParallelShaper(FontCollection *fonts, ThreadPool *pool, size_t cacheCapacity);
+
+void destroyParallelShaper(ParallelShaper *shaper);
+
+/*
+ * shapeFontRuns() on shaper->fonts, with cache for the calling thread's
+ * share. Text shorter than a piece never leaves the calling thread.
+ */
+void shapeParallel(ParallelShaper *shaper, ShapeCache *cache, unsigned int size, const TextSpan &text,
+                   std::vector<hb_glyph_info_t> &infos, std::vector<hb_glyph_position_t> &positions,
+                   std::vector<FaceRun> &faces);
+
+/*
+ * Shapes count texts of their own, each whole on one thread, for many short
+ * labels rather than one long text. pieces[i] gets texts[i] at sizes[i],
+ * with faces of shaper->fonts, as shapeFontRuns() would give it.
+ */
+void shapeBatch(ParallelShaper *shaper, ShapeCache *cache, const TextSpan *texts, const unsigned int *sizes,
+                int count, ShapePiece *pieces);
+
+#endif
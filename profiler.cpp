@@ -0,0 +1,308 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include "profiler.h"
+
+#ifdef TEXT_PROFILE
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include <glad/glad.h>
+
+static const int MAX_STAGES = 64;
+static const int MAX_COUNTERS = 32;
+static const size_t MAX_EVENTS = 1 << 20;       // about 32 MB, the oldest are overwritten
+static const int QUERY_FRAMES = 2;              // sets of queries in flight
+static const int MAX_FRAME_QUERIES = 128;
+static const double AVERAGE_WEIGHT = 1.0 / 16;  // of the newest frame in the moving averages
+static const int GPU_TRACK = 1000;              // trace thread the query results go to
+
+enum EventKind {
+    EVENT_CPU,
+    EVENT_GPU,
+    EVENT_COUNTER
+};
+
+struct ProfileEvent {
+    EventKind kind;
+    int id;                         // stage, or counter for EVENT_COUNTER
+    int thread;
+    unsigned long long start;       // ns
+    long long value;                // duration in ns, or the counter sample
+};
+
+struct StageStats {
+    const char *name;
+    unsigned long long cpu;         // ns spent in this frame so far
+    unsigned long long gpu;         // ns of the queries read back this frame
+    bool timed;                     // ever had a query
+    double cpuAverage;              // ms per frame
+    double gpuAverage;
+};
+
+struct CounterStats {
+    const char *name;
+    std::atomic<long long> value;   // since the last frame
+    double average;
+};
+
+struct QueryFrame {
+    std::vector<GLuint> queries;
+    std::vector<int> stages;
+    std::vector<unsigned long long> starts;
+    int used;
+};
+
+struct Profiler {
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+    StageStats stages[MAX_STAGES];
+    int stageCount = 0;
+    CounterStats counters[MAX_COUNTERS];
+    std::atomic<int> counterCount{0};
+    std::vector<ProfileEvent> events;
+    size_t recorded = 0;            // events ever recorded, events is a ring once full
+    int threads = 0;
+    int frameThread = 0;
+    QueryFrame frames[QUERY_FRAMES] = {};
+    int frame = 0;
+    bool querying = false;
+    unsigned long long lastFrame = 0;
+    double frameAverage = 0;
+};
+
+static Profiler &profiler() {
+    static Profiler p;
+    return p;
+}
+
+static int currentThread(Profiler &p) {
+    static thread_local int thread = 0;
+    if (!thread) {
+        thread = ++p.threads;
+    }
+    return thread;
+}
+
+// Called with the mutex held.
+static void pushEvent(Profiler &p, const ProfileEvent &event) {
+    if (p.events.size() < MAX_EVENTS) {
+        p.events.push_back(event);
+    } else {
+        p.events[p.recorded % MAX_EVENTS] = event;
+    }
+    p.recorded++;
+}
+
+int profileStage(const char *name) {
+    Profiler &p = profiler();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    for (int i = 0; i < p.stageCount; ++i) {
+        if (!strcmp(p.stages[i].name, name)) {
+            return i;
+        }
+    }
+    if (p.stageCount == MAX_STAGES) {
+        return -1;
+    }
+    p.stages[p.stageCount] = {name, 0, 0, false, 0, 0};
+    return p.stageCount++;
+}
+
+int profileCounter(const char *name) {
+    Profiler &p = profiler();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    int count = p.counterCount;
+    for (int i = 0; i < count; ++i) {
+        if (!strcmp(p.counters[i].name, name)) {
+            return i;
+        }
+    }
+    if (count == MAX_COUNTERS) {
+        return -1;
+    }
+    p.counters[count].name = name;
+    p.counters[count].value = 0;
+    p.counters[count].average = 0;
+    p.counterCount = count + 1;
+    return count;
+}
+
+unsigned long long profileNow() {
+    auto elapsed = std::chrono::steady_clock::now() - profiler().epoch;
+    return (unsigned long long) std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+}
+
+void profileRecord(int stage, unsigned long long start, unsigned long long end) {
+    if (stage < 0) {
+        return;
+    }
+    Profiler &p = profiler();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    p.stages[stage].cpu += end - start;
+    pushEvent(p, {EVENT_CPU, stage, currentThread(p), start, (long long) (end - start)});
+}
+
+void profileAdd(int counter, long long value) {
+    if (counter >= 0) {
+        profiler().counters[counter].value.fetch_add(value, std::memory_order_relaxed);
+    }
+}
+
+int beginGpuQuery(int stage, unsigned long long start) {
+    Profiler &p = profiler();
+    QueryFrame &frame = p.frames[p.frame];
+    if (stage < 0 || p.querying || frame.used == MAX_FRAME_QUERIES) {
+        return -1;
+    }
+    if (frame.used == (int) frame.queries.size()) {
+        GLuint query;
+        glGenQueries(1, &query);
+        frame.queries.push_back(query);
+        frame.stages.push_back(0);
+        frame.starts.push_back(0);
+    }
+    int query = frame.used++;
+    frame.stages[query] = stage;
+    frame.starts[query] = start;
+    glBeginQuery(GL_TIME_ELAPSED, frame.queries[query]);
+    p.querying = true;
+    return query;
+}
+
+void endGpuQuery(int query) {
+    if (query >= 0) {
+        glEndQuery(GL_TIME_ELAPSED);
+        profiler().querying = false;
+    }
+}
+
+static double toAverage(double average, double sample) {
+    return average + (sample - average) * AVERAGE_WEIGHT;
+}
+
+void endProfileFrame() {
+    Profiler &p = profiler();
+    unsigned long long now = profileNow();
+    // the set reused next was issued a whole frame ago
+    p.frame = (p.frame + 1) % QUERY_FRAMES;
+    QueryFrame &frame = p.frames[p.frame];
+
+    std::lock_guard<std::mutex> lock(p.mutex);
+    p.frameThread = currentThread(p);
+    for (int i = 0; i < frame.used; ++i) {
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &elapsed);
+        StageStats &stage = p.stages[frame.stages[i]];
+        stage.gpu += elapsed;
+        stage.timed = true;
+        pushEvent(p, {EVENT_GPU, frame.stages[i], GPU_TRACK, frame.starts[i], (long long) elapsed});
+    }
+    frame.used = 0;
+
+    for (int i = 0; i < p.stageCount; ++i) {
+        StageStats &stage = p.stages[i];
+        stage.cpuAverage = toAverage(stage.cpuAverage, stage.cpu / 1e6);
+        if (stage.timed) {
+            stage.gpuAverage = toAverage(stage.gpuAverage, stage.gpu / 1e6);
+        }
+        stage.cpu = 0;
+        stage.gpu = 0;
+    }
+    int counterCount = p.counterCount;
+    for (int i = 0; i < counterCount; ++i) {
+        long long value = p.counters[i].value.exchange(0);
+        p.counters[i].average = toAverage(p.counters[i].average, (double) value);
+        pushEvent(p, {EVENT_COUNTER, i, 0, now, value});
+    }
+    if (p.lastFrame) {
+        p.frameAverage = toAverage(p.frameAverage, (now - p.lastFrame) / 1e6);
+    }
+    p.lastFrame = now;
+}
+
+void formatProfile(std::string &out) {
+    Profiler &p = profiler();
+    std::lock_guard<std::mutex> lock(p.mutex);
+    char line[160];
+    snprintf(line, sizeof(line), "frame %.2f ms", p.frameAverage);
+    out = line;
+    for (int i = 0; i < p.stageCount; ++i) {
+        const StageStats &stage = p.stages[i];
+        if (stage.timed) {
+            snprintf(line, sizeof(line), "\n%s %.3f ms, gpu %.3f ms", stage.name, stage.cpuAverage,
+                     stage.gpuAverage);
+        } else {
+            snprintf(line, sizeof(line), "\n%s %.3f ms", stage.name, stage.cpuAverage);
+        }
+        out += line;
+    }
+    int counterCount = p.counterCount;
+    for (int i = 0; i < counterCount; ++i) {
+        snprintf(line, sizeof(line), "\n%s %.0f", p.counters[i].name, p.counters[i].average);
+        out += line;
+    }
+}
+
+bool saveProfileTrace(const char *path) {
+    Profiler &p = profiler();
+    std::vector<ProfileEvent> events;
+    std::vector<const char *> stages, counters;
+    int threads, frameThread;
+    {
+        std::lock_guard<std::mutex> lock(p.mutex);
+        size_t first = p.recorded > MAX_EVENTS ? p.recorded % MAX_EVENTS : 0;
+        events.insert(events.end(), p.events.begin() + first, p.events.end());
+        events.insert(events.end(), p.events.begin(), p.events.begin() + first);
+        for (int i = 0; i < p.stageCount; ++i) {
+            stages.push_back(p.stages[i].name);
+        }
+        for (int i = 0; i < p.counterCount; ++i) {
+            counters.push_back(p.counters[i].name);
+        }
+        threads = p.threads;
+        frameThread = p.frameThread;
+    }
+
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+    fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}",
+            GPU_TRACK);
+    for (int thread = 1; thread <= threads; ++thread) {
+        char name[32];
+        if (thread == frameThread) {
+            snprintf(name, sizeof(name), "main");
+        } else {
+            snprintf(name, sizeof(name), "thread %d", thread);
+        }
+        fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                thread, name);
+    }
+    // trace timestamps are in microseconds
+    for (const auto &event : events) {
+        if (event.kind == EVENT_COUNTER) {
+            fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,\"args\":{\"value\":%lld}}",
+                    counters[event.id], event.start / 1e3, event.value);
+        } else {
+            // a query only measures how long, so it is drawn from when it was submitted
+            fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,"
+                          "\"dur\":%.3f}", stages[event.id], event.kind == EVENT_GPU ? "gpu" : "cpu",
+                    event.thread, event.start / 1e3, event.value / 1e3);
+        }
+    }
+    fprintf(file, "\n]}\n");
+    return fclose(file) == 0;
+}
+
+#endif
@@ -0,0 +1,95 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+/*
+ * Frame profiler, only built with TEXT_PROFILE defined; without it every
+ * macro below expands to nothing and profiler.cpp is empty.
+ *
+ * PROFILE_SCOPE(name) times the rest of the enclosing block, on any thread.
+ * PROFILE_GPU_SCOPE(name) does the same and wraps the GL commands issued in
+ * the block in a GL_TIME_ELAPSED query. Queries can not nest, so a GPU scope
+ * inside another one only times the CPU. PROFILE_COUNT(name, n) adds to a
+ * counter that is sampled and cleared by PROFILE_FRAME(), which the GL thread
+ * calls once per frame. Names have to be string literals.
+ */
+#ifdef TEXT_PROFILE
+
+#include <string>
+
+int profileStage(const char *name);
+
+int profileCounter(const char *name);
+
+// Nanoseconds since the profiler first ran.
+unsigned long long profileNow();
+
+void profileRecord(int stage, unsigned long long start, unsigned long long end);
+
+void profileAdd(int counter, long long value);
+
+// Returns the query used, -1 when none was started.
+int beginGpuQuery(int stage, unsigned long long start);
+
+void endGpuQuery(int query);
+
+/*
+ * Closes the frame: counters become samples and queries of the frame before
+ * swap in. Those are read only if the GPU is done with them, so this never
+ * waits; a late result is dropped.
+ */
+void endProfileFrame();
+
+// One line per stage and counter, averaged over recent frames.
+void formatProfile(std::string &out);
+
+// Everything recorded so far, newest events kept, as Chrome trace-event JSON.
+bool saveProfileTrace(const char *path);
+
+struct ProfileScope {
+    int stage;
+    unsigned long long start;
+
+    explicit ProfileScope(int stage) : stage(stage), start(profileNow()) {}
+
+    ~ProfileScope() {
+        profileRecord(stage, start, profileNow());
+    }
+};
+
+struct GpuProfileScope : ProfileScope {
+    int query;
+
+    explicit GpuProfileScope(int stage) : ProfileScope(stage), query(beginGpuQuery(stage, start)) {}
+
+    ~GpuProfileScope() {
+        endGpuQuery(query);
+    }
+};
+
+#define PROFILE_JOIN2(a, b) a##b
+#define PROFILE_JOIN(a, b) PROFILE_JOIN2(a, b)
+#define PROFILE_SCOPE(name) \
+    static const int PROFILE_JOIN(profileStage, __LINE__) = profileStage(name); \
+    ProfileScope PROFILE_JOIN(profileScope, __LINE__)(PROFILE_JOIN(profileStage, __LINE__))
+#define PROFILE_GPU_SCOPE(name) \
+    static const int PROFILE_JOIN(profileStage, __LINE__) = profileStage(name); \
+    GpuProfileScope PROFILE_JOIN(profileScope, __LINE__)(PROFILE_JOIN(profileStage, __LINE__))
+#define PROFILE_COUNT(name, value) \
+    do { \
+        static const int profileId = profileCounter(name); \
+        profileAdd(profileId, (long long) (value)); \
+    } while (0)
+#define PROFILE_FRAME() endProfileFrame()
+
+#else
+
+#define PROFILE_SCOPE(name)
+#define PROFILE_GPU_SCOPE(name)
+#define PROFILE_COUNT(name, value) do {} while (0)
+#define PROFILE_FRAME() do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,11 @@
+#version 330 core
+in vec2 TexCoord;
+in vec4 TextColor;
+out vec4 color;
+
+uniform sampler2D text;
+
+void main()
+{
+    color = vec4(TextColor.rgb, TextColor.a * texture(text, TexCoord).r);
+}
\ No newline at end of file
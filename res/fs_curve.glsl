@@ -0,0 +1,88 @@
+#version 330 core
+in vec2 EmCoord;
+flat in int Glyph;
+flat in vec4 Box;
+in vec4 TextColor;
+out vec4 color;
+
+uniform samplerBuffer curves;
+uniform int bands;
+
+// Which of the two roots of a curve cross the ray, from the signs of its
+// points' distances to it: bit 0 the first, bit 1 the second.
+uint rootCode(float y1, float y2, float y3)
+{
+    int shift = (y1 > 0.0 ? 2 : 0) + (y2 > 0.0 ? 4 : 0) + (y3 > 0.0 ? 8 : 0);
+    return (0x2E74U >> shift) & 3U;
+}
+
+// x of both places the curve has y = 0, relative to the pixel.
+vec2 solveRoots(vec4 p12, vec2 p3)
+{
+    vec2 a = p12.xy - p12.zw * 2.0 + p3;
+    vec2 b = p12.xy - p12.zw;
+    float d = sqrt(max(b.y * b.y - a.y * p12.y, 0.0));
+    float t1 = (b.y - d) / a.y;
+    float t2 = (b.y + d) / a.y;
+    if (abs(a.y) < 1.0 / 65536.0) {
+        // a line in y
+        t1 = t2 = p12.y * 0.5 / b.y;
+    }
+    return vec2((a.x * t1 - b.x * 2.0) * t1 + p12.x, (a.x * t2 - b.x * 2.0) * t2 + p12.x);
+}
+
+/*
+ * Winding along a ray from the pixel towards +x through the curves of one
+ * band, each crossing counted by how much of the pixel it leaves behind it.
+ * swap casts the ray along y instead. weight is how close the nearest
+ * crossing is, as a share of the pixel.
+ */
+float rayCoverage(int band, bool swap, float pixelsPerEm, out float weight)
+{
+    vec4 header = texelFetch(curves, Glyph + 1 + band / 2);
+    vec2 entry = (band & 1) != 0 ? header.zw : header.xy;
+    int count = int(entry.x);
+    int list = int(entry.y);
+    float coverage = 0.0;
+    weight = 0.0;
+    for (int i = 0; i < count; ++i) {
+        int curve = int(texelFetch(curves, list + i / 4)[i & 3]);
+        vec4 p12 = texelFetch(curves, curve) - EmCoord.xyxy;
+        vec2 p3 = texelFetch(curves, curve + 1).xy - EmCoord;
+        if (swap) {
+            p12 = p12.yxwz;
+            p3 = p3.yx;
+        }
+        // sorted by their far end, so the rest are all behind the pixel
+        if (max(max(p12.x, p12.z), p3.x) * pixelsPerEm < -0.5) {
+            break;
+        }
+        uint code = rootCode(p12.y, p12.w, p3.y);
+        if (code != 0U) {
+            vec2 r = solveRoots(p12, p3) * pixelsPerEm;
+            if ((code & 1U) != 0U) {
+                coverage += clamp(r.x + 0.5, 0.0, 1.0);
+                weight = max(weight, clamp(1.0 - abs(r.x) * 2.0, 0.0, 1.0));
+            }
+            if (code > 1U) {
+                coverage -= clamp(r.y + 0.5, 0.0, 1.0);
+                weight = max(weight, clamp(1.0 - abs(r.y) * 2.0, 0.0, 1.0));
+            }
+        }
+    }
+    return coverage;
+}
+
+void main()
+{
+    vec2 pixelsPerEm = 1.0 / fwidth(EmCoord);
+    ivec2 band = clamp(ivec2((EmCoord - Box.xy) / (Box.zw - Box.xy) * float(bands)), 0, bands - 1);
+    float xWeight, yWeight;
+    // rows are cut along y and hold what a ray along x crosses
+    float x = rayCoverage(band.y, false, pixelsPerEm.x, xWeight);
+    float y = rayCoverage(bands + band.x, true, pixelsPerEm.y, yWeight);
+    // the ray with an edge nearer the pixel knows its coverage better
+    float coverage = max(abs(x * xWeight + y * yWeight) / max(xWeight + yWeight, 1.0 / 65536.0),
+                         min(abs(x), abs(y)));
+    color = vec4(TextColor.rgb, TextColor.a * clamp(coverage, 0.0, 1.0));
+}
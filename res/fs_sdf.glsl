@@ -0,0 +1,34 @@
+#version 330 core
+in vec2 TexCoord;
+in vec4 TextColor;
+out vec4 color;
+
+uniform sampler2D text;
+uniform vec4 outlineColor;
+uniform float outlineWidth;     // in field units, 0.5 reaches the full spread
+uniform vec4 shadowColor;
+uniform vec2 shadowOffset;      // in texture coordinates, at most 3 texels
+uniform float shadowSoftness;
+
+// 0.5 is the glyph edge; w is about half a screen pixel of field
+float coverage(float d, float edge, float w) {
+    return smoothstep(edge - w, edge + w, d);
+}
+
+void main()
+{
+    float d = texture(text, TexCoord).r;
+    float w = max(fwidth(d) * 0.5, 0.0001);
+    vec4 fill = vec4(TextColor.rgb * TextColor.a, TextColor.a) * coverage(d, 0.5, w);
+    vec4 c = fill;
+    if (outlineWidth > 0.0) {
+        float outline = coverage(d, 0.5 - outlineWidth, w);
+        c += vec4(outlineColor.rgb * outlineColor.a, outlineColor.a) * outline * (1.0 - c.a);
+    }
+    if (shadowColor.a > 0.0) {
+        float s = texture(text, TexCoord - shadowOffset).r;
+        float shadow = coverage(s, 0.5 - outlineWidth, w + shadowSoftness);
+        c += vec4(shadowColor.rgb * shadowColor.a, shadowColor.a) * shadow * (1.0 - c.a);
+    }
+    color = vec4(c.rgb / max(c.a, 0.0001), c.a);
+}
\ No newline at end of file
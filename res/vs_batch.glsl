@@ -0,0 +1,20 @@
+#version 330 core
+
+layout (location = 0) in vec4 vertex; // <vec2 pos, vec2 tex>
+layout (location = 1) in uint run;
+out vec2 TexCoord;
+out vec4 TextColor;
+
+uniform mat4 projection;
+uniform samplerBuffer runs;
+
+void main()
+{
+    int base = int(run) * 3;
+    vec4 m = texelFetch(runs, base);
+    vec2 offset = texelFetch(runs, base + 1).xy;
+    vec2 pos = mat2(m.xy, m.zw) * vertex.xy + offset;
+    gl_Position = projection * vec4(pos, 1.0, 1.0);
+    TexCoord = vertex.zw;
+    TextColor = texelFetch(runs, base + 2);
+}
\ No newline at end of file
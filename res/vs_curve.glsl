@@ -0,0 +1,30 @@
+#version 330 core
+
+layout (location = 0) in vec3 pen; // <x, y> in pixels, pixels per em
+layout (location = 1) in int glyph; // first texel of the glyph in curves
+layout (location = 2) in vec4 tint;
+out vec2 EmCoord;
+flat out int Glyph;
+flat out vec4 Box;
+out vec4 TextColor;
+
+uniform mat4 projection;
+uniform mat3 transform;
+uniform samplerBuffer curves;
+
+void main()
+{
+    vec4 box = texelFetch(curves, glyph);
+    // a pixel wider all around, so the antialiased edge is inside the quad
+    float scale = sqrt(abs(determinant(mat2(transform))));
+    float margin = 1.0 / (pen.z * max(scale, 1.0 / 64.0));
+    // strip order: top-left, top-right, bottom-left, bottom-right
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec2 em = mix(box.xw + vec2(-margin, margin), box.zy + vec2(margin, -margin), corner);
+    vec2 pos = (transform * vec3(pen.xy + em * pen.z, 1.0)).xy;
+    gl_Position = projection * vec4(pos, 1.0, 1.0);
+    EmCoord = em;
+    Glyph = glyph;
+    Box = box;
+    TextColor = tint;
+}
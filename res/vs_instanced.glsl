@@ -0,0 +1,22 @@
+#version 330 core
+
+layout (location = 0) in ivec2 position; // top-left corner in pixels
+layout (location = 1) in uvec4 rect; // <u, v, w, h> in atlas texels
+layout (location = 2) in vec4 tint;
+out vec2 TexCoord;
+out vec4 TextColor;
+
+uniform mat4 projection;
+uniform vec2 origin;
+uniform float pageSize;
+
+void main()
+{
+    // strip order: top-left, top-right, bottom-left, bottom-right
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+    vec2 size = vec2(rect.zw);
+    vec2 pos = origin + vec2(position) + vec2(corner.x, -corner.y) * size;
+    gl_Position = projection * vec4(pos, 1.0, 1.0);
+    TexCoord = (vec2(rect.xy) + corner * size) / pageSize;
+    TextColor = tint;
+}
\ No newline at end of file
@@ -3,15 +3,14 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include "screenshot.h"
-#define STB_IMAGE_WRITE_IMPLEMENTATION
-#include <stb_image_write.h>
+#include "image_write.h"
 
 void screenshot(GLFWwindow *window, const char *path) {
     int width, height;
 
     FILE *out = fopen(path, "wb");
 
-    glfwGetWindowSize(window, &width, &height);
+    glfwGetFramebufferSize(window, &width, &height);
 
     uint8_t *buffer = (uint8_t *) calloc(width * height * 3, sizeof(uint8_t));
 
@@ -36,10 +35,9 @@ void screenshot(GLFWwindow *window, const char *path) {
 
 void saveScreenShot(GLFWwindow *window, const char *path) {
     int width, height;
-    stbi_flip_vertically_on_write(1);
-    glfwGetWindowSize(window, &width, &height);
+    glfwGetFramebufferSize(window, &width, &height);
     uint8_t *buffer = (uint8_t *) calloc(width * height * 3, sizeof(uint8_t));
     glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, buffer);
-    stbi_write_bmp(path, width, height, 3, buffer);
+    saveImage(path, width, height, 3, buffer, 1);
     free(buffer);
 }
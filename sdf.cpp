@@ -0,0 +1,231 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include <cmath>
+#include "sdf.h"
+#include FT_OUTLINE_H
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SDF_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// flattening error allowed for curves, in base-size pixels
+static const float FLATTEN_TOLERANCE = 0.1f;
+static const int MAX_CURVE_SEGMENTS = 32;
+
+struct Flattener {
+    SdfOutline *outline;
+    float scale;
+    float x;
+    float y;
+};
+
+static void addSegment(Flattener *f, float x, float y) {
+    if (x != f->x || y != f->y) {
+        std::vector<float> &segments = f->outline->segments;
+        segments.push_back(f->x);
+        segments.push_back(f->y);
+        segments.push_back(x);
+        segments.push_back(y);
+    }
+    f->x = x;
+    f->y = y;
+}
+
+// Number of chords keeping a curve with the given second difference within tolerance.
+static int curveSegments(float ddx, float ddy, float factor) {
+    float dd = sqrtf(ddx * ddx + ddy * ddy) * factor;
+    int n = (int) ceilf(sqrtf(dd / FLATTEN_TOLERANCE));
+    return std::max(1, std::min(n, MAX_CURVE_SEGMENTS));
+}
+
+static int moveTo(const FT_Vector *to, void *user) {
+    auto f = (Flattener *) user;
+    f->x = to->x * f->scale;
+    f->y = to->y * f->scale;
+    return 0;
+}
+
+static int lineTo(const FT_Vector *to, void *user) {
+    auto f = (Flattener *) user;
+    addSegment(f, to->x * f->scale, to->y * f->scale);
+    return 0;
+}
+
+static int conicTo(const FT_Vector *control, const FT_Vector *to, void *user) {
+    auto f = (Flattener *) user;
+    float x0 = f->x, y0 = f->y;
+    float x1 = control->x * f->scale, y1 = control->y * f->scale;
+    float x2 = to->x * f->scale, y2 = to->y * f->scale;
+    int n = curveSegments(x0 - 2 * x1 + x2, y0 - 2 * y1 + y2, 0.125f);
+    for (int i = 1; i <= n; ++i) {
+        float t = (float) i / n, u = 1 - t;
+        addSegment(f, u * u * x0 + 2 * u * t * x1 + t * t * x2,
+                   u * u * y0 + 2 * u * t * y1 + t * t * y2);
+    }
+    return 0;
+}
+
+static int cubicTo(const FT_Vector *control1, const FT_Vector *control2, const FT_Vector *to, void *user) {
+    auto f = (Flattener *) user;
+    float x0 = f->x, y0 = f->y;
+    float x1 = control1->x * f->scale, y1 = control1->y * f->scale;
+    float x2 = control2->x * f->scale, y2 = control2->y * f->scale;
+    float x3 = to->x * f->scale, y3 = to->y * f->scale;
+    float ddx = std::max(fabsf(x0 - 2 * x1 + x2), fabsf(x1 - 2 * x2 + x3));
+    float ddy = std::max(fabsf(y0 - 2 * y1 + y2), fabsf(y1 - 2 * y2 + y3));
+    int n = curveSegments(ddx, ddy, 0.75f);
+    for (int i = 1; i <= n; ++i) {
+        float t = (float) i / n, u = 1 - t;
+        float a = u * u * u, b = 3 * u * u * t, c = 3 * u * t * t, d = t * t * t;
+        addSegment(f, a * x0 + b * x1 + c * x2 + d * x3, a * y0 + b * y1 + c * y2 + d * y3);
+    }
+    return 0;
+}
+
+bool loadSdfOutline(FT_Face face, unsigned int glyph, unsigned int size, SdfOutline *outline) {
+    outline->segments.clear();
+    if (FT_Load_Glyph(face, glyph, FT_LOAD_NO_SCALE | FT_LOAD_NO_BITMAP) ||
+        face->glyph->format != FT_GLYPH_FORMAT_OUTLINE) {
+        return false;
+    }
+    FT_Outline_Funcs funcs = {moveTo, lineTo, conicTo, cubicTo, 0, 0};
+    Flattener f = {outline, (float) size / face->units_per_EM, 0, 0};
+    FT_Outline *source = &face->glyph->outline;
+    if (FT_Outline_Decompose(source, &funcs, &f) || outline->segments.empty()) {
+        return false;
+    }
+    outline->evenOdd = (source->flags & FT_OUTLINE_EVEN_ODD_FILL) != 0;
+
+    const std::vector<float> &s = outline->segments;
+    outline->xMin = outline->xMax = s[0];
+    outline->yMin = outline->yMax = s[1];
+    for (size_t i = 0; i < s.size(); i += 2) {
+        outline->xMin = std::min(outline->xMin, s[i]);
+        outline->xMax = std::max(outline->xMax, s[i]);
+        outline->yMin = std::min(outline->yMin, s[i + 1]);
+        outline->yMax = std::max(outline->yMax, s[i + 1]);
+    }
+    return true;
+}
+
+void layoutSdf(const SdfOutline &outline, SdfBitmap *bitmap) {
+    int x0 = (int) floorf(outline.xMin) - SDF_SPREAD;
+    int x1 = (int) ceilf(outline.xMax) + SDF_SPREAD;
+    int y0 = (int) floorf(outline.yMin) - SDF_SPREAD;
+    int y1 = (int) ceilf(outline.yMax) + SDF_SPREAD;
+    bitmap->width = x1 - x0;
+    bitmap->rows = y1 - y0;
+    bitmap->left = x0;
+    bitmap->top = y1;
+    bitmap->pixels.assign((size_t) bitmap->width * bitmap->rows, 0);
+}
+
+/*
+ * Segments near one row, as structure of arrays padded to a multiple of four
+ * with segments far outside the spread, so the inner loop needs no tail.
+ */
+struct RowSegments {
+    std::vector<float> ax, ay, dx, dy, inv;
+
+    void clear() {
+        ax.clear();
+        ay.clear();
+        dx.clear();
+        dy.clear();
+        inv.clear();
+    }
+
+    void push(float x0, float y0, float x1, float y1) {
+        float ex = x1 - x0, ey = y1 - y0;
+        float len2 = ex * ex + ey * ey;
+        ax.push_back(x0);
+        ay.push_back(y0);
+        dx.push_back(ex);
+        dy.push_back(ey);
+        inv.push_back(len2 > 0 ? 1 / len2 : 0);
+    }
+
+    void pad() {
+        while (ax.size() % 4) {
+            push(1e6f, 1e6f, 1e6f, 1e6f);
+        }
+    }
+};
+
+// Squared distance from (px, py) to the nearest segment, starting from best.
+static float nearestSquared(const RowSegments &row, float px, float py, float best) {
+    int count = (int) row.ax.size();
+#if SDF_SSE2
+    __m128 x = _mm_set1_ps(px), y = _mm_set1_ps(py);
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1);
+    __m128 nearest = _mm_set1_ps(best);
+    for (int i = 0; i < count; i += 4) {
+        __m128 wx = _mm_sub_ps(x, _mm_loadu_ps(&row.ax[i]));
+        __m128 wy = _mm_sub_ps(y, _mm_loadu_ps(&row.ay[i]));
+        __m128 ex = _mm_loadu_ps(&row.dx[i]);
+        __m128 ey = _mm_loadu_ps(&row.dy[i]);
+        __m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(wx, ex), _mm_mul_ps(wy, ey)), _mm_loadu_ps(&row.inv[i]));
+        t = _mm_min_ps(_mm_max_ps(t, zero), one);
+        __m128 qx = _mm_sub_ps(wx, _mm_mul_ps(ex, t));
+        __m128 qy = _mm_sub_ps(wy, _mm_mul_ps(ey, t));
+        nearest = _mm_min_ps(nearest, _mm_add_ps(_mm_mul_ps(qx, qx), _mm_mul_ps(qy, qy)));
+    }
+    nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(1, 0, 3, 2)));
+    nearest = _mm_min_ps(nearest, _mm_shuffle_ps(nearest, nearest, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtss_f32(nearest);
+#else
+    for (int i = 0; i < count; ++i) {
+        float wx = px - row.ax[i], wy = py - row.ay[i];
+        float t = (wx * row.dx[i] + wy * row.dy[i]) * row.inv[i];
+        t = std::min(std::max(t, 0.0f), 1.0f);
+        float qx = wx - row.dx[i] * t, qy = wy - row.dy[i] * t;
+        best = std::min(best, qx * qx + qy * qy);
+    }
+    return best;
+#endif
+}
+
+/*
+ * Distances are brute force over the segments that can be within the spread
+ * of the row; the sign comes from the winding number, counted by walking the
+ * row's sorted edge crossings once.
+ */
+void generateSdf(const SdfOutline &outline, SdfBitmap *bitmap, int first, int last) {
+    const std::vector<float> &s = outline.segments;
+    float spread = (float) SDF_SPREAD;
+    RowSegments row;
+    std::vector<std::pair<float, int>> crossings;
+    for (int r = first; r < last; ++r) {
+        float py = bitmap->top - r - 0.5f;
+        row.clear();
+        crossings.clear();
+        for (size_t i = 0; i < s.size(); i += 4) {
+            float x0 = s[i], y0 = s[i + 1], x1 = s[i + 2], y1 = s[i + 3];
+            if (std::min(y0, y1) - spread <= py && py <= std::max(y0, y1) + spread) {
+                row.push(x0, y0, x1, y1);
+            }
+            if ((y0 <= py) != (y1 <= py)) {
+                float x = x0 + (py - y0) * (x1 - x0) / (y1 - y0);
+                crossings.push_back(std::make_pair(x, y1 > y0 ? 1 : -1));
+            }
+        }
+        row.pad();
+        std::sort(crossings.begin(), crossings.end());
+
+        unsigned char *out = &bitmap->pixels[(size_t) r * bitmap->width];
+        size_t next = 0;
+        int winding = 0;
+        for (int c = 0; c < bitmap->width; ++c) {
+            float px = bitmap->left + c + 0.5f;
+            while (next < crossings.size() && crossings[next].first < px) {
+                winding += crossings[next++].second;
+            }
+            bool inside = outline.evenOdd ? (winding & 1) != 0 : winding != 0;
+            float distance = sqrtf(nearestSquared(row, px, py, spread * spread));
+            float value = 0.5f + (inside ? distance : -distance) / (2 * spread);
+            out[c] = (unsigned char) std::min(255.0f, std::max(0.0f, value * 255 + 0.5f));
+        }
+    }
+}
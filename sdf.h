@@ -0,0 +1,47 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef SDF_H
+#define SDF_H
+
+#include <vector>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+// Every SDF glyph is generated once at this pixel size, whatever it is drawn at.
+static const unsigned int SDF_BASE_SIZE = 48;
+// Distance in base-size pixels mapped to the full 0..255 range around the 128 edge.
+static const int SDF_SPREAD = 6;
+
+/*
+ * Outline flattened to line segments, in base-size pixels with y up. Loading
+ * it needs the FT_Face and so happens on one thread; generating the field
+ * from it only reads the segments and can run anywhere.
+ */
+struct SdfOutline {
+    std::vector<float> segments;    // x0, y0, x1, y1 per segment
+    float xMin;
+    float yMin;
+    float xMax;
+    float yMax;
+    bool evenOdd;
+};
+
+struct SdfBitmap {
+    int width;
+    int rows;
+    int left;               // bearing, as FT_GlyphSlot reports it for bitmaps
+    int top;
+    std::vector<unsigned char> pixels;
+};
+
+// Loads the unscaled outline, so the face's current pixel size is untouched.
+// Returns false for glyphs without an outline, e.g. a space or a bitmap emoji.
+bool loadSdfOutline(FT_Face face, unsigned int glyph, unsigned int size, SdfOutline *outline);
+
+// Sizes bitmap to the outline bounds plus the spread on every side.
+void layoutSdf(const SdfOutline &outline, SdfBitmap *bitmap);
+
+// Fills rows [first, last) of a bitmap laid out by layoutSdf().
+void generateSdf(const SdfOutline &outline, SdfBitmap *bitmap, int first, int last);
+
+#endif
@@ -0,0 +1,177 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include "profiler.h"
+#include "shape_cache.h"
+
+// longer words are shaped directly, caching them would only churn the LRU
+static const size_t MAX_CACHED_WORD = 256;
+
+ShapeCache *createShapeCache(size_t capacity) {
+    auto cache = new ShapeCache;
+    cache->capacity = capacity;
+    cache->hits = 0;
+    cache->misses = 0;
+    return cache;
+}
+
+void destroyShapeCache(ShapeCache *cache) {
+    for (auto buffer : cache->buffers) {
+        hb_buffer_destroy(buffer);
+    }
+    delete cache;
+}
+
+hb_buffer_t *acquireShapeBuffer(ShapeCache *cache) {
+    if (cache->buffers.empty()) {
+        return hb_buffer_create();
+    }
+    hb_buffer_t *buffer = cache->buffers.back();
+    cache->buffers.pop_back();
+    return buffer;
+}
+
+void releaseShapeBuffer(ShapeCache *cache, hb_buffer_t *buffer) {
+    // clear_contents keeps the allocation around for the next user
+    hb_buffer_clear_contents(buffer);
+    cache->buffers.push_back(buffer);
+}
+
+float shapeCacheHitRate(const ShapeCache *cache) {
+    unsigned long total = cache->hits + cache->misses;
+    return total ? (float) cache->hits / total : 0.0f;
+}
+
+static unsigned long long hashRun(hb_font_t *font, unsigned int size, const TextSpan &text,
+                                  hb_language_t language, const char *data, size_t length) {
+    // FNV-1a over the bytes, then the rest of the key folded in
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; ++i) {
+        h = (h ^ (unsigned char) data[i]) * 1099511628211ULL;
+    }
+    unsigned long long fields[] = {
+            (unsigned long long) (size_t) font,
+            size,
+            (unsigned long long) text.script,
+            (unsigned long long) text.direction,
+            (unsigned long long) (size_t) language
+    };
+    for (auto field : fields) {
+        h = (h ^ field) * 1099511628211ULL;
+    }
+    return h;
+}
+
+static bool isSameRun(const ShapedRun &run, hb_font_t *font, unsigned int size, const TextSpan &text,
+                      hb_language_t language, const char *data, size_t length) {
+    return run.font == font && run.size == size && run.script == text.script &&
+           run.direction == text.direction && run.language == language &&
+           run.text.size() == length && run.text.compare(0, length, data, length) == 0;
+}
+
+static void shapeWord(hb_buffer_t *buffer, hb_font_t *font, const TextSpan &text, hb_language_t language,
+                      const char *data, size_t length) {
+    hb_buffer_set_direction(buffer, text.direction);
+    hb_buffer_set_script(buffer, text.script);
+    hb_buffer_set_language(buffer, language);
+    hb_buffer_add_utf8(buffer, data, (int) length, 0, (int) length);
+    hb_shape(font, buffer, nullptr, 0);
+}
+
+static void appendGlyphs(const hb_glyph_info_t *infos, const hb_glyph_position_t *positions, unsigned int count,
+                         unsigned int offset, std::vector<hb_glyph_info_t> &outInfos,
+                         std::vector<hb_glyph_position_t> &outPositions) {
+    for (unsigned int i = 0; i < count; ++i) {
+        hb_glyph_info_t info = infos[i];
+        info.cluster += offset;
+        outInfos.push_back(info);
+        outPositions.push_back(positions[i]);
+    }
+}
+
+static void shapeSegment(ShapeCache *cache, hb_font_t *font, unsigned int size, const TextSpan &text,
+                         hb_language_t language, size_t start, size_t end,
+                         std::vector<hb_glyph_info_t> &infos, std::vector<hb_glyph_position_t> &positions) {
+    const char *word = text.data + start;
+    size_t length = end - start;
+    unsigned long long h = hashRun(font, size, text, language, word, length);
+    auto found = cache->index.find(h);
+    if (found != cache->index.end() && isSameRun(*found->second, font, size, text, language, word, length)) {
+        cache->hits++;
+        PROFILE_COUNT("shape_hits", 1);
+        cache->runs.splice(cache->runs.begin(), cache->runs, found->second);
+        const ShapedRun &run = cache->runs.front();
+        appendGlyphs(run.infos.data(), run.positions.data(), (unsigned int) run.infos.size(),
+                     (unsigned int) start, infos, positions);
+        return;
+    }
+    cache->misses++;
+    PROFILE_COUNT("shape_misses", 1);
+
+    hb_buffer_t *buffer = acquireShapeBuffer(cache);
+    shapeWord(buffer, font, text, language, word, length);
+    unsigned int count;
+    hb_glyph_info_t *wordInfos = hb_buffer_get_glyph_infos(buffer, &count);
+    hb_glyph_position_t *wordPositions = hb_buffer_get_glyph_positions(buffer, &count);
+    appendGlyphs(wordInfos, wordPositions, count, (unsigned int) start, infos, positions);
+
+    if (length <= MAX_CACHED_WORD && cache->capacity) {
+        if (found != cache->index.end()) {
+            // hash collision, the newer word takes the slot
+            cache->runs.erase(found->second);
+            cache->index.erase(found);
+        }
+        if (cache->runs.size() >= cache->capacity) {
+            cache->index.erase(cache->runs.back().hash);
+            cache->runs.pop_back();
+        }
+        cache->runs.push_front(ShapedRun());
+        ShapedRun &run = cache->runs.front();
+        run.hash = h;
+        run.font = font;
+        run.size = size;
+        run.script = text.script;
+        run.direction = text.direction;
+        run.language = language;
+        run.text.assign(word, length);
+        run.infos.assign(wordInfos, wordInfos + count);
+        run.positions.assign(wordPositions, wordPositions + count);
+        cache->index[h] = cache->runs.begin();
+    }
+    releaseShapeBuffer(cache, buffer);
+}
+
+static size_t nextWordEnd(const char *data, size_t length, size_t start) {
+    while (start < length) {
+        char c = data[start++];
+        if (c == ' ' || c == '\n') {
+            break;
+        }
+    }
+    return start;
+}
+
+void shapeText(ShapeCache *cache, hb_font_t *font, unsigned int size, const TextSpan &text,
+               std::vector<hb_glyph_info_t> &infos, std::vector<hb_glyph_position_t> &positions) {
+    infos.clear();
+    positions.clear();
+    hb_language_t language = hb_language_from_string(text.language, -1);
+    size_t length = text.length;
+
+    if (HB_DIRECTION_IS_BACKWARD(text.direction)) {
+        // a whole-text shape comes out in visual order, so words go last to first
+        std::vector<size_t> &ends = cache->ends;
+        ends.clear();
+        for (size_t start = 0; start < length; start = ends.back()) {
+            ends.push_back(nextWordEnd(text.data, length, start));
+        }
+        for (size_t i = ends.size(); i-- > 0;) {
+            shapeSegment(cache, font, size, text, language, i ? ends[i - 1] : 0, ends[i], infos, positions);
+        }
+        return;
+    }
+    for (size_t start = 0; start < length;) {
+        size_t end = nextWordEnd(text.data, length, start);
+        shapeSegment(cache, font, size, text, language, start, end, infos, positions);
+        start = end;
+    }
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef SHAPE_CACHE_H
+#define SHAPE_CACHE_H
+
+#include <list>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <hb.h>
+#include "text.h"
+
+struct ShapedRun {
+    unsigned long long hash;
+    hb_font_t *font;
+    unsigned int size;
+    hb_script_t script;
+    hb_direction_t direction;
+    hb_language_t language;
+    std::string text;
+    std::vector<hb_glyph_info_t> infos;
+    std::vector<hb_glyph_position_t> positions;
+};
+
+/*
+ * Bounded LRU of shaped words. Text is cut after every space or newline and
+ * each piece is shaped on its own, so labels that share words share entries.
+ * Lookups hash the bytes in place and never allocate on a hit.
+ *
+ * A word is shaped without the text around it, so nothing reaches across a
+ * cut: kerning against a space, ligatures or contextual forms that span one,
+ * and joining that depends on a neighbouring word are lost. The result can
+ * differ from shaping the whole text in one hb_shape() call wherever the
+ * font has such lookups.
+ */
+struct ShapeCache {
+    size_t capacity;
+    std::list<ShapedRun> runs;      // most recently used first
+    std::unordered_map<unsigned long long, std::list<ShapedRun>::iterator> index;
+    std::vector<hb_buffer_t *> buffers;
+    std::vector<size_t> ends;       // word ends of backward text, scratch
+    unsigned long hits;
+    unsigned long misses;
+};
+
+ShapeCache *createShapeCache(size_t capacity);
+
+void destroyShapeCache(ShapeCache *cache);
+
+// Pooled HarfBuzz buffers, handed back empty and ready to fill.
+hb_buffer_t *acquireShapeBuffer(ShapeCache *cache);
+
+void releaseShapeBuffer(ShapeCache *cache, hb_buffer_t *buffer);
+
+/*
+ * Shapes text with font, which must already be scaled for size, word by
+ * word. Clusters in infos are byte offsets into text.data and glyphs come in
+ * the order one call would give them; the glyphs themselves can differ at
+ * word edges, see ShapeCache.
+ */
+void shapeText(ShapeCache *cache, hb_font_t *font, unsigned int size, const TextSpan &text,
+               std::vector<hb_glyph_info_t> &infos, std::vector<hb_glyph_position_t> &positions);
+
+float shapeCacheHitRate(const ShapeCache *cache);
+
+#endif
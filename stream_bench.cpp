@@ -0,0 +1,170 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+/*
+ * Compares the ways dynamic glyph quads can reach the GPU: glBufferData per
+ * draw (what drawText() used to do), the orphaning ring and the persistently
+ * mapped ring. Every frame rewrites all quads, vsync is off and the clock
+ * only stops after glFinish, so the numbers include any driver stalls.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "shader.h"
+#include "stream_buffer.h"
+
+static const int DRAWS_PER_FRAME = 100;
+static const int QUADS_PER_DRAW = 200;
+static const int FRAMES = 300;
+
+enum Strategy {
+    BUFFER_DATA,
+    ORPHAN,
+    PERSISTENT
+};
+
+static const char *strategyName(Strategy strategy) {
+    switch (strategy) {
+        case BUFFER_DATA:
+            return "bufferdata";
+        case ORPHAN:
+            return "orphan";
+        default:
+            return "persistent";
+    }
+}
+
+static void fillQuads(std::vector<GLfloat> &vertices, int frame, int draw) {
+    for (int q = 0; q < QUADS_PER_DRAW; ++q) {
+        float x = (float) ((q * 7 + draw * 13 + frame) % 780);
+        float y = (float) ((q * 11 + draw * 5) % 580);
+        GLfloat quad[] = {
+                x, y + 12, 0, 0,
+                x, y, 0, 1,
+                x + 8, y, 1, 1,
+                x + 8, y + 12, 1, 0
+        };
+        memcpy(&vertices[q * 16], quad, sizeof(quad));
+    }
+}
+
+static double run(Strategy strategy, GLuint vao, GLuint ibo, unsigned long *waits) {
+    std::vector<GLfloat> vertices(QUADS_PER_DRAW * 16);
+    GLsizeiptr bytes = vertices.size() * sizeof(GLfloat);
+    GLuint vbo = 0;
+    StreamBuffer *stream = nullptr;
+    if (strategy == BUFFER_DATA) {
+        glGenBuffers(1, &vbo);
+    } else {
+        stream = createStreamBuffer(GL_ARRAY_BUFFER, bytes * DRAWS_PER_FRAME * STREAM_REGIONS,
+                                    strategy == PERSISTENT);
+        vbo = stream->buffer;
+    }
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), nullptr);
+
+    glFinish();
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < FRAMES; ++frame) {
+        glClear(GL_COLOR_BUFFER_BIT);
+        for (int draw = 0; draw < DRAWS_PER_FRAME; ++draw) {
+            fillQuads(vertices, frame, draw);
+            GLint base = 0;
+            if (stream) {
+                GLintptr offset;
+                void *dst = mapStream(stream, bytes, 16, &offset);
+                memcpy(dst, vertices.data(), bytes);
+                unmapStream(stream);
+                base = (GLint) (offset / 16);
+            } else {
+                glBindBuffer(GL_ARRAY_BUFFER, vbo);
+                glBufferData(GL_ARRAY_BUFFER, bytes, vertices.data(), GL_DYNAMIC_DRAW);
+            }
+            glDrawElementsBaseVertex(GL_TRIANGLES, QUADS_PER_DRAW * 6, GL_UNSIGNED_INT, nullptr, base);
+        }
+        glFlush();
+    }
+    glFinish();
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    *waits = stream ? stream->waits : 0;
+    glBindVertexArray(0);
+    if (stream) {
+        destroyStreamBuffer(stream);
+    } else {
+        glDeleteBuffers(1, &vbo);
+    }
+    return elapsed / FRAMES;
+}
+
+int main() {
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(800, 600, "stream_bench", nullptr, nullptr);
+    if (window == nullptr) {
+        printf("Failed to create GLFW window\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+        printf("Failed to initialize GLAD\n");
+        glfwTerminate();
+        return 1;
+    }
+    glfwSwapInterval(0);
+    bool persistent = loadBufferStorage((GLADloadproc) glfwGetProcAddress);
+
+    GLuint program = shader_load("res/vs_texture.glsl", "res/fs_texture.glsl");
+    glUseProgram(program);
+    GLfloat projection[] = {
+            2.0f / 800, 0, 0, 0,
+            0, 2.0f / 600, 0, 0,
+            0, 0, -1, 0,
+            -1, -1, 0, 1
+    };
+    glUniformMatrix4fv(glGetUniformLocation(program, "projection"), 1, GL_FALSE, projection);
+    glUniform3f(glGetUniformLocation(program, "textColor"), 0, 0, 0);
+
+    GLuint vao, ibo;
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &ibo);
+    std::vector<GLuint> indices(QUADS_PER_DRAW * 6);
+    for (int i = 0; i < QUADS_PER_DRAW; ++i) {
+        GLuint index = i * 4;
+        GLuint quad[] = {index, index + 1, index + 2, index, index + 2, index + 3};
+        memcpy(&indices[i * 6], quad, sizeof(quad));
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    int glyphs = DRAWS_PER_FRAME * QUADS_PER_DRAW;
+    printf("%s, %d glyphs/frame, %d frames\n", (const char *) glGetString(GL_RENDERER), glyphs, FRAMES);
+    Strategy strategies[] = {BUFFER_DATA, ORPHAN, PERSISTENT};
+    for (auto strategy : strategies) {
+        if (strategy == PERSISTENT && !persistent) {
+            printf("%-12s unsupported\n", strategyName(strategy));
+            continue;
+        }
+        unsigned long waits;
+        double ms = run(strategy, vao, ibo, &waits);
+        printf("%-12s %8.3f ms/frame %12.0f glyphs/s %6lu waits\n", strategyName(strategy), ms,
+               glyphs * 1000.0 / ms, waits);
+    }
+
+    glDeleteBuffers(1, &ibo);
+    glDeleteVertexArrays(1, &vao);
+    glDeleteProgram(program);
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <string.h>
+#include "stream_buffer.h"
+#include "profiler.h"
+
+/* GL_ARB_buffer_storage, glad is generated for plain 3.3 core */
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEPROC)(GLenum target, GLsizeiptr size, const void *data,
+                                                 GLbitfield flags);
+static PFNGLBUFFERSTORAGEPROC bufferStorage = nullptr;
+
+bool loadBufferStorage(GLADloadproc load) {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    bool supported = major > 4 || (major == 4 && minor >= 4);
+
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count && !supported; ++i) {
+        const char *name = (const char *) glGetStringi(GL_EXTENSIONS, i);
+        supported = name && strcmp(name, "GL_ARB_buffer_storage") == 0;
+    }
+    bufferStorage = supported ? (PFNGLBUFFERSTORAGEPROC) load("glBufferStorage") : nullptr;
+    return bufferStorage != nullptr;
+}
+
+StreamBuffer *createStreamBuffer(GLenum target, GLsizeiptr size, bool persistent) {
+    auto stream = new StreamBuffer;
+    stream->target = target;
+    // regions start on a boundary any vertex stride we stream divides
+    stream->regionSize = size / STREAM_REGIONS / 256 * 256;
+    stream->size = stream->regionSize * STREAM_REGIONS;
+    stream->region = 0;
+    stream->head = 0;
+    stream->mapped = nullptr;
+    stream->waits = 0;
+    for (auto &fence : stream->fences) {
+        fence = nullptr;
+    }
+
+    glGenBuffers(1, &stream->buffer);
+    glBindBuffer(target, stream->buffer);
+    if (persistent && bufferStorage) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(target, stream->size, nullptr, flags);
+        stream->mapped = (unsigned char *) glMapBufferRange(target, 0, stream->size, flags);
+    } else {
+        glBufferData(target, stream->size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(target, 0);
+    return stream;
+}
+
+void destroyStreamBuffer(StreamBuffer *stream) {
+    for (auto fence : stream->fences) {
+        if (fence) {
+            glDeleteSync(fence);
+        }
+    }
+    if (stream->mapped) {
+        glBindBuffer(stream->target, stream->buffer);
+        glUnmapBuffer(stream->target);
+        glBindBuffer(stream->target, 0);
+    }
+    glDeleteBuffers(1, &stream->buffer);
+    delete stream;
+}
+
+static void nextRegion(StreamBuffer *stream) {
+    if (stream->mapped) {
+        // everything drawn from the region we leave has been submitted already
+        stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stream->region = (stream->region + 1) % STREAM_REGIONS;
+        GLsync fence = stream->fences[stream->region];
+        if (fence) {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                stream->waits++;
+                while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+                }
+            }
+            glDeleteSync(fence);
+            stream->fences[stream->region] = nullptr;
+        }
+    } else {
+        stream->region = (stream->region + 1) % STREAM_REGIONS;
+        if (stream->region == 0) {
+            // hand the old storage to the driver, it frees it once unused
+            glBufferData(stream->target, stream->size, nullptr, GL_STREAM_DRAW);
+        }
+    }
+    stream->head = stream->region * stream->regionSize;
+}
+
+void *mapStream(StreamBuffer *stream, GLsizeiptr bytes, GLsizeiptr align, GLintptr *offset) {
+    if (bytes > stream->regionSize) {
+        return nullptr;
+    }
+    glBindBuffer(stream->target, stream->buffer);
+    GLintptr start = (stream->head + align - 1) / align * align;
+    GLintptr regionEnd = (stream->region + 1) * stream->regionSize;
+    if (start + bytes > regionEnd) {
+        nextRegion(stream);
+        start = (stream->head + align - 1) / align * align;
+    }
+    stream->head = start + bytes;
+    *offset = start;
+    PROFILE_COUNT("upload_bytes", bytes);
+    if (stream->mapped) {
+        return stream->mapped + start;
+    }
+    return glMapBufferRange(stream->target, start, bytes,
+                            GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+}
+
+void unmapStream(StreamBuffer *stream) {
+    if (!stream->mapped) {
+        glBindBuffer(stream->target, stream->buffer);
+        glUnmapBuffer(stream->target);
+    }
+}
@@ -0,0 +1,46 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+
+static const int STREAM_REGIONS = 3;
+
+/*
+ * Ring of vertex or pixel memory for data that changes every frame. With
+ * GL_ARB_buffer_storage the buffer is mapped once, persistently, and split
+ * into regions; a region gets a fence when writing moves past it and is only
+ * reused once that fence signalled. Without the extension each region change
+ * orphans the buffer and writes go through unsynchronized map ranges.
+ */
+typedef struct {
+    GLenum target;
+    GLuint buffer;
+    GLsizeiptr size;
+    GLsizeiptr regionSize;
+    int region;
+    GLintptr head;              // next free byte, absolute offset
+    unsigned char *mapped;      // persistent mapping, null when orphaning
+    GLsync fences[STREAM_REGIONS];
+    unsigned long waits;        // times the CPU had to block on a fence
+} StreamBuffer;
+
+// Resolves glBufferStorage through load when GL 4.4 or the extension exists.
+bool loadBufferStorage(GLADloadproc load);
+
+// persistent falls back to orphaning when loadBufferStorage() failed.
+StreamBuffer *createStreamBuffer(GLenum target, GLsizeiptr size, bool persistent);
+
+void destroyStreamBuffer(StreamBuffer *stream);
+
+/*
+ * Reserves bytes aligned to align and returns where to write them; offset
+ * receives their position in the buffer. Must be paired with unmapStream()
+ * before drawing. Returns null when bytes do not fit in one region.
+ */
+void *mapStream(StreamBuffer *stream, GLsizeiptr bytes, GLsizeiptr align, GLintptr *offset);
+
+void unmapStream(StreamBuffer *stream);
+
+#endif
@@ -0,0 +1,43 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <string>
+#include <hb.h>
+
+typedef struct {
+    std::string data;
+    std::string language;
+    hb_script_t script;
+    hb_direction_t direction;
+    float space;
+} HBText;
+
+/*
+ * What shaping and layout read of a text: a view that copies no bytes, so a
+ * label can be shaped straight from a literal, a mapped file or a slice of
+ * another text. language is null terminated; an empty one means the default.
+ */
+struct TextSpan {
+    const char *data;
+    size_t length;
+    const char *language;
+    hb_script_t script;
+    hb_direction_t direction;
+    float space;
+};
+
+inline TextSpan textSpan(const HBText &text) {
+    return {text.data.data(), text.data.size(), text.language.c_str(), text.script, text.direction, text.space};
+}
+
+// Bytes [start, end) of text, with the same style.
+inline TextSpan sliceText(const TextSpan &text, size_t start, size_t end) {
+    TextSpan slice = text;
+    slice.data = text.data + start;
+    slice.length = end - start;
+    return slice;
+}
+
+#endif
@@ -0,0 +1,184 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include "text_batch.h"
+#include "profiler.h"
+
+// texels of GL_RGBA32F per run: mat2, translation, color
+static const int RUN_TEXELS = 3;
+
+TextBatch *createTextBatch(GLuint program) {
+    auto batch = new TextBatch;
+    batch->program = program;
+    batch->geometryDirty = false;
+    batch->runsDirty = false;
+
+    glGenVertexArrays(1, &batch->vao);
+    glGenBuffers(1, &batch->vbo);
+    glGenBuffers(1, &batch->ibo);
+    glBindVertexArray(batch->vao);
+    glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(BatchVertex), nullptr);
+    glEnableVertexAttribArray(1);
+    glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(BatchVertex), (void *) (4 * sizeof(GLfloat)));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, batch->ibo);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    glGenBuffers(1, &batch->runBuffer);
+    glGenTextures(1, &batch->runTexture);
+    glBindBuffer(GL_TEXTURE_BUFFER, batch->runBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, batch->runTexture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, batch->runBuffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "text"), 0);
+    glUniform1i(glGetUniformLocation(program, "runs"), 1);
+    glUseProgram(0);
+    return batch;
+}
+
+void destroyTextBatch(TextBatch *batch) {
+    glDeleteVertexArrays(1, &batch->vao);
+    glDeleteBuffers(1, &batch->vbo);
+    glDeleteBuffers(1, &batch->ibo);
+    glDeleteBuffers(1, &batch->runBuffer);
+    glDeleteTextures(1, &batch->runTexture);
+    delete batch;
+}
+
+int addTextRun(TextBatch *batch, Atlas *atlas, float r, float g, float b, float a) {
+    TextRun run = {atlas, {1, 0, 0, 1, 0, 0, 0, 0}, {r, g, b, a}};
+    batch->runs.push_back(run);
+    batch->geometryDirty = true;
+    batch->runsDirty = true;
+    return (int) batch->runs.size() - 1;
+}
+
+void setTextRunColor(TextBatch *batch, int run, float r, float g, float b, float a) {
+    GLfloat *color = batch->runs[run].color;
+    color[0] = r;
+    color[1] = g;
+    color[2] = b;
+    color[3] = a;
+    batch->runsDirty = true;
+}
+
+void setTextRunTransform(TextBatch *batch, int run, float a, float b, float c, float d, float tx, float ty) {
+    GLfloat *transform = batch->runs[run].transform;
+    transform[0] = a;
+    transform[1] = b;
+    transform[2] = c;
+    transform[3] = d;
+    transform[4] = tx;
+    transform[5] = ty;
+    batch->runsDirty = true;
+}
+
+void clearTextBatch(TextBatch *batch) {
+    batch->runs.clear();
+    batch->geometryDirty = true;
+    batch->runsDirty = true;
+}
+
+/*
+ * Regroups the quads of every run by atlas page, so each page ends up as a
+ * single contiguous index range no matter how many runs touch it.
+ */
+static void rebuildGeometry(TextBatch *batch, GlyphCache *glyphCache) {
+    batch->vertices.clear();
+    batch->indices.clear();
+    batch->ranges.clear();
+
+    for (int page = 0; page < (int) glyphCache->pages.size(); ++page) {
+        int first = (int) batch->indices.size();
+        for (size_t r = 0; r < batch->runs.size(); ++r) {
+            const Atlas *atlas = batch->runs[r].atlas;
+            for (int i = 0; i < atlas->rc; ++i) {
+                const AtlasRange &range = atlas->ranges[i];
+                if (range.page != page) {
+                    continue;
+                }
+                int quad = range.first / 6;
+                int quads = range.count / 6;
+                for (int q = quad; q < quad + quads; ++q) {
+                    auto base = (GLuint) batch->vertices.size();
+                    for (int v = 0; v < 4; ++v) {
+                        const Point &p = atlas->vertices[q * 4 + v];
+                        batch->vertices.push_back({p.x, p.y, p.s, p.t, (GLuint) r});
+                    }
+                    GLuint quadIndices[] = {base, base + 1, base + 2, base, base + 2, base + 3};
+                    batch->indices.insert(batch->indices.end(), quadIndices, quadIndices + 6);
+                }
+            }
+        }
+        int count = (int) batch->indices.size() - first;
+        if (count) {
+            batch->ranges.push_back({page, first, count});
+        }
+    }
+
+    PROFILE_COUNT("upload_bytes",
+                  batch->vertices.size() * sizeof(BatchVertex) + batch->indices.size() * sizeof(GLuint));
+    glBindBuffer(GL_ARRAY_BUFFER, batch->vbo);
+    glBufferData(GL_ARRAY_BUFFER, batch->vertices.size() * sizeof(BatchVertex), batch->vertices.data(),
+                 GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(batch->vao);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, batch->indices.size() * sizeof(GLuint), batch->indices.data(),
+                 GL_STATIC_DRAW);
+    glBindVertexArray(0);
+}
+
+static void uploadRuns(TextBatch *batch) {
+    batch->runData.clear();
+    for (const auto &run : batch->runs) {
+        batch->runData.insert(batch->runData.end(), run.transform, run.transform + 8);
+        batch->runData.insert(batch->runData.end(), run.color, run.color + 4);
+    }
+    PROFILE_COUNT("upload_bytes", batch->runData.size() * sizeof(GLfloat));
+    glBindBuffer(GL_TEXTURE_BUFFER, batch->runBuffer);
+    glBufferData(GL_TEXTURE_BUFFER, batch->runData.size() * sizeof(GLfloat), batch->runData.data(),
+                 GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void drawTextBatch(TextBatch *batch, GlyphCache *glyphCache) {
+    PROFILE_GPU_SCOPE("draw_batch");
+    for (auto &run : batch->runs) {
+        if (isAtlasStale(run.atlas, glyphCache)) {
+            buildAtlas(run.atlas, glyphCache);
+            batch->geometryDirty = true;
+        }
+    }
+    if (batch->geometryDirty) {
+        rebuildGeometry(batch, glyphCache);
+        batch->geometryDirty = false;
+    }
+    if (batch->runsDirty) {
+        uploadRuns(batch);
+        batch->runsDirty = false;
+    }
+    if (batch->ranges.empty()) {
+        return;
+    }
+
+    glUseProgram(batch->program);
+    glBindVertexArray(batch->vao);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, batch->runTexture);
+    glActiveTexture(GL_TEXTURE0);
+    for (const auto &range : batch->ranges) {
+        touchGlyphPage(glyphCache, range.page);
+        bindGlyphPage(glyphCache, range.page);
+        glDrawElements(GL_TRIANGLES, range.count, GL_UNSIGNED_INT, (void *) (range.first * sizeof(GLuint)));
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef TEXT_BATCH_H
+#define TEXT_BATCH_H
+
+#include <vector>
+#include <glad/glad.h>
+#include "atlas.h"
+#include "glyph_cache.h"
+
+struct BatchVertex {
+    GLfloat x;
+    GLfloat y;
+    GLfloat s;
+    GLfloat t;
+    GLuint run;
+};
+
+struct TextRun {
+    Atlas *atlas;
+    GLfloat transform[8];   // mat2 columns, then translation and padding
+    GLfloat color[4];
+};
+
+struct BatchRange {
+    int page;
+    int first;
+    int count;
+};
+
+/*
+ * Retained renderer for static text. Quads are uploaded once and stay on the
+ * GPU; color and transform live per run in a texture buffer the vertex
+ * shader reads through the run id, so changing them never touches geometry.
+ * Every run sharing an atlas page is drawn with one glDrawElements.
+ */
+struct TextBatch {
+    GLuint program;
+    GLuint vao;
+    GLuint vbo;
+    GLuint ibo;
+    GLuint runBuffer;
+    GLuint runTexture;
+    std::vector<TextRun> runs;
+    std::vector<BatchRange> ranges;
+    std::vector<BatchVertex> vertices;
+    std::vector<GLuint> indices;
+    std::vector<GLfloat> runData;
+    bool geometryDirty;
+    bool runsDirty;
+};
+
+// program is built from res/vs_batch.glsl and res/fs_batch.glsl.
+TextBatch *createTextBatch(GLuint program);
+
+void destroyTextBatch(TextBatch *batch);
+
+// The batch keeps the atlas pointer and rebuilds it when its pages recycle.
+int addTextRun(TextBatch *batch, Atlas *atlas, float r, float g, float b, float a = 1.0f);
+
+void setTextRunColor(TextBatch *batch, int run, float r, float g, float b, float a = 1.0f);
+
+// Affine transform applied to the run's quads: [a c tx; b d ty].
+void setTextRunTransform(TextBatch *batch, int run, float a, float b, float c, float d, float tx, float ty);
+
+void clearTextBatch(TextBatch *batch);
+
+void drawTextBatch(TextBatch *batch, GlyphCache *glyphCache);
+
+#endif
@@ -0,0 +1,987 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+/*
+ * Times every stage of the text pipeline on its own over fixed corpora and
+ * prints the results as JSON: font load, shaping (cold, cached, 1 MB through
+ * FreeType's font functions and through the cached OT ones, and 1 MB across
+ * 1, 2, 4 ... threads with the speedup over one), line layout and re-wrapping
+ * of 1 MB, splitting it into fallback font runs, hit tests, FreeType
+ * rasterization, rect packing, glyph cache misses with the bytes and
+ * transfers their atlas uploads took, a warm start from a saved cache, vertex
+ * generation, the streamed GL draw, single edits to a 100k line document,
+ * scrolling a 64 MB file and CPU compositing with every blend kernel the
+ * machine runs.
+ * GL runs offscreen, through an EGL surfaceless context when built with
+ * TEXT_BENCH_EGL, otherwise in a hidden GLFW window; vsync never applies.
+ *
+ *   text_bench [output.json]
+ *
+ * Allocations count operator new plus everything FreeType allocates through
+ * the bench's FT_Memory; HarfBuzz's own mallocs are not seen.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include <glad/glad.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include FT_MODULE_H
+#include "hb-ft.h"
+#include "arena.h"
+#include "atlas.h"
+#include "font_collection.h"
+#include "parallel_shaper.h"
+#include "cpu_renderer.h"
+#include "glyph_cache.h"
+#include "shape_cache.h"
+#include "shader.h"
+#include "stream_buffer.h"
+#include "text.h"
+#include "text_document.h"
+#include "text_layout.h"
+#include "text_view.h"
+#include "thread_pool.h"
+
+#ifdef TEXT_BENCH_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+static const unsigned int TEXT_SIZE = 32;
+static const float WRAP_WIDTH = 1000;
+static const int ATLAS_PAGE_SIZE = 1024;
+static const int ATLAS_PAGE_COUNT = 4;
+static const size_t SHAPE_CACHE_CAPACITY = 4096;
+static const GLsizeiptr STREAM_SIZE = 12 * 1024 * 1024;
+static const int TARGET_SIZE = 1024;
+// every stage repeats until it ran this long, within the iteration bounds
+static const double MIN_STAGE_NS = 250e6;
+static const int MIN_ITERATIONS = 3;
+static const int MAX_ITERATIONS = 2000;
+static const int DOCUMENT_LINES = 100000;
+static const size_t LAYOUT_BYTES = 1 << 20;
+static const int HIT_TESTS = 1000;
+static const size_t FRAME_LABELS = 32;
+static const size_t VIEW_BYTES = 64 << 20;
+static const char *VIEW_FILE = "text_bench_view.txt";
+static const char *GLYPH_CACHE_FILE = "text_bench_glyphs.bin";
+static const char *FALLBACK_FONTS[] = {"fonts/fzhtjt.ttf", "fonts/NotoEmoji-Regular.ttf", "fonts/entypo.ttf"};
+
+static std::atomic<unsigned long> allocations(0);
+static std::atomic<unsigned long> allocatedBytes(0);
+
+void *operator new(size_t size) {
+    allocations++;
+    allocatedBytes += size;
+    void *p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void *operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    free(p);
+}
+
+static void *ftAlloc(FT_Memory, long size) {
+    allocations++;
+    allocatedBytes += size;
+    return malloc((size_t) size);
+}
+
+static void ftFree(FT_Memory, void *block) {
+    free(block);
+}
+
+static void *ftRealloc(FT_Memory, long, long size, void *block) {
+    allocations++;
+    allocatedBytes += size;
+    return realloc(block, (size_t) size);
+}
+
+static FT_MemoryRec_ ftMemory = {nullptr, ftAlloc, ftFree, ftRealloc};
+
+struct Corpus {
+    const char *name;
+    const char *font;
+    HBText text;
+};
+
+struct Stage {
+    std::string name;
+    const char *unit;
+    long units;             // per iteration
+    int iterations;
+    double ns;              // per iteration
+    double allocations;     // per iteration
+    double bytes;
+    double speedup;         // over the same work on one thread or font functions, 0 when not compared
+    double uploadBytes;     // per iteration, texels sent to atlas pages
+    double uploadCalls;     // per iteration, transfers they went in
+};
+
+struct CorpusResult {
+    const char *name;
+    const char *font;
+    size_t bytes;
+    long glyphs;
+    long uniqueGlyphs;
+    std::vector<Stage> stages;
+};
+
+/*
+ * Runs setup, the timed body and teardown until the stage has been timed for
+ * long enough. Only the body counts towards time and allocations.
+ */
+static Stage measure(const char *name, const char *unit, long units, const std::function<void()> &body,
+                     const std::function<void()> &setup = nullptr,
+                     const std::function<void()> &teardown = nullptr) {
+    Stage stage = {name, unit, units, 0, 0, 0, 0, 0, 0, 0};
+    double ns = 0;
+    unsigned long allocs = 0, bytes = 0;
+    while (stage.iterations < MAX_ITERATIONS && (stage.iterations < MIN_ITERATIONS || ns < MIN_STAGE_NS)) {
+        if (setup) {
+            setup();
+        }
+        unsigned long a = allocations, b = allocatedBytes;
+        auto start = std::chrono::steady_clock::now();
+        body();
+        ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        allocs += allocations - a;
+        bytes += allocatedBytes - b;
+        if (teardown) {
+            teardown();
+        }
+        stage.iterations++;
+    }
+    stage.ns = ns / stage.iterations;
+    stage.allocations = (double) allocs / stage.iterations;
+    stage.bytes = (double) bytes / stage.iterations;
+    return stage;
+}
+
+static std::string encodeUtf8(unsigned int cp) {
+    std::string out;
+    if (cp < 0x80) {
+        out += (char) cp;
+    } else if (cp < 0x800) {
+        out += (char) (0xc0 | (cp >> 6));
+        out += (char) (0x80 | (cp & 0x3f));
+    } else if (cp < 0x10000) {
+        out += (char) (0xe0 | (cp >> 12));
+        out += (char) (0x80 | ((cp >> 6) & 0x3f));
+        out += (char) (0x80 | (cp & 0x3f));
+    } else {
+        out += (char) (0xf0 | (cp >> 18));
+        out += (char) (0x80 | ((cp >> 12) & 0x3f));
+        out += (char) (0x80 | ((cp >> 6) & 0x3f));
+        out += (char) (0x80 | (cp & 0x3f));
+    }
+    return out;
+}
+
+static std::string repeat(const std::string &text, int times) {
+    std::string out;
+    for (int i = 0; i < times; ++i) {
+        out += text;
+    }
+    return out;
+}
+
+static std::vector<Corpus> loadCorpora() {
+    std::string latin =
+            "The quick brown fox jumps over the lazy dog. Pack my box with five dozen liquor jugs! "
+            "How vexingly quick daft zebras jump; sphinx of black quartz, judge my vow. "
+            "Modern text rendering shapes runs with HarfBuzz, rasterizes glyphs with FreeType "
+            "and packs them into a texture atlas before a single draw call puts them on screen.\n";
+    std::string han = "现代文本渲染：FreeType\n";
+    std::string mixed =
+            "文本渲染的第一步是字形整形（shaping），HarfBuzz 根据字体的 GSUB 与 GPOS 表把 Unicode "
+            "字符序列变成字形序列和位置。第二步由 FreeType 把每个字形的轮廓光栅化成位图，"
+            "再用 stb_rect_pack 装进纹理图集。The atlas is shared by every string, so a "
+            "paragraph that repeats 常用汉字 only pays for rasterization once; 之后每一帧只需要"
+            "生成顶点并提交 draw call。\n"
+            "排版引擎还要处理换行、行高与字间距，mixed scripts like 中文 English 混排 and "
+            "punctuation such as “引号”、《书名号》 and (parentheses) all take part.\n";
+    std::string emoji;
+    for (unsigned int cp = 0x1f600; cp <= 0x1f64f; ++cp) {
+        emoji += encodeUtf8(cp);
+    }
+    for (unsigned int cp = 0x1f680; cp <= 0x1f6c5; ++cp) {
+        emoji += encodeUtf8(cp);
+    }
+    for (unsigned int cp = 0x2600; cp <= 0x26ff; cp += 3) {
+        emoji += encodeUtf8(cp);
+    }
+    emoji += "\n";
+
+    return {
+            {"latin", "fonts/fzhtjt.ttf", {repeat(latin, 8), "en", HB_SCRIPT_LATIN, HB_DIRECTION_LTR, 0}},
+            {"han", "fonts/fzhtjt.ttf", {repeat(han, 40), "zh", HB_SCRIPT_HAN, HB_DIRECTION_LTR, 0}},
+            {"mixed", "fonts/fzhtjt.ttf", {repeat(mixed, 8), "zh", HB_SCRIPT_HAN, HB_DIRECTION_LTR, 0}},
+            {"emoji", "fonts/NotoEmoji-Regular.ttf", {repeat(emoji, 4), "en", HB_SCRIPT_COMMON, HB_DIRECTION_LTR, 0}}
+    };
+}
+
+static void drawAtlas(const Atlas *atlas, GlyphCache *cache, StreamBuffer *stream, GLuint vao) {
+    int regionQuads = (int) (stream->regionSize / (4 * sizeof(Point)));
+    glBindVertexArray(vao);
+    for (int i = 0; i < atlas->rc; ++i) {
+        const AtlasRange &range = atlas->ranges[i];
+        bindGlyphPage(cache, range.page);
+        int first = range.first / 6;
+        int last = first + range.count / 6;
+        while (first < last) {
+            int quads = std::min(last - first, regionQuads);
+            GLsizeiptr bytes = quads * 4 * sizeof(Point);
+            GLintptr offset;
+            void *dst = mapStream(stream, bytes, sizeof(Point), &offset);
+            memcpy(dst, atlas->vertices + first * 4, bytes);
+            unmapStream(stream);
+            glDrawElementsBaseVertex(GL_TRIANGLES, quads * 6, GL_UNSIGNED_INT, nullptr,
+                                     (GLint) (offset / sizeof(Point)));
+            first += quads;
+        }
+    }
+    glBindVertexArray(0);
+}
+
+// Framebuffer pixels the CPU renderer blends for atlas, after clipping.
+static long coveredPixels(CPURenderer *cpu, const Atlas *atlas) {
+    long pixels = 0;
+    const GlyphRun &run = atlas->run;
+    for (int f = 0; f < run.faceCount; ++f) {
+        for (int i = run.faces[f].first, end = faceRunEnd(&run, f); i < end; ++i) {
+            const Glyph *glyph = cacheGlyph(cpu->glyphCache, run.faces[f].face, run.glyphs[i], atlas->size);
+            if (glyph->page < 0) {
+                continue;
+            }
+            int x0 = (int) std::lround(run.x[i] + glyph->left);
+            int row0 = cpu->height - (int) std::floor(run.y[i] + glyph->top);
+            int w = std::min(x0 + glyph->w, cpu->width) - std::max(x0, 0);
+            int h = std::min(row0 + glyph->h, cpu->height) - std::max(row0, 0);
+            if (w > 0 && h > 0) {
+                pixels += (long) w * h;
+            }
+        }
+    }
+    return pixels;
+}
+
+static bool isSameShaping(const std::vector<hb_glyph_info_t> &infos, const std::vector<hb_glyph_position_t> &positions,
+                          const std::vector<FaceRun> &faces, const std::vector<hb_glyph_info_t> &otherInfos,
+                          const std::vector<hb_glyph_position_t> &otherPositions,
+                          const std::vector<FaceRun> &otherFaces) {
+    if (infos.size() != otherInfos.size() || faces.size() != otherFaces.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < infos.size(); ++i) {
+        const hb_glyph_position_t &a = positions[i], &b = otherPositions[i];
+        if (infos[i].codepoint != otherInfos[i].codepoint || infos[i].cluster != otherInfos[i].cluster ||
+            a.x_advance != b.x_advance || a.y_advance != b.y_advance || a.x_offset != b.x_offset ||
+            a.y_offset != b.y_offset) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < faces.size(); ++i) {
+        if (faces[i].first != otherFaces[i].first || faces[i].face != otherFaces[i].face) {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct GLState {
+    GLuint program;
+    GLuint instancedProgram;
+    GLuint vao;
+    GLuint ibo;
+    GLuint fbo;
+    GLuint color;
+    StreamBuffer *stream;
+};
+
+static void runCorpus(const Corpus &corpus, FT_Library library, ThreadPool *pool, GLState &gl,
+                      CorpusResult &result) {
+    result.name = corpus.name;
+    result.font = corpus.font;
+    result.bytes = corpus.text.data.size();
+    // includes walking the cmap into the coverage bitset
+    result.stages.push_back(measure("font_load", "load", 1, [&] {
+        FontCollection *fonts = createFontCollection(library);
+        addFontFace(fonts, corpus.font);
+        destroyFontCollection(fonts);
+    }));
+
+    FontCollection *fonts = createFontCollection(library);
+    if (addFontFace(fonts, corpus.font) < 0) {
+        fprintf(stderr, "text_bench: can not load %s\n", corpus.font);
+        destroyFontCollection(fonts);
+        return;
+    }
+    setFontSize(fonts, TEXT_SIZE);
+    const FontFace &loaded = fonts->faces[0];
+    FT_Face face = loaded.face;
+    // shaping leaves the face alone; the raster stages load at this size
+    FT_Set_Pixel_Sizes(face, 0, TEXT_SIZE);
+    hb_font_t *font = loaded.font;
+    FontFile fontFile = {loaded.path, loaded.index, loaded.file->data, loaded.file->size, loaded.hash};
+    std::vector<FaceRun> faces = {{0, face}};
+    TextSpan text = textSpan(corpus.text);
+
+    std::vector<hb_glyph_info_t> infos;
+    std::vector<hb_glyph_position_t> positions;
+    ShapeCache *shapes = createShapeCache(SHAPE_CACHE_CAPACITY);
+    shapeText(shapes, font, TEXT_SIZE, text, infos, positions);
+    long glyphs = (long) infos.size();
+    std::vector<unsigned int> unique;
+    for (const auto &info : infos) {
+        unique.push_back(info.codepoint);
+    }
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    long uniqueGlyphs = (long) unique.size();
+    result.glyphs = glyphs;
+    result.uniqueGlyphs = uniqueGlyphs;
+
+    ShapeCache *cold = nullptr;
+    result.stages.push_back(measure("shape", "glyph", glyphs, [&] {
+        shapeText(cold, font, TEXT_SIZE, text, infos, positions);
+    }, [&] {
+        cold = createShapeCache(SHAPE_CACHE_CAPACITY);
+    }, [&] {
+        destroyShapeCache(cold);
+    }));
+    result.stages.push_back(measure("shape_cached", "glyph", glyphs, [&] {
+        shapeText(shapes, font, TEXT_SIZE, text, infos, positions);
+    }));
+
+    // break opportunities, pen positions and lines for about 1 MB of text;
+    // rewrap only walks the cached breaks again at another width
+    HBText big = corpus.text;
+    big.data = repeat(corpus.text.data, (int) (LAYOUT_BYTES / corpus.text.data.size()) + 1);
+    std::vector<hb_glyph_info_t> bigInfos;
+    std::vector<hb_glyph_position_t> bigPositions;
+    shapeText(shapes, font, TEXT_SIZE, textSpan(big), bigInfos, bigPositions);
+
+    // the megabyte through hb_shape() whole, no word cache: every advance
+    // from FreeType as hb-ft gets it, then from the collection's cached OT metrics
+    hb_font_t *ftFont = hb_ft_font_create(face, nullptr);
+    hb_font_set_ppem(ftFont, TEXT_SIZE, TEXT_SIZE);
+    hb_font_set_scale(ftFont, TEXT_SIZE << 6, TEXT_SIZE << 6);
+    hb_buffer_t *buffer = hb_buffer_create();
+    auto shapeWhole = [&](hb_font_t *with) {
+        hb_buffer_clear_contents(buffer);
+        hb_buffer_set_direction(buffer, big.direction);
+        hb_buffer_set_script(buffer, big.script);
+        hb_buffer_set_language(buffer, hb_language_from_string(big.language.c_str(), -1));
+        hb_buffer_add_utf8(buffer, big.data.data(), (int) big.data.size(), 0, (int) big.data.size());
+        hb_shape(with, buffer, nullptr, 0);
+    };
+    result.stages.push_back(measure("shape_ft_1mb", "byte", (long) big.data.size(), [&] {
+        shapeWhole(ftFont);
+    }));
+    std::vector<hb_codepoint_t> ftGlyphs;
+    unsigned int count;
+    hb_glyph_info_t *shaped = hb_buffer_get_glyph_infos(buffer, &count);
+    for (unsigned int i = 0; i < count; ++i) {
+        ftGlyphs.push_back(shaped[i].codepoint);
+    }
+    Stage ot = measure("shape_ot_1mb", "byte", (long) big.data.size(), [&] {
+        shapeWhole(font);
+    });
+    ot.speedup = result.stages.back().ns / ot.ns;
+    result.stages.push_back(ot);
+    shaped = hb_buffer_get_glyph_infos(buffer, &count);
+    for (unsigned int i = 0; i < count; ++i) {
+        if (count != ftGlyphs.size() || shaped[i].codepoint != ftGlyphs[i]) {
+            fprintf(stderr, "text_bench: %s shapes to other glyphs without FreeType\n", corpus.name);
+            break;
+        }
+    }
+    hb_buffer_destroy(buffer);
+    hb_font_destroy(ftFont);
+
+    ParagraphLayout layout;
+    result.stages.push_back(measure("layout_1mb", "byte", (long) big.data.size(), [&] {
+        layoutParagraph(&layout, textSpan(big), bigInfos, bigPositions, faces, TEXT_SIZE, 1.0f, WRAP_WIDTH);
+    }));
+    float width = WRAP_WIDTH;
+    result.stages.push_back(measure("rewrap_1mb", "glyph", (long) bigInfos.size(), [&] {
+        width = width == WRAP_WIDTH ? WRAP_WIDTH * 0.75f : WRAP_WIDTH;
+        wrapParagraph(&layout, width);
+    }));
+    float layoutWidth, layoutHeight;
+    measureParagraph(&layout, &layoutWidth, &layoutHeight);
+    result.stages.push_back(measure("hit_test", "query", HIT_TESTS, [&] {
+        for (int i = 0; i < HIT_TESTS; ++i) {
+            float x, y;
+            size_t cluster = hitTestParagraph(&layout, (float) (i * 37 % 1000), -layoutHeight * i / HIT_TESTS);
+            caretPosition(&layout, cluster, &x, &y);
+        }
+    }));
+    std::vector<hb_glyph_info_t>().swap(bigInfos);
+    std::vector<hb_glyph_position_t>().swap(bigPositions);
+    layoutParagraph(&layout, text, infos, positions, faces, TEXT_SIZE, 1.0f, WRAP_WIDTH);
+
+    // resolving every character through the whole fallback chain
+    FontCollection *chain = createFontCollection(library);
+    for (auto path : FALLBACK_FONTS) {
+        addFontFace(chain, path);
+    }
+    std::vector<FontRun> runs;
+    result.stages.push_back(measure("font_runs_1mb", "byte", (long) big.data.size(), [&] {
+        splitFontRuns(chain, big.data.data(), big.data.size(), runs);
+    }));
+
+    // the same megabyte through the whole chain on 1, 2, 4 ... threads, up to
+    // the machine's, every time with cold shape caches; t1 is plain serial
+    // shaping and every count has to give exactly its glyphs
+    std::vector<hb_glyph_info_t> serialInfos, parallelInfos;
+    std::vector<hb_glyph_position_t> serialPositions, parallelPositions;
+    std::vector<FaceRun> serialFaces, parallelFaces;
+    ShapeCache *serialCache = createShapeCache(SHAPE_CACHE_CAPACITY);
+    shapeFontRuns(chain, serialCache, TEXT_SIZE, textSpan(big), serialInfos, serialPositions, serialFaces);
+    destroyShapeCache(serialCache);
+    int hardwareThreads = std::max(1, (int) std::thread::hardware_concurrency());
+    double serialNs = 0;
+    for (int threads = 1;; threads = std::min(threads * 2, hardwareThreads)) {
+        ThreadPool *shapePool = threads > 1 ? createThreadPool(threads - 1) : nullptr;
+        ParallelShaper *shaper = nullptr;
+        ShapeCache *coldCache = nullptr;
+        std::string name = "shape_parallel_1mb_t" + std::to_string(threads);
+        Stage stage = measure(name.c_str(), "byte", (long) big.data.size(), [&] {
+            shapeParallel(shaper, coldCache, TEXT_SIZE, textSpan(big), parallelInfos, parallelPositions,
+                          parallelFaces);
+        }, [&] {
+            shaper = createParallelShaper(chain, shapePool, SHAPE_CACHE_CAPACITY);
+            coldCache = createShapeCache(SHAPE_CACHE_CAPACITY);
+        }, [&] {
+            destroyShapeCache(coldCache);
+            destroyParallelShaper(shaper);
+        });
+        if (threads == 1) {
+            serialNs = stage.ns;
+        }
+        stage.speedup = serialNs / stage.ns;
+        result.stages.push_back(stage);
+        if (!isSameShaping(serialInfos, serialPositions, serialFaces, parallelInfos, parallelPositions,
+                           parallelFaces)) {
+            fprintf(stderr, "text_bench: %s shapes %s differently from serial shaping\n", name.c_str(), corpus.name);
+        }
+        if (shapePool) {
+            destroyThreadPool(shapePool);
+        }
+        if (threads == hardwareThreads) {
+            break;
+        }
+    }
+    destroyFontCollection(chain);
+
+    std::vector<stbrp_rect> rects;
+    for (auto glyph : unique) {
+        stbrp_rect rect = {};
+        if (!FT_Load_Glyph(face, glyph, FT_LOAD_RENDER) && face->glyph->bitmap.width) {
+            rect.w = (stbrp_coord) (face->glyph->bitmap.width + 1);
+            rect.h = (stbrp_coord) (face->glyph->bitmap.rows + 1);
+            rects.push_back(rect);
+        }
+    }
+    result.stages.push_back(measure("raster", "glyph", uniqueGlyphs, [&] {
+        for (auto glyph : unique) {
+            FT_Load_Glyph(face, glyph, FT_LOAD_RENDER);
+        }
+    }));
+
+    stbrp_context packer;
+    std::vector<stbrp_node> nodes(ATLAS_PAGE_SIZE);
+    result.stages.push_back(measure("pack", "glyph", (long) rects.size(), [&] {
+        stbrp_init_target(&packer, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, nodes.data(), (int) nodes.size());
+        for (auto &rect : rects) {
+            stbrp_pack_rects(&packer, &rect, 1);
+            if (!rect.was_packed) {
+                stbrp_init_target(&packer, ATLAS_PAGE_SIZE, ATLAS_PAGE_SIZE, nodes.data(), (int) nodes.size());
+                stbrp_pack_rects(&packer, &rect, 1);
+            }
+        }
+    }));
+
+    // wrapped and placed the way renderText() does it
+    Arena *arena = createArena();
+    Atlas *atlas = createAtlas(arena, &layout, 0, TARGET_SIZE - (float) TEXT_SIZE, GLYPH_BITMAP, ATLAS_PAGE_COUNT);
+    GlyphCache *cache = nullptr;
+    unsigned long uploadBytes = 0, uploadCalls = 0;
+    auto createCache = [&] {
+        cache = createGlyphCache(ATLAS_PAGE_SIZE, ATLAS_PAGE_COUNT);
+        // clearing the new pages is not what the stages time
+        flushGlyphUploads(cache);
+        cache->uploadedBytes = 0;
+        cache->uploadCalls = 0;
+        glFinish();
+    };
+    auto destroyCache = [&] {
+        uploadBytes += cache->uploadedBytes;
+        uploadCalls += cache->uploadCalls;
+        destroyGlyphCache(cache);
+    };
+    auto countUploads = [&](Stage stage) {
+        stage.uploadBytes = (double) uploadBytes / stage.iterations;
+        stage.uploadCalls = (double) uploadCalls / stage.iterations;
+        uploadBytes = 0;
+        uploadCalls = 0;
+        return stage;
+    };
+    result.stages.push_back(countUploads(measure("cache_cold", "glyph", uniqueGlyphs, [&] {
+        buildAtlas(atlas, cache);
+        flushGlyphUploads(cache);
+        glFinish();
+    }, createCache, destroyCache)));
+
+    if (pool && !pool->threads.empty()) {
+        std::string name = "cache_cold_pool_" + std::to_string(pool->threads.size());
+        result.stages.push_back(countUploads(measure(name.c_str(), "glyph", uniqueGlyphs, [&] {
+            buildAtlas(atlas, cache);
+            while (cache->inFlight) {
+                waitRasterizedGlyphs(cache);
+                uploadRasterizedGlyphs(cache);
+            }
+            buildAtlas(atlas, cache);
+            flushGlyphUploads(cache);
+            glFinish();
+        }, [&] {
+            createCache();
+            cache->pool = pool;
+            addFontFile(cache, face, fontFile);
+        }, destroyCache)));
+    }
+
+    // what a restart finds: the pages and glyphs the last run saved
+    createCache();
+    addFontFile(cache, face, fontFile);
+    buildAtlas(atlas, cache);
+    bool saved = saveGlyphCache(cache, GLYPH_CACHE_FILE);
+    destroyCache();
+    uploadBytes = 0;
+    uploadCalls = 0;
+    if (saved) {
+        result.stages.push_back(countUploads(measure("cache_warm", "glyph", uniqueGlyphs, [&] {
+            loadGlyphCache(cache, GLYPH_CACHE_FILE);
+            buildAtlas(atlas, cache);
+            flushGlyphUploads(cache);
+            glFinish();
+        }, [&] {
+            createCache();
+            addFontFile(cache, face, fontFile);
+        }, destroyCache)));
+        remove(GLYPH_CACHE_FILE);
+    }
+
+    createCache();
+    buildAtlas(atlas, cache);
+    flushGlyphUploads(cache);
+    result.stages.push_back(measure("vertices", "glyph", glyphs, [&] {
+        buildAtlas(atlas, cache);
+    }));
+
+    // a frame of short labels built from scratch: shape, lay out, place and
+    // build quads, with the arena reset instead of anything freed. Once the
+    // scratch vectors have grown this should not allocate at all
+    std::vector<TextSpan> labels;
+    long labelGlyphs = 0;
+    for (size_t start = 0; start < text.length && labels.size() < FRAME_LABELS;) {
+        size_t end = corpus.text.data.find('\n', start);
+        end = end == std::string::npos ? text.length : end;
+        labels.push_back(sliceText(text, start, end));
+        start = end + 1;
+    }
+    Arena *frameArena = createArena();
+    ParagraphLayout labelLayout;
+    auto frame = [&] {
+        resetArena(frameArena);
+        labelGlyphs = 0;
+        for (size_t i = 0; i < labels.size(); ++i) {
+            shapeText(shapes, font, TEXT_SIZE, labels[i], infos, positions);
+            layoutParagraph(&labelLayout, labels[i], infos, positions, faces, TEXT_SIZE);
+            Atlas *label = createAtlas(frameArena, &labelLayout, 0, TARGET_SIZE - (float) TEXT_SIZE * (i + 1),
+                                       GLYPH_BITMAP, ATLAS_PAGE_COUNT);
+            buildAtlas(label, cache);
+            labelGlyphs += label->run.count;
+        }
+    };
+    frame();
+    result.stages.push_back(measure("frame_labels", "glyph", labelGlyphs, frame));
+    destroyArena(frameArena);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, gl.fbo);
+    glUseProgram(gl.program);
+    result.stages.push_back(measure("draw", "glyph", atlas->vc / 4, [&] {
+        glClear(GL_COLOR_BUFFER_BIT);
+        drawAtlas(atlas, cache, gl.stream, gl.vao);
+        glFinish();
+    }));
+    glUseProgram(0);
+
+    // keystroke to pixel in the middle of a document, at two lengths to show
+    // the cost does not follow them. The edit stages time until the changed
+    // line is reshaped and patched on the GPU, edit_redraw adds drawing the view
+    std::string line = corpus.text.data.substr(0, corpus.text.data.find('\n'));
+    const char *typed = "typing ";
+    for (int lines : {1000, DOCUMENT_LINES}) {
+        HBText document = corpus.text;
+        document.data = repeat(line + "\n", lines - 1) + line;
+        TextDocument *doc = createTextDocument(gl.instancedProgram, cache, document, fonts, TEXT_SIZE, 1.2f);
+        int cursor = lines / 2;
+        size_t column = 4;
+        doc->y = TARGET_SIZE - (float) TEXT_SIZE;
+        doc->top = TARGET_SIZE;
+        doc->scroll = cursor * documentLineAdvance(doc);
+        drawTextDocument(doc, cache, shapes);
+        auto idle = [] {
+            glFinish();
+        };
+        std::string suffix = "_" + std::to_string(lines / 1000) + "k";
+        result.stages.push_back(measure(("edit_keystroke" + suffix).c_str(), "edit", 1, [&] {
+            insertText(doc, cursor, column, typed + column % 7, 1);
+            column++;
+            updateTextDocument(doc, cache, shapes);
+        }, idle));
+        result.stages.push_back(measure(("edit_newline" + suffix).c_str(), "edit", 1, [&] {
+            insertText(doc, cursor, column, "\n", 1);
+            updateTextDocument(doc, cache, shapes);
+        }, idle, [&] {
+            // join the lines again so every iteration sees the same screen
+            eraseText(doc, cursor, column, 1);
+            updateTextDocument(doc, cache, shapes);
+        }));
+        if (lines == DOCUMENT_LINES) {
+            result.stages.push_back(measure("edit_redraw", "edit", 1, [&] {
+                glClear(GL_COLOR_BUFFER_BIT);
+                drawTextDocument(doc, cache, shapes);
+                glFinish();
+            }));
+        }
+        destroyTextDocument(doc);
+    }
+
+    // a file far bigger than the screen, only ever mapped: opening it, then
+    // scrolling by a line and by a page, then a first jump to its middle,
+    // which has to run the line index that far
+    FILE *log = fopen(VIEW_FILE, "wb");
+    if (log) {
+        std::string block = repeat(line + "\n", (int) (LAYOUT_BYTES / (line.size() + 1)) + 1);
+        for (size_t written = 0; written < VIEW_BYTES; written += block.size()) {
+            fwrite(block.data(), 1, block.size(), log);
+        }
+        fclose(log);
+        long lines = (long) (VIEW_BYTES / block.size() + 1) * (long) (block.size() / (line.size() + 1));
+        std::string suffix = "_" + std::to_string(VIEW_BYTES >> 20) + "mb";
+        TextView *view = nullptr;
+        auto open = [&] {
+            view = openTextView(VIEW_FILE, gl.instancedProgram, cache, corpus.text, fonts, TEXT_SIZE, 1.2f);
+            view->y = TARGET_SIZE - (float) TEXT_SIZE;
+            view->top = TARGET_SIZE;
+        };
+        auto close = [&] {
+            closeTextView(view);
+        };
+        result.stages.push_back(measure(("view_open" + suffix).c_str(), "open", 1, [&] {
+            open();
+        }, nullptr, close));
+        open();
+        drawTextView(view, cache, shapes);
+        result.stages.push_back(measure("view_scroll_line", "frame", 1, [&] {
+            view->scroll += viewLineAdvance(view);
+            updateTextView(view, cache, shapes);
+        }, [] {
+            glFinish();
+        }));
+        result.stages.push_back(measure("view_scroll_page", "frame", 1, [&] {
+            view->scroll += TARGET_SIZE;
+            updateTextView(view, cache, shapes);
+        }, [] {
+            glFinish();
+        }));
+        close();
+        result.stages.push_back(measure(("view_jump" + suffix).c_str(), "frame", 1, [&] {
+            view->scroll = lines / 2 * (double) viewLineAdvance(view);
+            updateTextView(view, cache, shapes);
+        }, [&] {
+            open();
+            glFinish();
+        }, close));
+        remove(VIEW_FILE);
+    }
+
+    GlyphCache *cpuCache = createGlyphCache(ATLAS_PAGE_SIZE, ATLAS_PAGE_COUNT, GLYPH_STORAGE_CPU);
+    CPURenderer *cpu = createCPURenderer(cpuCache, TARGET_SIZE, TARGET_SIZE, PIXEL_BGRA);
+    cpu->clear(1, 1, 1);
+    // the same text, resolved against the renderer's own cache so it draws from the atlas
+    Atlas *cpuAtlas = createAtlas(arena, &layout, 0, TARGET_SIZE - (float) TEXT_SIZE, GLYPH_BITMAP,
+                                  ATLAS_PAGE_COUNT);
+    buildAtlas(cpuAtlas, cpuCache);
+    long pixels = coveredPixels(cpu, cpuAtlas);
+    BlendKernel best = cpu->kernel;
+    for (int kernel = BLEND_SCALAR; kernel <= best; ++kernel) {
+        cpu->kernel = (BlendKernel) kernel;
+        std::string name = std::string("composite_") + blendKernelName(cpu->kernel);
+        result.stages.push_back(measure(name.c_str(), "pixel", pixels, [&] {
+            cpu->drawText(cpuAtlas, 0, 0, 0);
+        }));
+    }
+    destroyRenderer(cpu);
+    destroyGlyphCache(cpuCache);
+
+    destroyCache();
+    destroyArena(arena);
+    destroyShapeCache(shapes);
+    destroyFontCollection(fonts);
+}
+
+#ifdef TEXT_BENCH_EGL
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+
+static bool createContext() {
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (!eglInitialize(display, nullptr, nullptr) || !eglBindAPI(EGL_OPENGL_API)) {
+        return false;
+    }
+    EGLint configAttributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_SURFACE_TYPE, 0, EGL_NONE};
+    EGLConfig config = nullptr;
+    EGLint configs = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configs);
+    EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 3,
+            EGL_CONTEXT_MINOR_VERSION, 3,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+    };
+    // EGL_KHR_no_config_context covers platforms without any config
+    context = eglCreateContext(display, configs ? config : (EGLConfig) nullptr, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        return false;
+    }
+    return gladLoadGLLoader((GLADloadproc) eglGetProcAddress) != 0;
+}
+
+static void destroyContext() {
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(display, context);
+    eglTerminate(display);
+}
+
+static GLADloadproc procLoader() {
+    return (GLADloadproc) eglGetProcAddress;
+}
+#else
+static bool createContext() {
+    if (!glfwInit()) {
+        return false;
+    }
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "text_bench", nullptr, nullptr);
+    if (window == nullptr) {
+        return false;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    return gladLoadGLLoader((GLADloadproc) glfwGetProcAddress) != 0;
+}
+
+static void destroyContext() {
+    glfwTerminate();
+}
+
+static GLADloadproc procLoader() {
+    return (GLADloadproc) glfwGetProcAddress;
+}
+#endif
+
+static void initGLState(GLState &gl) {
+    // the default framebuffer may not exist, so everything draws offscreen
+    glGenFramebuffers(1, &gl.fbo);
+    glGenRenderbuffers(1, &gl.color);
+    glBindRenderbuffer(GL_RENDERBUFFER, gl.color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, TARGET_SIZE, TARGET_SIZE);
+    glBindFramebuffer(GL_FRAMEBUFFER, gl.fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, gl.color);
+    glViewport(0, 0, TARGET_SIZE, TARGET_SIZE);
+    glClearColor(1, 1, 1, 1);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    gl.program = shader_load("res/vs_texture.glsl", "res/fs_texture.glsl");
+    glUseProgram(gl.program);
+    GLfloat projection[] = {
+            2.0f / TARGET_SIZE, 0, 0, 0,
+            0, 2.0f / TARGET_SIZE, 0, 0,
+            0, 0, -1, 0,
+            -1, -1, 0, 1
+    };
+    glUniformMatrix4fv(glGetUniformLocation(gl.program, "projection"), 1, GL_FALSE, projection);
+    glUniform3f(glGetUniformLocation(gl.program, "textColor"), 0, 0, 0);
+    glUseProgram(0);
+
+    gl.instancedProgram = shader_load("res/vs_instanced.glsl", "res/fs_batch.glsl");
+    glUseProgram(gl.instancedProgram);
+    glUniformMatrix4fv(glGetUniformLocation(gl.instancedProgram, "projection"), 1, GL_FALSE, projection);
+    glUseProgram(0);
+
+    loadBufferStorage(procLoader());
+    gl.stream = createStreamBuffer(GL_ARRAY_BUFFER, STREAM_SIZE, true);
+    int quads = (int) (gl.stream->regionSize / (4 * sizeof(Point)));
+    std::vector<GLuint> indices((size_t) quads * 6);
+    for (int i = 0; i < quads; ++i) {
+        GLuint index = i * 4;
+        GLuint quad[] = {index, index + 1, index + 2, index, index + 2, index + 3};
+        std::copy(quad, quad + 6, indices.begin() + i * 6);
+    }
+    glGenVertexArrays(1, &gl.vao);
+    glGenBuffers(1, &gl.ibo);
+    glBindVertexArray(gl.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, gl.stream->buffer);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), nullptr);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gl.ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+static void destroyGLState(GLState &gl) {
+    destroyStreamBuffer(gl.stream);
+    glDeleteBuffers(1, &gl.ibo);
+    glDeleteVertexArrays(1, &gl.vao);
+    glDeleteProgram(gl.program);
+    glDeleteProgram(gl.instancedProgram);
+    glDeleteRenderbuffers(1, &gl.color);
+    glDeleteFramebuffers(1, &gl.fbo);
+}
+
+static long peakMemoryKB() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+    return (long) (counters.PeakWorkingSetSize / 1024);
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+static void writeJson(FILE *out, const char *renderer, int workers, const std::vector<CorpusResult> &results) {
+    fprintf(out, "{\n  \"renderer\": \"%s\",\n  \"text_size\": %u,\n  \"workers\": %d,\n", renderer, TEXT_SIZE,
+            workers);
+    fprintf(out, "  \"peak_memory_kb\": %ld,\n  \"corpora\": [\n", peakMemoryKB());
+    for (size_t c = 0; c < results.size(); ++c) {
+        const CorpusResult &corpus = results[c];
+        fprintf(out, "    {\n      \"name\": \"%s\",\n      \"font\": \"%s\",\n", corpus.name, corpus.font);
+        fprintf(out, "      \"bytes\": %zu,\n      \"glyphs\": %ld,\n      \"unique_glyphs\": %ld,\n",
+                corpus.bytes, corpus.glyphs, corpus.uniqueGlyphs);
+        fprintf(out, "      \"stages\": [\n");
+        for (size_t s = 0; s < corpus.stages.size(); ++s) {
+            const Stage &stage = corpus.stages[s];
+            double perUnit = stage.units ? stage.ns / stage.units : 0;
+            fprintf(out, "        {\"name\": \"%s\", \"unit\": \"%s\", \"units\": %ld, \"iterations\": %d, "
+                         "\"ns\": %.0f, \"ns_per_unit\": %.3f, \"units_per_sec\": %.0f, ",
+                    stage.name.c_str(), stage.unit, stage.units, stage.iterations, stage.ns, perUnit,
+                    perUnit > 0 ? 1e9 / perUnit : 0);
+            if (strcmp(stage.unit, "pixel") == 0) {
+                fprintf(out, "\"megapixels_per_sec\": %.1f, ", perUnit > 0 ? 1e3 / perUnit : 0);
+            }
+            if (stage.speedup > 0) {
+                fprintf(out, "\"speedup\": %.2f, ", stage.speedup);
+            }
+            if (stage.uploadCalls > 0) {
+                fprintf(out, "\"upload_bytes\": %.0f, \"upload_calls\": %.1f, ", stage.uploadBytes,
+                        stage.uploadCalls);
+            }
+            fprintf(out, "\"allocations\": %.1f, \"allocated_bytes\": %.0f}%s\n", stage.allocations, stage.bytes,
+                    s + 1 < corpus.stages.size() ? "," : "");
+        }
+        fprintf(out, "      ]\n    }%s\n", c + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+int main(int argc, char **argv) {
+    if (!createContext()) {
+        fprintf(stderr, "text_bench: no GL 3.3 core context\n");
+        return 1;
+    }
+    GLState gl;
+    initGLState(gl);
+
+    FT_Library library;
+    if (FT_New_Library(&ftMemory, &library)) {
+        fprintf(stderr, "text_bench: could not init FreeType\n");
+        return 1;
+    }
+    FT_Add_Default_Modules(library);
+    ThreadPool *pool = createThreadPool(0);
+
+    std::vector<CorpusResult> results;
+    for (const auto &corpus : loadCorpora()) {
+        CorpusResult result = {};
+        runCorpus(corpus, library, pool, gl, result);
+        results.push_back(result);
+    }
+
+    FILE *out = argc > 1 ? fopen(argv[1], "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "text_bench: can not write %s\n", argv[1]);
+        return 1;
+    }
+    writeJson(out, (const char *) glGetString(GL_RENDERER), (int) pool->threads.size(), results);
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    destroyThreadPool(pool);
+    FT_Done_Library(library);
+    destroyGLState(gl);
+    destroyContext();
+    return 0;
+}
@@ -0,0 +1,241 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include <cmath>
+#include "text_document.h"
+
+static const int INITIAL_CAPACITY = 64 * 1024;
+
+static Paragraph *createParagraph() {
+    auto p = new Paragraph;
+    p->length = 0;
+    p->dirty = true;
+    initLineSlot(&p->slot);
+    return p;
+}
+
+static void appendPiece(std::vector<TextPiece> &pieces, bool added, size_t start, size_t length) {
+    if (!length) {
+        return;
+    }
+    if (!pieces.empty()) {
+        TextPiece &last = pieces.back();
+        if (last.added == added && last.start + last.length == start) {
+            // typing keeps extending the same piece
+            last.length += length;
+            return;
+        }
+    }
+    pieces.push_back({added, start, length});
+}
+
+// Appends bytes [from, to) of pieces to out.
+static void slicePieces(const std::vector<TextPiece> &pieces, size_t from, size_t to, std::vector<TextPiece> &out) {
+    size_t offset = 0;
+    for (const auto &piece : pieces) {
+        size_t begin = std::max(from, offset);
+        size_t end = std::min(to, offset + piece.length);
+        if (begin < end) {
+            appendPiece(out, piece.added, piece.start + begin - offset, end - begin);
+        }
+        offset += piece.length;
+        if (offset >= to) {
+            break;
+        }
+    }
+}
+
+static void setPieces(Paragraph *p, std::vector<TextPiece> &pieces) {
+    p->pieces.swap(pieces);
+    p->length = 0;
+    for (const auto &piece : p->pieces) {
+        p->length += piece.length;
+    }
+    p->dirty = true;
+}
+
+TextDocument *createTextDocument(GLuint program, GlyphCache *glyphCache, const HBText &text, FontCollection *fonts,
+                                 unsigned int size, float lineHeight) {
+    auto doc = new TextDocument;
+    doc->original = text.data;
+    doc->style = text;
+    doc->style.data.clear();
+    doc->fonts = fonts;
+    doc->size = size;
+    doc->lineHeight = lineHeight;
+    doc->x = 0;
+    doc->y = 0;
+    doc->scroll = 0;
+    doc->top = 0;
+    doc->bottom = 0;
+    doc->color[0] = 0;
+    doc->color[1] = 0;
+    doc->color[2] = 0;
+    doc->color[3] = 255;
+    doc->reshaped = 0;
+
+    size_t start = 0;
+    for (;;) {
+        size_t end = doc->original.find('\n', start);
+        Paragraph *p = createParagraph();
+        size_t length = (end == std::string::npos ? doc->original.size() : end) - start;
+        appendPiece(p->pieces, false, start, length);
+        p->length = length;
+        doc->paragraphs.push_back(p);
+        if (end == std::string::npos) {
+            break;
+        }
+        start = end + 1;
+    }
+
+    doc->lines = createLineBuffer(program, glyphCache, INITIAL_CAPACITY);
+    return doc;
+}
+
+void destroyTextDocument(TextDocument *doc) {
+    for (auto p : doc->paragraphs) {
+        delete p;
+    }
+    destroyLineBuffer(doc->lines);
+    delete doc;
+}
+
+void insertText(TextDocument *doc, int line, size_t column, const char *text, size_t length) {
+    Paragraph *p = doc->paragraphs[line];
+    column = std::min(column, p->length);
+    std::vector<TextPiece> head, tail;
+    slicePieces(p->pieces, 0, column, head);
+    slicePieces(p->pieces, column, p->length, tail);
+
+    size_t base = doc->added.size();
+    doc->added.append(text, length);
+    std::vector<Paragraph *> created;
+    size_t start = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (text[i] != '\n') {
+            continue;
+        }
+        appendPiece(head, true, base + start, i - start);
+        Paragraph *target = created.empty() ? p : created.back();
+        setPieces(target, head);
+        head.clear();
+        created.push_back(createParagraph());
+        start = i + 1;
+    }
+    appendPiece(head, true, base + start, length - start);
+    for (const auto &piece : tail) {
+        appendPiece(head, piece.added, piece.start, piece.length);
+    }
+    setPieces(created.empty() ? p : created.back(), head);
+    doc->paragraphs.insert(doc->paragraphs.begin() + line + 1, created.begin(), created.end());
+}
+
+void eraseText(TextDocument *doc, int line, size_t column, size_t length) {
+    Paragraph *p = doc->paragraphs[line];
+    column = std::min(column, p->length);
+    int last = line;
+    size_t end = column;
+    for (;;) {
+        size_t take = std::min(length, doc->paragraphs[last]->length - end);
+        end += take;
+        length -= take;
+        if (!length || last + 1 == (int) doc->paragraphs.size()) {
+            break;
+        }
+        // the newline joins the next line in
+        length--;
+        last++;
+        end = 0;
+    }
+
+    std::vector<TextPiece> pieces;
+    slicePieces(p->pieces, 0, column, pieces);
+    Paragraph *tail = doc->paragraphs[last];
+    slicePieces(tail->pieces, end, tail->length, pieces);
+    setPieces(p, pieces);
+    for (int i = line + 1; i <= last; ++i) {
+        delete doc->paragraphs[i];
+    }
+    doc->paragraphs.erase(doc->paragraphs.begin() + line + 1, doc->paragraphs.begin() + last + 1);
+}
+
+void getParagraphText(const TextDocument *doc, int line, std::string &text) {
+    const Paragraph *p = doc->paragraphs[line];
+    text.clear();
+    text.reserve(p->length);
+    for (const auto &piece : p->pieces) {
+        const std::string &source = piece.added ? doc->added : doc->original;
+        text.append(source, piece.start, piece.length);
+    }
+}
+
+float documentLineAdvance(const TextDocument *doc) {
+    return doc->lineHeight * doc->size;
+}
+
+// Pen positions the way renderText() advances them, on a line of its own.
+static void shapeParagraph(TextDocument *doc, int line, ShapeCache *shapeCache) {
+    Paragraph *p = doc->paragraphs[line];
+    getParagraphText(doc, line, doc->style.data);
+    TextSpan text = textSpan(doc->style);
+    shapeFontRuns(doc->fonts, shapeCache, doc->size, text, doc->infos, doc->positions, doc->faces);
+    layoutParagraph(&doc->layout, text, doc->infos, doc->positions, doc->faces, doc->size, doc->lineHeight);
+    std::vector<GlyphPlacement> &glyphs = p->slot.glyphs;
+    glyphs.resize(doc->infos.size());
+    glyphs.resize(placeParagraph(&doc->layout, 0, 0, glyphs.data()));
+    p->dirty = false;
+    doc->reshaped++;
+}
+
+static bool visibleLines(const TextDocument *doc, int *first, int *last) {
+    float advance = documentLineAdvance(doc);
+    float origin = doc->y + doc->scroll;
+    *first = std::max(0, (int) std::ceil((origin - doc->top) / advance));
+    *last = std::min((int) doc->paragraphs.size() - 1, (int) std::floor((origin - doc->bottom) / advance));
+    return *first <= *last;
+}
+
+void updateTextDocument(TextDocument *doc, GlyphCache *glyphCache, ShapeCache *shapeCache) {
+    int first, last;
+    if (!visibleLines(doc, &first, &last)) {
+        return;
+    }
+    LineBuffer *lines = doc->lines;
+    glBindBuffer(GL_ARRAY_BUFFER, lines->buffer);
+    for (int line = first; line <= last; ++line) {
+        Paragraph *p = doc->paragraphs[line];
+        bool edited = p->dirty;
+        if (edited) {
+            shapeParagraph(doc, line, shapeCache);
+        }
+        if (!edited && !isLineStale(lines, &p->slot, glyphCache)) {
+            continue;
+        }
+        if (!uploadLine(lines, &p->slot, glyphCache, doc->size, doc->color)) {
+            // slots of lines long gone pile up; drop them all and start over
+            // with the visible ones
+            int visible = 0;
+            for (int i = first; i <= line; ++i) {
+                visible += lineSlotSize(&doc->paragraphs[i]->slot);
+            }
+            resetLineBuffer(lines, visible);
+            line = first - 1;
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawTextDocument(TextDocument *doc, GlyphCache *glyphCache, ShapeCache *shapeCache) {
+    updateTextDocument(doc, glyphCache, shapeCache);
+    int first, last;
+    if (!visibleLines(doc, &first, &last)) {
+        return;
+    }
+    float advance = documentLineAdvance(doc);
+    float origin = doc->y + doc->scroll;
+    doc->draws.clear();
+    for (int line = first; line <= last; ++line) {
+        doc->draws.push_back({&doc->paragraphs[line]->slot, doc->x, std::floor(origin - line * advance)});
+    }
+    drawLines(doc->lines, glyphCache, doc->draws.data(), (int) doc->draws.size());
+}
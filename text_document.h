@@ -0,0 +1,97 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef TEXT_DOCUMENT_H
+#define TEXT_DOCUMENT_H
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <hb.h>
+#include "font_collection.h"
+#include "glyph_cache.h"
+#include "line_buffer.h"
+#include "shape_cache.h"
+#include "text.h"
+#include "text_layout.h"
+
+struct TextPiece {
+    bool added;             // in TextDocument::added, otherwise in TextDocument::original
+    size_t start;
+    size_t length;
+};
+
+/*
+ * One line of the document, newline excluded. Shaped glyphs sit relative to
+ * the line's own pen origin and its instances keep a slot in the document's
+ * line buffer, so lines above an edit never change and lines below it only
+ * move.
+ */
+struct Paragraph {
+    std::vector<TextPiece> pieces;
+    size_t length;                      // bytes
+    bool dirty;                         // edited since it was last shaped
+    LineSlot slot;
+};
+
+/*
+ * Editable text as a piece table: the loaded bytes are never copied or
+ * modified, typed bytes go to an append-only buffer and every paragraph is a
+ * list of pieces over the two. Edits only mark the paragraphs they touch;
+ * drawing reshapes those that are visible and patches their slot with
+ * glBufferSubData. Lines are drawn with their origin as a uniform, so a line
+ * break shifts the lines below for free.
+ */
+struct TextDocument {
+    std::string original;
+    std::string added;
+    std::vector<Paragraph *> paragraphs;
+    HBText style;               // language, script, direction and letter space; data is scratch
+    FontCollection *fonts;      // not owned
+    unsigned int size;
+    float lineHeight;           // in multiples of size, as renderText() takes it
+    float x;                    // pen position of the first line
+    float y;
+    float scroll;               // pixels the text is moved up by
+    float top;                  // only lines with their baseline in [bottom, top] are drawn
+    float bottom;
+    GLubyte color[4];
+
+    LineBuffer *lines;
+    std::vector<hb_glyph_info_t> infos;
+    std::vector<hb_glyph_position_t> positions;
+    std::vector<FaceRun> faces;
+    ParagraphLayout layout;     // unwrapped, lines never hold a newline
+    std::vector<LineDraw> draws;
+    unsigned long reshaped;     // paragraphs shaped so far
+};
+
+/*
+ * program is built from res/vs_instanced.glsl and res/fs_batch.glsl. The
+ * faces of fonts are rescaled to size before shaping. Paragraphs are shaped
+ * lazily, the first time they are drawn.
+ */
+TextDocument *createTextDocument(GLuint program, GlyphCache *glyphCache, const HBText &text, FontCollection *fonts,
+                                 unsigned int size, float lineHeight = 1.0f);
+
+void destroyTextDocument(TextDocument *doc);
+
+// Positions are a line index and a byte offset inside it. Text may contain
+// newlines, which split the line.
+void insertText(TextDocument *doc, int line, size_t column, const char *text, size_t length);
+
+// Newlines count as one byte at the end of every line but the last one;
+// erasing one joins the two lines.
+void eraseText(TextDocument *doc, int line, size_t column, size_t length);
+
+void getParagraphText(const TextDocument *doc, int line, std::string &text);
+
+// Distance between two baselines, in pixels.
+float documentLineAdvance(const TextDocument *doc);
+
+// Reshapes the visible lines that were edited and uploads the ones whose
+// instances changed or went stale. drawTextDocument() starts with it.
+void updateTextDocument(TextDocument *doc, GlyphCache *glyphCache, ShapeCache *shapeCache);
+
+void drawTextDocument(TextDocument *doc, GlyphCache *glyphCache, ShapeCache *shapeCache);
+
+#endif
@@ -0,0 +1,574 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include "text_layout.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+
+// Line breaking classes of UAX #14. AI, SG, XX and SA resolve to AL and CJ
+// to NS before they get here; Hangul syllables and jamo are taken as ID.
+enum BreakClass : unsigned char {
+    BK, CR, LF, NL, SP, ZW, ZWJ, CM, WJ, GL, OP, CL, CP, QU, EX, IS, SY, NS, IN,
+    HY, BA, BB, B2, CB, PR, PO, NU, AL, HL, ID, RI, EB, EM, CLASS_COUNT
+};
+
+static const BreakClass ASCII_CLASSES[128] = {
+        CM, CM, CM, CM, CM, CM, CM, CM, CM, BA, LF, BK, BK, CR, CM, CM,
+        CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM, CM,
+        SP, EX, QU, AL, PR, PO, AL, QU, OP, CP, AL, PR, IS, HY, IS, SY,
+        NU, NU, NU, NU, NU, NU, NU, NU, NU, NU, IS, IS, AL, AL, AL, EX,
+        AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+        AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, OP, PR, CP, AL, AL,
+        AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL,
+        AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, AL, OP, BA, CL, AL, CM
+};
+
+struct BreakRange {
+    unsigned int first;
+    unsigned int last;
+    BreakClass cls;
+};
+
+// Sorted and disjoint; everything missing is AL.
+static const BreakRange BREAK_RANGES[] = {
+        {0x0080, 0x0084, CM}, {0x0085, 0x0085, NL}, {0x0086, 0x009f, CM}, {0x00a0, 0x00a0, GL},
+        {0x00a1, 0x00a1, OP}, {0x00a2, 0x00a2, PO}, {0x00a3, 0x00a5, PR}, {0x00ab, 0x00ab, QU},
+        {0x00ad, 0x00ad, BA}, {0x00b0, 0x00b0, PO}, {0x00b1, 0x00b1, PR}, {0x00b4, 0x00b4, BB},
+        {0x00bb, 0x00bb, QU}, {0x00bf, 0x00bf, OP}, {0x02c8, 0x02c8, BB}, {0x02cc, 0x02cc, BB},
+        {0x02df, 0x02df, BB}, {0x0300, 0x034e, CM}, {0x034f, 0x034f, GL}, {0x0350, 0x035b, CM},
+        {0x035c, 0x0362, GL}, {0x0363, 0x036f, CM}, {0x037e, 0x037e, IS}, {0x0483, 0x0489, CM},
+        {0x0589, 0x0589, IS}, {0x058a, 0x058a, BA}, {0x0591, 0x05bd, CM}, {0x05be, 0x05be, BA},
+        {0x05bf, 0x05c7, CM}, {0x05d0, 0x05ea, HL}, {0x05f0, 0x05f2, HL}, {0x060c, 0x060d, IS},
+        {0x0610, 0x061a, CM}, {0x061f, 0x061f, EX}, {0x064b, 0x065f, CM}, {0x0660, 0x0669, NU},
+        {0x066a, 0x066a, PO}, {0x066b, 0x066c, NU}, {0x0670, 0x0670, CM}, {0x06d4, 0x06d4, EX},
+        {0x06d6, 0x06e4, CM}, {0x06e7, 0x06ed, CM}, {0x06f0, 0x06f9, NU}, {0x0900, 0x0903, CM},
+        {0x093a, 0x094f, CM}, {0x0951, 0x0957, CM}, {0x0962, 0x0963, CM}, {0x0964, 0x0965, BA},
+        {0x0966, 0x096f, NU}, {0x0e00, 0x0eff, AL}, {0x0f0b, 0x0f0b, BA}, {0x1000, 0x109f, AL},
+        {0x1100, 0x11ff, ID}, {0x1680, 0x1680, BA}, {0x1780, 0x17ff, AL}, {0x1ab0, 0x1aff, CM},
+        {0x1dc0, 0x1dff, CM}, {0x2000, 0x2006, BA}, {0x2007, 0x2007, GL}, {0x2008, 0x200a, BA},
+        {0x200b, 0x200b, ZW}, {0x200c, 0x200c, CM}, {0x200d, 0x200d, ZWJ}, {0x200e, 0x200f, CM},
+        {0x2010, 0x2010, BA}, {0x2011, 0x2011, GL}, {0x2012, 0x2013, BA}, {0x2014, 0x2014, B2},
+        {0x2018, 0x2019, QU}, {0x201a, 0x201a, OP}, {0x201b, 0x201d, QU}, {0x201e, 0x201e, OP},
+        {0x201f, 0x201f, QU}, {0x2024, 0x2026, IN}, {0x2027, 0x2027, BA}, {0x2028, 0x2029, BK},
+        {0x202a, 0x202e, CM}, {0x202f, 0x202f, GL}, {0x2030, 0x2037, PO}, {0x2039, 0x203a, QU},
+        {0x203c, 0x203d, NS}, {0x2044, 0x2044, IS}, {0x2045, 0x2045, OP}, {0x2046, 0x2046, CL},
+        {0x2047, 0x2049, NS}, {0x2060, 0x2060, WJ}, {0x2066, 0x206f, CM}, {0x207d, 0x207d, OP},
+        {0x207e, 0x207e, CL}, {0x208d, 0x208d, OP}, {0x208e, 0x208e, CL}, {0x20a0, 0x20a6, PR},
+        {0x20a7, 0x20a7, PO}, {0x20a8, 0x20b5, PR}, {0x20b6, 0x20b6, PO}, {0x20b7, 0x20ba, PR},
+        {0x20bb, 0x20bb, PO}, {0x20bc, 0x20bd, PR}, {0x20be, 0x20cf, PR}, {0x20d0, 0x20ff, CM},
+        {0x2103, 0x2103, PO}, {0x2109, 0x2109, PO}, {0x2116, 0x2116, PR}, {0x2212, 0x2213, PR},
+        {0x2308, 0x2308, OP}, {0x2309, 0x2309, CL}, {0x230a, 0x230a, OP}, {0x230b, 0x230b, CL},
+        {0x2329, 0x2329, OP}, {0x232a, 0x232a, CL}, {0x261d, 0x261d, EB}, {0x26f9, 0x26f9, EB},
+        {0x270a, 0x270d, EB}, {0x2768, 0x2768, OP}, {0x2769, 0x2769, CL}, {0x276a, 0x276a, OP},
+        {0x276b, 0x276b, CL}, {0x276c, 0x276c, OP}, {0x276d, 0x276d, CL}, {0x276e, 0x276e, OP},
+        {0x276f, 0x276f, CL}, {0x2770, 0x2770, OP}, {0x2771, 0x2771, CL}, {0x2772, 0x2772, OP},
+        {0x2773, 0x2773, CL}, {0x2774, 0x2774, OP}, {0x2775, 0x2775, CL}, {0x2e80, 0x2fff, ID},
+        {0x3000, 0x3000, BA}, {0x3001, 0x3002, CL}, {0x3003, 0x3004, ID}, {0x3005, 0x3005, NS},
+        {0x3006, 0x3007, ID}, {0x3008, 0x3008, OP}, {0x3009, 0x3009, CL}, {0x300a, 0x300a, OP},
+        {0x300b, 0x300b, CL}, {0x300c, 0x300c, OP}, {0x300d, 0x300d, CL}, {0x300e, 0x300e, OP},
+        {0x300f, 0x300f, CL}, {0x3010, 0x3010, OP}, {0x3011, 0x3011, CL}, {0x3012, 0x3013, ID},
+        {0x3014, 0x3014, OP}, {0x3015, 0x3015, CL}, {0x3016, 0x3016, OP}, {0x3017, 0x3017, CL},
+        {0x3018, 0x3018, OP}, {0x3019, 0x3019, CL}, {0x301a, 0x301a, OP}, {0x301b, 0x301b, CL},
+        {0x301c, 0x301c, NS}, {0x301d, 0x301d, OP}, {0x301e, 0x301f, CL}, {0x3020, 0x3029, ID},
+        {0x302a, 0x302f, CM}, {0x3030, 0x303a, ID}, {0x303b, 0x303c, NS}, {0x303d, 0x3040, ID},
+        {0x3041, 0x3041, NS}, {0x3042, 0x3042, ID}, {0x3043, 0x3043, NS}, {0x3044, 0x3044, ID},
+        {0x3045, 0x3045, NS}, {0x3046, 0x3046, ID}, {0x3047, 0x3047, NS}, {0x3048, 0x3048, ID},
+        {0x3049, 0x3049, NS}, {0x304a, 0x3062, ID}, {0x3063, 0x3063, NS}, {0x3064, 0x3082, ID},
+        {0x3083, 0x3083, NS}, {0x3084, 0x3084, ID}, {0x3085, 0x3085, NS}, {0x3086, 0x3086, ID},
+        {0x3087, 0x3087, NS}, {0x3088, 0x308d, ID}, {0x308e, 0x308e, NS}, {0x308f, 0x3094, ID},
+        {0x3095, 0x3096, NS}, {0x3097, 0x3098, ID}, {0x3099, 0x309a, CM}, {0x309b, 0x309e, NS},
+        {0x309f, 0x309f, ID}, {0x30a0, 0x30a1, NS}, {0x30a2, 0x30a2, ID}, {0x30a3, 0x30a3, NS},
+        {0x30a4, 0x30a4, ID}, {0x30a5, 0x30a5, NS}, {0x30a6, 0x30a6, ID}, {0x30a7, 0x30a7, NS},
+        {0x30a8, 0x30a8, ID}, {0x30a9, 0x30a9, NS}, {0x30aa, 0x30c2, ID}, {0x30c3, 0x30c3, NS},
+        {0x30c4, 0x30e2, ID}, {0x30e3, 0x30e3, NS}, {0x30e4, 0x30e4, ID}, {0x30e5, 0x30e5, NS},
+        {0x30e6, 0x30e6, ID}, {0x30e7, 0x30e7, NS}, {0x30e8, 0x30ed, ID}, {0x30ee, 0x30ee, NS},
+        {0x30ef, 0x30f4, ID}, {0x30f5, 0x30f6, NS}, {0x30f7, 0x30fa, ID}, {0x30fb, 0x30fe, NS},
+        {0x30ff, 0x31ef, ID}, {0x31f0, 0x31ff, NS}, {0x3200, 0x4dbf, ID}, {0x4e00, 0xa014, ID},
+        {0xa015, 0xa015, NS}, {0xa016, 0xa4cf, ID}, {0xac00, 0xd7ff, ID}, {0xf900, 0xfaff, ID},
+        {0xfb1d, 0xfb4f, HL}, {0xfd3e, 0xfd3e, CL}, {0xfd3f, 0xfd3f, OP}, {0xfe00, 0xfe0f, CM},
+        {0xfe10, 0xfe10, IS}, {0xfe11, 0xfe12, CL}, {0xfe13, 0xfe14, IS}, {0xfe15, 0xfe16, EX},
+        {0xfe17, 0xfe17, OP}, {0xfe18, 0xfe18, CL}, {0xfe19, 0xfe19, IN}, {0xfe20, 0xfe2f, CM},
+        {0xfe30, 0xfe4f, ID}, {0xfe50, 0xfe50, CL}, {0xfe51, 0xfe51, ID}, {0xfe52, 0xfe52, CL},
+        {0xfe54, 0xfe55, NS}, {0xfe56, 0xfe57, EX}, {0xfe58, 0xfe58, ID}, {0xfe59, 0xfe59, OP},
+        {0xfe5a, 0xfe5a, CL}, {0xfe5b, 0xfe5b, OP}, {0xfe5c, 0xfe5c, CL}, {0xfe5d, 0xfe5d, OP},
+        {0xfe5e, 0xfe5e, CL}, {0xfe5f, 0xfe6b, ID}, {0xfeff, 0xfeff, WJ}, {0xff01, 0xff01, EX},
+        {0xff02, 0xff03, ID}, {0xff04, 0xff04, PR}, {0xff05, 0xff05, PO}, {0xff06, 0xff07, ID},
+        {0xff08, 0xff08, OP}, {0xff09, 0xff09, CL}, {0xff0a, 0xff0b, ID}, {0xff0c, 0xff0c, CL},
+        {0xff0d, 0xff0d, ID}, {0xff0e, 0xff0e, CL}, {0xff0f, 0xff19, ID}, {0xff1a, 0xff1b, NS},
+        {0xff1c, 0xff1e, ID}, {0xff1f, 0xff1f, EX}, {0xff20, 0xff3a, ID}, {0xff3b, 0xff3b, OP},
+        {0xff3c, 0xff3c, ID}, {0xff3d, 0xff3d, CL}, {0xff3e, 0xff5a, ID}, {0xff5b, 0xff5b, OP},
+        {0xff5c, 0xff5c, ID}, {0xff5d, 0xff5d, CL}, {0xff5e, 0xff5e, ID}, {0xff5f, 0xff5f, OP},
+        {0xff60, 0xff61, CL}, {0xff62, 0xff62, OP}, {0xff63, 0xff64, CL}, {0xff65, 0xff65, NS},
+        {0xff66, 0xff66, ID}, {0xff67, 0xff70, NS}, {0xff71, 0xff9d, ID}, {0xff9e, 0xff9f, NS},
+        {0xffa0, 0xffdc, ID}, {0xffe0, 0xffe0, PO}, {0xffe1, 0xffe1, PR}, {0xffe2, 0xffe4, ID},
+        {0xffe5, 0xffe6, PR}, {0xfffc, 0xfffc, CB}, {0x1b000, 0x1b2ff, ID}, {0x1f000, 0x1f0ff, ID},
+        {0x1f1e6, 0x1f1ff, RI}, {0x1f200, 0x1f384, ID}, {0x1f385, 0x1f385, EB}, {0x1f386, 0x1f3c1, ID},
+        {0x1f3c2, 0x1f3c4, EB}, {0x1f3c5, 0x1f3c6, ID}, {0x1f3c7, 0x1f3c7, EB}, {0x1f3c8, 0x1f3c9, ID},
+        {0x1f3ca, 0x1f3cc, EB}, {0x1f3cd, 0x1f3fa, ID}, {0x1f3fb, 0x1f3ff, EM}, {0x1f400, 0x1f441, ID},
+        {0x1f442, 0x1f443, EB}, {0x1f444, 0x1f445, ID}, {0x1f446, 0x1f450, EB}, {0x1f451, 0x1f465, ID},
+        {0x1f466, 0x1f469, EB}, {0x1f46a, 0x1f46d, ID}, {0x1f46e, 0x1f46e, EB}, {0x1f46f, 0x1f46f, ID},
+        {0x1f470, 0x1f478, EB}, {0x1f479, 0x1f47b, ID}, {0x1f47c, 0x1f47c, EB}, {0x1f47d, 0x1f480, ID},
+        {0x1f481, 0x1f483, EB}, {0x1f484, 0x1f484, ID}, {0x1f485, 0x1f487, EB}, {0x1f488, 0x1f4a9, ID},
+        {0x1f4aa, 0x1f4aa, EB}, {0x1f4ab, 0x1f573, ID}, {0x1f574, 0x1f575, EB}, {0x1f576, 0x1f579, ID},
+        {0x1f57a, 0x1f57a, EB}, {0x1f57b, 0x1f58f, ID}, {0x1f590, 0x1f590, EB}, {0x1f591, 0x1f594, ID},
+        {0x1f595, 0x1f596, EB}, {0x1f597, 0x1f644, ID}, {0x1f645, 0x1f647, EB}, {0x1f648, 0x1f64a, ID},
+        {0x1f64b, 0x1f64f, EB}, {0x1f650, 0x1f6a2, ID}, {0x1f6a3, 0x1f6a3, EB}, {0x1f6a4, 0x1f6b3, ID},
+        {0x1f6b4, 0x1f6b6, EB}, {0x1f6b7, 0x1f6bf, ID}, {0x1f6c0, 0x1f6c0, EB}, {0x1f6c1, 0x1f6cb, ID},
+        {0x1f6cc, 0x1f6cc, EB}, {0x1f6cd, 0x1f917, ID}, {0x1f918, 0x1f91c, EB}, {0x1f91d, 0x1f91d, ID},
+        {0x1f91e, 0x1f91f, EB}, {0x1f920, 0x1f925, ID}, {0x1f926, 0x1f926, EB}, {0x1f927, 0x1f92f, ID},
+        {0x1f930, 0x1f939, EB}, {0x1f93a, 0x1f93c, ID}, {0x1f93d, 0x1f93e, EB}, {0x1f93f, 0x1f9d0, ID},
+        {0x1f9d1, 0x1f9dd, EB}, {0x1f9de, 0x1faff, ID}, {0x20000, 0x3fffd, ID}, {0xe0001, 0xe007f, CM},
+        {0xe0100, 0xe01ef, CM}
+};
+
+static BreakClass breakClass(unsigned int codepoint) {
+    if (codepoint < 0x80) {
+        return ASCII_CLASSES[codepoint];
+    }
+    if (codepoint >= 0x4e00 && codepoint <= 0x9fff) {
+        return ID;
+    }
+    auto end = BREAK_RANGES + sizeof(BREAK_RANGES) / sizeof(BREAK_RANGES[0]);
+    auto range = std::upper_bound(BREAK_RANGES, end, codepoint, [](unsigned int c, const BreakRange &r) {
+        return c < r.first;
+    });
+    if (range != BREAK_RANGES && codepoint <= (range - 1)->last) {
+        return (range - 1)->cls;
+    }
+    return AL;
+}
+
+unsigned int decodeUtf8(const unsigned char *s, size_t length, size_t *size) {
+    unsigned char c = s[0];
+    unsigned int need = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+    if (c < 0x80 || need == 0 || need >= length) {
+        *size = 1;
+        return c < 0x80 ? c : 0xfffd;
+    }
+    unsigned int codepoint = c & (0x3f >> need);
+    for (unsigned int i = 1; i <= need; ++i) {
+        if ((s[i] & 0xc0) != 0x80) {
+            *size = 1;
+            return 0xfffd;
+        }
+        codepoint = (codepoint << 6) | (s[i] & 0x3f);
+    }
+    *size = need + 1;
+    return codepoint;
+}
+
+static inline bool isAlphabetic(BreakClass c) {
+    return c == AL || c == HL;
+}
+
+static inline bool isHardBreak(BreakClass c) {
+    return c == BK || c == CR || c == LF || c == NL;
+}
+
+/*
+ * The rules that decide the position between prev and cur, after LB9 folded
+ * combining marks into their base. beforeSpaces is the last class that was
+ * not SP. LB8a, LB21a and LB30a look further back and are left to the caller.
+ */
+static unsigned char breakBetween(BreakClass prev, BreakClass beforeSpaces, BreakClass cur) {
+    // LB4, LB5
+    if (prev == CR && cur == LF) {
+        return 0;
+    }
+    if (isHardBreak(prev)) {
+        return LINE_BREAK_MANDATORY;
+    }
+    // LB6, LB7
+    if (isHardBreak(cur) || cur == SP || cur == ZW) {
+        return 0;
+    }
+    // LB8
+    if (beforeSpaces == ZW) {
+        return LINE_BREAK_ALLOWED;
+    }
+    // LB11, LB12, LB12a
+    if (cur == WJ || prev == WJ || prev == GL) {
+        return 0;
+    }
+    if (cur == GL && prev != SP && prev != BA && prev != HY) {
+        return 0;
+    }
+    // LB13
+    if (cur == CL || cur == CP || cur == EX || cur == IS || cur == SY) {
+        return 0;
+    }
+    // LB14 to LB17, which look through spaces
+    if (beforeSpaces == OP) {
+        return 0;
+    }
+    if (beforeSpaces == QU && cur == OP) {
+        return 0;
+    }
+    if ((beforeSpaces == CL || beforeSpaces == CP) && cur == NS) {
+        return 0;
+    }
+    if (beforeSpaces == B2 && cur == B2) {
+        return 0;
+    }
+    // LB18
+    if (prev == SP) {
+        return LINE_BREAK_ALLOWED;
+    }
+    // LB19, LB20
+    if (cur == QU || prev == QU) {
+        return 0;
+    }
+    if (cur == CB || prev == CB) {
+        return LINE_BREAK_ALLOWED;
+    }
+    // LB21, LB21a, LB21b, LB22
+    if (cur == BA || cur == HY || cur == NS || prev == BB) {
+        return 0;
+    }
+    if ((prev == SY && cur == HL) || cur == IN) {
+        return 0;
+    }
+    // LB23, LB23a, LB24
+    if ((isAlphabetic(prev) && cur == NU) || (prev == NU && isAlphabetic(cur))) {
+        return 0;
+    }
+    if ((prev == PR && (cur == ID || cur == EB || cur == EM)) || ((prev == ID || prev == EB || prev == EM) && cur == PO)) {
+        return 0;
+    }
+    if (((prev == PR || prev == PO) && isAlphabetic(cur)) || (isAlphabetic(prev) && (cur == PR || cur == PO))) {
+        return 0;
+    }
+    // LB25, in its pairwise form
+    if ((prev == CL || prev == CP || prev == NU) && (cur == PO || cur == PR)) {
+        return 0;
+    }
+    if ((prev == PO || prev == PR) && (cur == OP || cur == NU)) {
+        return 0;
+    }
+    if ((prev == HY || prev == IS || prev == NU || prev == SY) && cur == NU) {
+        return 0;
+    }
+    // LB28, LB29, LB30
+    if ((isAlphabetic(prev) || prev == IS) && isAlphabetic(cur)) {
+        return 0;
+    }
+    if (((isAlphabetic(prev) || prev == NU) && cur == OP) || (prev == CP && (isAlphabetic(cur) || cur == NU))) {
+        return 0;
+    }
+    // LB30b
+    if (prev == EB && cur == EM) {
+        return 0;
+    }
+    // LB31
+    return LINE_BREAK_ALLOWED;
+}
+
+/*
+ * breakBetween() for every pair, once. Without spaces in between
+ * beforeSpaces is prev itself; after spaces only beforeSpaces matters.
+ */
+struct BreakTables {
+    unsigned char pairs[CLASS_COUNT][CLASS_COUNT];
+    unsigned char spaced[CLASS_COUNT][CLASS_COUNT];     // by beforeSpaces when prev is SP
+};
+
+static const BreakTables &breakTables() {
+    static const BreakTables tables = [] {
+        BreakTables t;
+        for (int a = 0; a < CLASS_COUNT; ++a) {
+            for (int b = 0; b < CLASS_COUNT; ++b) {
+                t.pairs[a][b] = breakBetween((BreakClass) a, (BreakClass) a, (BreakClass) b);
+                t.spaced[a][b] = breakBetween(SP, (BreakClass) a, (BreakClass) b);
+            }
+        }
+        return t;
+    }();
+    return tables;
+}
+
+void findLineBreaks(const char *text, size_t length, std::vector<unsigned char> &breaks) {
+    const BreakTables &tables = breakTables();
+    breaks.resize(length);
+    auto bytes = (const unsigned char *) text;
+    BreakClass prevPrev = WJ;
+    BreakClass prev = WJ;
+    BreakClass beforeSpaces = WJ;
+    bool afterJoiner = false;
+    int regionalRun = 0;
+    size_t size = 1;
+    for (size_t i = 0; i < length; i += size) {
+        BreakClass cur;
+        if (bytes[i] < 0x80) {
+            cur = ASCII_CLASSES[bytes[i]];
+            size = 1;
+        } else {
+            cur = breakClass(decodeUtf8(bytes + i, length - i, &size));
+            for (size_t j = 1; j < size; ++j) {
+                breaks[i + j] = 0;
+            }
+        }
+        unsigned char flags = cur == SP ? LINE_BREAK_SPACE : 0;
+        if (isHardBreak(cur)) {
+            flags = LINE_BREAK_SPACE | LINE_BREAK_TERMINATOR;
+        }
+        if (i == 0) {
+            // LB2, and LB10 for a leading mark
+            breaks[i] = flags;
+            prev = beforeSpaces = cur == CM || cur == ZWJ ? AL : cur;
+            regionalRun = cur == RI;
+            afterJoiner = cur == ZWJ;
+            continue;
+        }
+        bool joined = afterJoiner;
+        afterJoiner = cur == ZWJ;
+        if ((cur == CM || cur == ZWJ) && !isHardBreak(prev) && prev != SP && prev != ZW) {
+            // LB9, the mark takes the class of its base
+            breaks[i] = flags;
+            continue;
+        }
+        if (cur == CM || cur == ZWJ) {
+            cur = AL;
+        }
+        unsigned char b = prev == SP ? tables.spaced[beforeSpaces][cur] : tables.pairs[prev][cur];
+        if (b == LINE_BREAK_ALLOWED) {
+            // LB8a, LB21a and LB30a
+            if (joined && prev != SP && beforeSpaces != ZW) {
+                b = 0;
+            } else if (prevPrev == HL && (prev == HY || prev == BA)) {
+                b = 0;
+            } else if (prev == RI && cur == RI && regionalRun % 2 == 1) {
+                b = 0;
+            }
+        }
+        breaks[i] = flags | b;
+        regionalRun = cur == RI ? regionalRun + 1 : 0;
+        prevPrev = prev;
+        prev = cur;
+        if (cur != SP) {
+            beforeSpaces = cur;
+        }
+    }
+}
+
+void layoutParagraph(ParagraphLayout *layout, const TextSpan &text, const std::vector<hb_glyph_info_t> &infos,
+                     const std::vector<hb_glyph_position_t> &positions, const std::vector<FaceRun> &faces,
+                     unsigned int size, float lineHeight, float width) {
+    PROFILE_SCOPE("layout");
+    layout->size = size;
+    layout->lineHeight = lineHeight;
+    layout->letterSpace = text.space;
+    layout->backward = HB_DIRECTION_IS_BACKWARD(text.direction);
+    layout->length = text.length;
+    findLineBreaks(text.data, text.length, layout->breaks);
+
+    size_t count = infos.size();
+    layout->glyphs.resize(count);
+    layout->faces = faces;
+    layout->clusters.resize(count);
+    layout->pen.resize(count + 1);
+    layout->offsets.clear();
+    float x = 0;
+    for (size_t i = 0; i < count; ++i) {
+        const hb_glyph_position_t &pos = positions[i];
+        layout->glyphs[i] = infos[i].codepoint;
+        layout->clusters[i] = infos[i].cluster;
+        layout->pen[i] = x;
+        if ((pos.x_offset | pos.y_offset) && layout->offsets.empty()) {
+            layout->offsets.resize(count * 2, 0.0f);
+        }
+        if (!layout->offsets.empty()) {
+            layout->offsets[i * 2] = (float) pos.x_offset / 64;
+            layout->offsets[i * 2 + 1] = (float) pos.y_offset / 64;
+        }
+        x += (float) pos.x_advance / 64 + layout->letterSpace;
+    }
+    layout->pen[count] = x;
+    wrapParagraph(layout, width);
+}
+
+static inline unsigned char glyphBreaks(const ParagraphLayout *layout, int glyph) {
+    unsigned int cluster = layout->clusters[glyph];
+    return cluster < layout->length ? layout->breaks[cluster] : (unsigned char) 0;
+}
+
+static void addLine(ParagraphLayout *layout, int first, int last) {
+    int end = last;
+    while (end > first && (glyphBreaks(layout, end - 1) & LINE_BREAK_SPACE)) {
+        end--;
+    }
+    layout->lines.push_back({first, last, layout->pen[end] - layout->pen[first]});
+}
+
+void wrapParagraph(ParagraphLayout *layout, float width) {
+    layout->width = width;
+    layout->lines.clear();
+    int count = (int) layout->glyphs.size();
+    if (layout->backward) {
+        addLine(layout, 0, count);
+        return;
+    }
+    int first = 0;
+    int opportunity = -1;       // last glyph the line may break before
+    for (int i = 0; i < count; ++i) {
+        unsigned char flags = glyphBreaks(layout, i);
+        if (i > first && layout->clusters[i] != layout->clusters[i - 1]) {
+            if (flags & LINE_BREAK_MANDATORY) {
+                addLine(layout, first, i);
+                first = i;
+                opportunity = -1;
+            } else if (flags & LINE_BREAK_ALLOWED) {
+                opportunity = i;
+            }
+        }
+        if (width > 0 && !(flags & LINE_BREAK_SPACE) && opportunity > first &&
+            layout->pen[i + 1] - layout->pen[first] > width) {
+            addLine(layout, first, opportunity);
+            first = opportunity;
+            opportunity = -1;
+        }
+    }
+    addLine(layout, first, count);
+}
+
+float layoutLineAdvance(const ParagraphLayout *layout) {
+    return layout->lineHeight * layout->size;
+}
+
+void measureParagraph(const ParagraphLayout *layout, float *width, float *height) {
+    float widest = 0;
+    for (const auto &line : layout->lines) {
+        widest = std::max(widest, line.width);
+    }
+    *width = widest;
+    *height = layout->lines.size() * layoutLineAdvance(layout);
+}
+
+/*
+ * Walks the glyphs that get drawn, in order, handing out the glyph index, the
+ * face run it is in and where it goes.
+ */
+template<typename Put>
+static void placeGlyphs(const ParagraphLayout *layout, float x, float y, Put put) {
+    float advance = layoutLineAdvance(layout);
+    float left = x + layout->letterSpace * 0.5f;
+    size_t run = 0;
+    for (size_t k = 0; k < layout->lines.size(); ++k) {
+        const LayoutLine &line = layout->lines[k];
+        float start = left - layout->pen[line.first];
+        float baseline = y - k * advance;
+        for (int i = line.first; i < line.last; ++i) {
+            while (run + 1 < layout->faces.size() && layout->faces[run + 1].first <= i) {
+                run++;
+            }
+            if (glyphBreaks(layout, i) & LINE_BREAK_TERMINATOR) {
+                continue;
+            }
+            float gx = start + layout->pen[i];
+            float gy = baseline;
+            if (!layout->offsets.empty()) {
+                gx += layout->offsets[i * 2];
+                gy += layout->offsets[i * 2 + 1];
+            }
+            put(i, run, gx, gy);
+        }
+    }
+}
+
+int placeParagraph(const ParagraphLayout *layout, float x, float y, GlyphPlacement *out) {
+    int count = 0;
+    placeGlyphs(layout, x, y, [layout, out, &count](int i, size_t run, float gx, float gy) {
+        out[count++] = {layout->faces[run].face, layout->glyphs[i], gx, gy};
+    });
+    return count;
+}
+
+void placeGlyphRun(const ParagraphLayout *layout, float x, float y, GlyphRun *run) {
+    run->count = 0;
+    run->faceCount = 0;
+    size_t current = layout->faces.size();
+    placeGlyphs(layout, x, y, [layout, run, &current](int i, size_t face, float gx, float gy) {
+        int n = run->count++;
+        if (face != current) {
+            // spans whose glyphs were all skipped leave no entry
+            current = face;
+            run->faces[run->faceCount++] = {n, layout->faces[face].face};
+        }
+        run->glyphs[n] = layout->glyphs[i];
+        run->clusters[n] = layout->clusters[i];
+        run->x[n] = gx;
+        run->y[n] = gy;
+    });
+}
+
+// Line boxes start this far above their baseline, a typical ascender.
+static const float ASCENT = 0.8f;
+
+size_t hitTestParagraph(const ParagraphLayout *layout, float x, float y) {
+    if (layout->lines.empty() || layout->glyphs.empty()) {
+        return 0;
+    }
+    float advance = layoutLineAdvance(layout);
+    int k = (int) std::floor((ASCENT * layout->size - y) / advance);
+    k = std::max(0, std::min(k, (int) layout->lines.size() - 1));
+    const LayoutLine &line = layout->lines[k];
+    if (line.first == line.last) {
+        return line.first < (int) layout->glyphs.size() ? layout->clusters[line.first] : layout->length;
+    }
+
+    // the glyph whose right half or the next glyph's left half holds x
+    float target = x - layout->letterSpace * 0.5f + layout->pen[line.first];
+    auto begin = layout->pen.begin() + line.first;
+    auto end = layout->pen.begin() + line.last;
+    int i = (int) (std::upper_bound(begin, end, target) - layout->pen.begin()) - 1;
+    i = std::max(i, line.first);
+    float middle = (layout->pen[i] + layout->pen[i + 1]) * 0.5f;
+    if (layout->backward) {
+        // the right half is in front of the character, the left half in
+        // front of the one after it, which is further left
+        if (target >= middle) {
+            return layout->clusters[i];
+        }
+        int previous = i - 1;
+        while (previous >= 0 && layout->clusters[previous] == layout->clusters[i]) {
+            previous--;
+        }
+        return previous >= 0 ? layout->clusters[previous] : layout->length;
+    }
+    if (target < middle) {
+        return layout->clusters[i];
+    }
+    // past the middle: in front of the next cluster, or at the end of the
+    // line, where hanging spaces and newlines keep the caret before them
+    int next = i + 1;
+    while (next < line.last && layout->clusters[next] == layout->clusters[i]) {
+        next++;
+    }
+    if (next < line.last) {
+        return layout->clusters[next];
+    }
+    if (glyphBreaks(layout, i) & LINE_BREAK_SPACE && line.last < (int) layout->glyphs.size()) {
+        return layout->clusters[i];
+    }
+    return line.last < (int) layout->glyphs.size() ? layout->clusters[line.last] : layout->length;
+}
+
+void caretPosition(const ParagraphLayout *layout, size_t cluster, float *x, float *y) {
+    int i;
+    if (layout->backward) {
+        // clusters run downwards in visual order, so the caret in front of a
+        // character is at the right edge of its last glyph
+        i = (int) (std::lower_bound(layout->clusters.begin(), layout->clusters.end(), cluster,
+                                    [](unsigned int c, size_t value) { return c >= value; }) -
+                   layout->clusters.begin());
+    } else {
+        i = (int) (std::lower_bound(layout->clusters.begin(), layout->clusters.end(), cluster) -
+                   layout->clusters.begin());
+    }
+    // the line that starts at or before i, the last one for the end
+    auto line = std::upper_bound(layout->lines.begin(), layout->lines.end(), i,
+                                 [](int glyph, const LayoutLine &l) { return glyph < l.first; });
+    int k = line == layout->lines.begin() ? 0 : (int) (line - layout->lines.begin()) - 1;
+    int first = layout->lines.empty() ? 0 : layout->lines[k].first;
+    *x = layout->letterSpace * 0.5f + layout->pen[i] - layout->pen[first];
+    *y = -k * layoutLineAdvance(layout);
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef TEXT_LAYOUT_H
+#define TEXT_LAYOUT_H
+
+#include <string>
+#include <vector>
+#include <hb.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+#include "text.h"
+
+typedef struct {
+    FT_Face face;
+    unsigned int glyph;
+    float x;
+    float y;
+} GlyphPlacement;
+
+// Glyphs from first up to the next run's first were shaped with face.
+struct FaceRun {
+    int first;
+    FT_Face face;
+};
+
+/*
+ * Placed glyphs as parallel arrays, the way the atlas and the renderers walk
+ * them: ids, clusters and coordinates each packed tight, and the face once per
+ * span of glyphs instead of once per glyph. The arrays belong to whoever
+ * allocated them, usually an Arena.
+ */
+struct GlyphRun {
+    int count;
+    unsigned int *glyphs;
+    unsigned int *clusters;     // byte offsets into the text
+    float *x;
+    float *y;
+    FaceRun *faces;             // in glyph order, the first one starts at 0
+    int faceCount;
+};
+
+// Face span f of run covers glyphs [run->faces[f].first, faceRunEnd(run, f)).
+inline int faceRunEnd(const GlyphRun *run, int f) {
+    return f + 1 < run->faceCount ? run->faces[f + 1].first : run->count;
+}
+
+// Decodes the character at s, taking malformed bytes one at a time; size
+// gets how many bytes it took.
+unsigned int decodeUtf8(const unsigned char *s, size_t length, size_t *size);
+
+// Per byte of text, about the position right before it.
+enum LineBreakFlags {
+    LINE_BREAK_ALLOWED = 1,
+    LINE_BREAK_MANDATORY = 2,       // the previous character ends the line
+    LINE_BREAK_SPACE = 4,           // the character here hangs past the end of a line
+    LINE_BREAK_TERMINATOR = 8       // the character here is a newline, it is never drawn
+};
+
+/*
+ * UAX #14 line breaking, rules LB2 to LB31 over a built-in class table that
+ * covers Latin, CJK, kana, Hangul, the common punctuation blocks and emoji.
+ * Complex-context scripts (Thai, Lao, Khmer, Myanmar) have no dictionary and
+ * break like alphabetic text. breaks gets one entry per byte; bytes that do
+ * not start a character only get the space and terminator flags.
+ */
+void findLineBreaks(const char *text, size_t length, std::vector<unsigned char> &breaks);
+
+struct LayoutLine {
+    int first;              // glyphs [first, last)
+    int last;
+    float width;            // trailing spaces excluded
+};
+
+/*
+ * A shaped paragraph broken into lines. Break opportunities and pen
+ * positions are computed once from the shaping result; wrapping to another
+ * width only walks them again. Nothing in here touches GL, so paragraphs can
+ * be laid out on worker threads.
+ *
+ * Forward text wraps at width and at newlines. Backward (right-to-left)
+ * text comes from HarfBuzz in visual order and is kept on one line.
+ */
+struct ParagraphLayout {
+    unsigned int size;
+    float lineHeight;                   // in multiples of size
+    float letterSpace;                  // added after every glyph, half of it before the first one of a line
+    bool backward;
+    size_t length;                      // bytes of text
+    std::vector<unsigned char> breaks;  // LineBreakFlags per byte of text
+    std::vector<unsigned int> glyphs;
+    std::vector<FaceRun> faces;         // in glyph order, the first one starts at glyph 0
+    std::vector<unsigned int> clusters;
+    std::vector<float> pen;             // x before every glyph from the paragraph start, one more at the end
+    std::vector<float> offsets;         // x and y per glyph, empty while HarfBuzz moved none
+    std::vector<LayoutLine> lines;
+    float width;                        // what the lines were wrapped to, 0 for no limit
+};
+
+// infos, positions and faces come from shapeFontRuns() on text. Lines are
+// wrapped to width as wrapParagraph() does it.
+void layoutParagraph(ParagraphLayout *layout, const TextSpan &text, const std::vector<hb_glyph_info_t> &infos,
+                     const std::vector<hb_glyph_position_t> &positions, const std::vector<FaceRun> &faces,
+                     unsigned int size, float lineHeight = 1.0f, float width = 0);
+
+// Breaks lines so they fit in width where the text allows it; 0 only breaks
+// at newlines. Words longer than width overflow.
+void wrapParagraph(ParagraphLayout *layout, float width);
+
+float layoutLineAdvance(const ParagraphLayout *layout);
+
+// Widest line and the height of all lines.
+void measureParagraph(const ParagraphLayout *layout, float *width, float *height);
+
+// Writes the glyphs with the first baseline at (x, y) and lines going down,
+// skipping newlines. out needs room for layout->glyphs.size(); returns the
+// count written.
+int placeParagraph(const ParagraphLayout *layout, float x, float y, GlyphPlacement *out);
+
+// placeParagraph() into the arrays of run, which need room for
+// layout->glyphs.size() glyphs and layout->faces.size() faces. Sets count and
+// faceCount.
+void placeGlyphRun(const ParagraphLayout *layout, float x, float y, GlyphRun *run);
+
+// Point relative to the first baseline, y up, to the byte offset the caret
+// goes to. Points outside the paragraph clamp to the closest line.
+size_t hitTestParagraph(const ParagraphLayout *layout, float x, float y);
+
+// Caret in front of the character at byte offset cluster, relative to the
+// first baseline. The end of the text is after the last glyph.
+void caretPosition(const ParagraphLayout *layout, size_t cluster, float *x, float *y);
+
+#endif
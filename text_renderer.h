@@ -0,0 +1,25 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef TEXT_RENDERER_H
+#define TEXT_RENDERER_H
+
+#include "atlas.h"
+
+/*
+ * Draws built atlases somewhere. The GL renderer streams quads into the
+ * current framebuffer, the CPU renderer composites cached coverage into
+ * memory, so the same strings render on machines without a GPU.
+ */
+struct TextRenderer {
+    virtual ~TextRenderer() {}
+
+    virtual void clear(float r, float g, float b) = 0;
+
+    virtual void drawText(Atlas *atlas, float r, float g, float b) = 0;
+};
+
+inline void destroyRenderer(TextRenderer *renderer) {
+    delete renderer;
+}
+
+#endif
@@ -0,0 +1,270 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include "text_view.h"
+
+static const int INDEX_STRIDE = 1024;
+// lines past this are cut for display, so one huge line can not stall a frame
+static const size_t MAX_LINE_BYTES = 4096;
+static const int INITIAL_CAPACITY = 16 * 1024;
+static const int DEFAULT_MARGIN = 8;
+
+TextView *openTextView(const char *path, GLuint program, GlyphCache *glyphCache, const HBText &style,
+                       FontCollection *fonts, unsigned int size, float lineHeight) {
+    MappedFile *file = mapFile(path);
+    if (!file) {
+        return nullptr;
+    }
+    auto view = new TextView;
+    view->file = file;
+    view->checkpoints.push_back(0);
+    view->indexedLines = 0;
+    view->indexed = 0;
+    view->lineCount = file->size ? -1 : 1;
+    view->style = style;
+    view->style.data.clear();
+    view->fonts = fonts;
+    view->size = size;
+    view->lineHeight = lineHeight;
+    view->x = 0;
+    view->y = 0;
+    view->scroll = 0;
+    view->top = 0;
+    view->bottom = 0;
+    view->margin = DEFAULT_MARGIN;
+    view->color[0] = 0;
+    view->color[1] = 0;
+    view->color[2] = 0;
+    view->color[3] = 255;
+    view->residentFirst = 0;
+    view->lines = createLineBuffer(program, glyphCache, INITIAL_CAPACITY);
+    view->shaped = 0;
+    return view;
+}
+
+void closeTextView(TextView *view) {
+    for (auto line : view->resident) {
+        delete line;
+    }
+    for (auto line : view->spare) {
+        delete line;
+    }
+    destroyLineBuffer(view->lines);
+    unmapFile(view->file);
+    delete view;
+}
+
+// Start of the line after the one at start, or the file size when it is the
+// last. A newline that ends the file does not start another line.
+static size_t nextLine(const MappedFile *file, size_t start, size_t *end) {
+    auto newline = (const char *) memchr(file->data + start, '\n', file->size - start);
+    if (!newline) {
+        *end = file->size;
+        return file->size;
+    }
+    *end = newline - file->data;
+    return *end + 1;
+}
+
+// Moves the index scan forward until it is past line or the file ends.
+static void extendIndex(TextView *view, long line) {
+    const MappedFile *file = view->file;
+    while (view->lineCount < 0 && view->indexedLines < line) {
+        size_t end;
+        size_t next = nextLine(file, view->indexed, &end);
+        if (next >= file->size) {
+            view->lineCount = view->indexedLines + 1;
+            break;
+        }
+        view->indexed = next;
+        view->indexedLines++;
+        if (view->indexedLines % INDEX_STRIDE == 0) {
+            view->checkpoints.push_back(next);
+        }
+    }
+}
+
+bool findViewLine(TextView *view, long line, size_t *start) {
+    if (line < 0) {
+        return false;
+    }
+    extendIndex(view, line);
+    if (view->lineCount >= 0 && line >= view->lineCount) {
+        return false;
+    }
+    if (line == view->indexedLines) {
+        *start = view->indexed;
+        return true;
+    }
+    // walk from the checkpoint before it, at most INDEX_STRIDE - 1 lines
+    size_t offset = view->checkpoints[line / INDEX_STRIDE];
+    for (long i = line / INDEX_STRIDE * INDEX_STRIDE; i < line; ++i) {
+        size_t end;
+        offset = nextLine(view->file, offset, &end);
+    }
+    *start = offset;
+    return true;
+}
+
+long countViewLines(TextView *view) {
+    extendIndex(view, LONG_MAX);
+    return view->lineCount;
+}
+
+float viewLineAdvance(const TextView *view) {
+    return view->lineHeight * view->size;
+}
+
+// Start of the line before the one at start, which must not be the first.
+static size_t previousLine(const MappedFile *file, size_t start) {
+    size_t i = start - 1;
+    while (i > 0 && file->data[i - 1] != '\n') {
+        i--;
+    }
+    return i;
+}
+
+static void shapeLine(TextView *view, ViewLine *line, ShapeCache *shapeCache) {
+    const char *data = view->file->data + line->start;
+    size_t length = std::min(line->length, MAX_LINE_BYTES);
+    while (length < line->length && length > 0 && (data[length] & 0xc0) == 0x80) {
+        // never cut a character in half
+        length--;
+    }
+    // shaped straight from the mapping
+    TextSpan text = textSpan(view->style);
+    text.data = data;
+    text.length = length;
+    shapeFontRuns(view->fonts, shapeCache, view->size, text, view->infos, view->positions, view->faces);
+    layoutParagraph(&view->layout, text, view->infos, view->positions, view->faces, view->size, view->lineHeight);
+    std::vector<GlyphPlacement> &glyphs = line->slot.glyphs;
+    glyphs.resize(view->infos.size());
+    glyphs.resize(placeParagraph(&view->layout, 0, 0, glyphs.data()));
+    line->fresh = true;
+    view->shaped++;
+}
+
+/*
+ * Picks up a line object, preferring one that scrolled out: its slot stays
+ * with it, so the new line reuses the range in the buffer when it fits.
+ */
+static ViewLine *loadLine(TextView *view, long index, size_t start, ShapeCache *shapeCache) {
+    ViewLine *line;
+    if (view->spare.empty()) {
+        line = new ViewLine;
+        initLineSlot(&line->slot);
+    } else {
+        line = view->spare.back();
+        view->spare.pop_back();
+    }
+    const MappedFile *file = view->file;
+    size_t end;
+    line->line = index;
+    line->start = start;
+    line->next = start < file->size ? nextLine(file, start, &end) : file->size;
+    if (start >= file->size) {
+        end = start;
+    }
+    if (end > start && file->data[end - 1] == '\r') {
+        end--;
+    }
+    line->length = end - start;
+    shapeLine(view, line, shapeCache);
+    return line;
+}
+
+static bool visibleLines(const TextView *view, long *first, long *last) {
+    double advance = viewLineAdvance(view);
+    double origin = view->y + view->scroll;
+    *first = std::max(0L, (long) std::ceil((origin - view->top) / advance));
+    *last = (long) std::floor((origin - view->bottom) / advance);
+    if (view->lineCount >= 0) {
+        *last = std::min(*last, view->lineCount - 1);
+    }
+    return *first <= *last;
+}
+
+static void updateResident(TextView *view, long first, long last, ShapeCache *shapeCache) {
+    std::deque<ViewLine *> &resident = view->resident;
+    // let go of what scrolled out, keeping the objects and their slots
+    while (!resident.empty() && (view->residentFirst < first || view->residentFirst > last)) {
+        view->spare.push_back(resident.front());
+        resident.pop_front();
+        view->residentFirst++;
+    }
+    while (!resident.empty() && view->residentFirst + (long) resident.size() - 1 > last) {
+        view->spare.push_back(resident.back());
+        resident.pop_back();
+    }
+
+    if (resident.empty()) {
+        size_t start;
+        if (!findViewLine(view, first, &start)) {
+            return;
+        }
+        resident.push_back(loadLine(view, first, start, shapeCache));
+        view->residentFirst = first;
+    }
+    while (view->residentFirst > first) {
+        size_t start = previousLine(view->file, resident.front()->start);
+        resident.push_front(loadLine(view, view->residentFirst - 1, start, shapeCache));
+        view->residentFirst--;
+    }
+    while (view->residentFirst + (long) resident.size() - 1 < last) {
+        const ViewLine *back = resident.back();
+        if (back->next >= view->file->size) {
+            break;
+        }
+        resident.push_back(loadLine(view, back->line + 1, back->next, shapeCache));
+    }
+}
+
+void updateTextView(TextView *view, GlyphCache *glyphCache, ShapeCache *shapeCache) {
+    long first, last;
+    if (!visibleLines(view, &first, &last)) {
+        return;
+    }
+    updateResident(view, std::max(0L, first - view->margin), last + view->margin, shapeCache);
+
+    LineBuffer *lines = view->lines;
+    glBindBuffer(GL_ARRAY_BUFFER, lines->buffer);
+    for (size_t i = 0; i < view->resident.size(); ++i) {
+        ViewLine *line = view->resident[i];
+        if (!line->fresh && !isLineStale(lines, &line->slot, glyphCache)) {
+            continue;
+        }
+        if (!uploadLine(lines, &line->slot, glyphCache, view->size, view->color)) {
+            // every resident line gets a new slot, the ones scrolled out
+            // lose theirs
+            int needed = 0;
+            for (auto resident : view->resident) {
+                needed += lineSlotSize(&resident->slot);
+            }
+            resetLineBuffer(lines, needed);
+            i = (size_t) -1;
+            continue;
+        }
+        line->fresh = false;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void drawTextView(TextView *view, GlyphCache *glyphCache, ShapeCache *shapeCache) {
+    updateTextView(view, glyphCache, shapeCache);
+    long first, last;
+    if (!visibleLines(view, &first, &last) || view->resident.empty()) {
+        return;
+    }
+    double advance = viewLineAdvance(view);
+    double origin = view->y + view->scroll;
+    view->draws.clear();
+    long end = std::min(last, view->residentFirst + (long) view->resident.size() - 1);
+    for (long line = std::max(first, view->residentFirst); line <= end; ++line) {
+        const ViewLine *resident = view->resident[line - view->residentFirst];
+        view->draws.push_back({&resident->slot, view->x, (float) std::floor(origin - line * advance)});
+    }
+    drawLines(view->lines, glyphCache, view->draws.data(), (int) view->draws.size());
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef TEXT_VIEW_H
+#define TEXT_VIEW_H
+
+#include <deque>
+#include <vector>
+#include <glad/glad.h>
+#include <hb.h>
+#include "font_collection.h"
+#include "glyph_cache.h"
+#include "line_buffer.h"
+#include "mapped_file.h"
+#include "shape_cache.h"
+#include "text.h"
+#include "text_layout.h"
+
+// A line of the file that is inside the viewport or its prefetch margin.
+struct ViewLine {
+    long line;
+    size_t start;               // byte offset in the file
+    size_t length;              // newline and carriage return excluded
+    size_t next;                // start of the next line, or the file size after the last one
+    bool fresh;                 // shaped since it was last uploaded
+    LineSlot slot;
+};
+
+/*
+ * Read-only view of a file too big to hold, such as a log. The file is
+ * mapped, not read, and lines are found lazily: the index only records where
+ * every INDEX_STRIDE-th line starts and only runs as far as a jump needed.
+ * Just the lines crossing the viewport, plus margin lines on either side,
+ * are shaped, laid out and given a slot in the line buffer; lines scrolling
+ * out hand their object and slot to the lines scrolling in. Memory and work
+ * per frame follow the viewport, not the file.
+ */
+struct TextView {
+    MappedFile *file;
+    std::vector<size_t> checkpoints;    // start of line k * INDEX_STRIDE
+    long indexedLines;                  // lines the index scan went past
+    size_t indexed;                     // start of line indexedLines
+    long lineCount;                     // -1 until the scan reached the end
+    HBText style;                       // language, script, direction and letter space; data is unused
+    FontCollection *fonts;              // not owned
+    unsigned int size;
+    float lineHeight;                   // in multiples of size
+    float x;                            // pen position of the first line
+    float y;
+    double scroll;                      // pixels the text is moved up by, double to reach far into big files
+    float top;                          // only lines with their baseline in [bottom, top] are drawn
+    float bottom;
+    int margin;                         // lines kept ready beyond each edge
+    GLubyte color[4];
+
+    long residentFirst;
+    std::deque<ViewLine *> resident;    // lines residentFirst onwards, in order
+    std::vector<ViewLine *> spare;
+    LineBuffer *lines;
+    std::vector<hb_glyph_info_t> infos;
+    std::vector<hb_glyph_position_t> positions;
+    std::vector<FaceRun> faces;
+    ParagraphLayout layout;
+    std::vector<LineDraw> draws;
+    unsigned long shaped;               // lines shaped so far
+};
+
+/*
+ * Maps path; nullptr when it can not be. program is built from
+ * res/vs_instanced.glsl and res/fs_batch.glsl. Nothing is read until the
+ * view is drawn.
+ */
+TextView *openTextView(const char *path, GLuint program, GlyphCache *glyphCache, const HBText &style,
+                       FontCollection *fonts, unsigned int size, float lineHeight = 1.0f);
+
+void closeTextView(TextView *view);
+
+// Byte offset where line starts, extending the index as far as needed.
+// False past the last line.
+bool findViewLine(TextView *view, long line, size_t *start);
+
+// Scans the rest of the file once to count its lines.
+long countViewLines(TextView *view);
+
+// Distance between two baselines, in pixels.
+float viewLineAdvance(const TextView *view);
+
+// Brings the resident lines in line with the scroll position, shaping and
+// uploading the ones that came in. drawTextView() starts with it.
+void updateTextView(TextView *view, GlyphCache *glyphCache, ShapeCache *shapeCache);
+
+void drawTextView(TextView *view, GlyphCache *glyphCache, ShapeCache *shapeCache);
+
+#endif
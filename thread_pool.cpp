@@ -0,0 +1,100 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include "thread_pool.h"
+
+static void workerLoop(ThreadPool *pool) {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(pool->mutex);
+            pool->wake.wait(lock, [pool] { return pool->stop || !pool->tasks.empty(); });
+            if (pool->tasks.empty()) {
+                return;
+            }
+            task = std::move(pool->tasks.front());
+            pool->tasks.pop_front();
+        }
+        task();
+    }
+}
+
+ThreadPool *createThreadPool(int threads) {
+    if (threads <= 0) {
+        threads = (int) std::thread::hardware_concurrency() - 1;
+    }
+    auto pool = new ThreadPool;
+    pool->stop = false;
+    for (int i = 0; i < threads; ++i) {
+        pool->threads.emplace_back(workerLoop, pool);
+    }
+    return pool;
+}
+
+void destroyThreadPool(ThreadPool *pool) {
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->stop = true;
+    }
+    pool->wake.notify_all();
+    for (auto &thread : pool->threads) {
+        thread.join();
+    }
+    delete pool;
+}
+
+void submitTask(ThreadPool *pool, std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(pool->mutex);
+        pool->tasks.push_back(std::move(task));
+    }
+    pool->wake.notify_one();
+}
+
+struct ParallelFor {
+    std::atomic<int> next;
+    std::atomic<int> done;
+    int count;
+    const std::function<void(int)> *fn;
+    std::mutex mutex;
+    std::condition_variable finished;
+};
+
+static void drain(ParallelFor *job) {
+    int ran = 0;
+    for (int i = job->next++; i < job->count; i = job->next++) {
+        (*job->fn)(i);
+        ran++;
+    }
+    if (ran && job->done.fetch_add(ran) + ran == job->count) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->finished.notify_all();
+    }
+}
+
+void parallelFor(ThreadPool *pool, int count, const std::function<void(int)> &fn) {
+    if (count <= 0) {
+        return;
+    }
+    if (!pool || pool->threads.empty() || count == 1) {
+        for (int i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+    // helpers may outlive this call if they start late, so they share ownership
+    auto job = std::make_shared<ParallelFor>();
+    job->next = 0;
+    job->done = 0;
+    job->count = count;
+    job->fn = &fn;
+    int helpers = std::min((int) pool->threads.size(), count - 1);
+    for (int i = 0; i < helpers; ++i) {
+        submitTask(pool, [job] { drain(job.get()); });
+    }
+    drain(job.get());
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&job] { return job->done == job->count; });
+}
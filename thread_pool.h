@@ -0,0 +1,34 @@
+// Copyright (c) 2018 BaiQiang. All rights reserved.
+
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct ThreadPool {
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stop;
+};
+
+// threads <= 0 picks one per hardware thread, minus the caller's.
+ThreadPool *createThreadPool(int threads);
+
+void destroyThreadPool(ThreadPool *pool);
+
+void submitTask(ThreadPool *pool, std::function<void()> task);
+
+/*
+ * Runs fn(0) .. fn(count - 1) across the pool and returns when all are done.
+ * The calling thread takes indices too, so a null pool runs serially.
+ */
+void parallelFor(ThreadPool *pool, int count, const std::function<void(int)> &fn);
+
+#endif